@@ -0,0 +1,1135 @@
+#include "broadphase.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+#include <math.h>
+
+namespace Diana
+{
+    typedef struct PhysicsObject PO;
+
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+#define MAX(x, y) (((x) > (y)) ? (x) : (y))
+
+    // Fetch the d'th component of the lower or upper corner of a box.
+#define AABB_L(b, d) (((double *)&(b).l)[d])
+#define AABB_U(b, d) (((double *)&(b).u)[d])
+
+    // Whether two boxes overlap, or touch, on all three axes.
+    static bool aabb_overlap(struct AABB *a, struct AABB *b)
+    {
+        return (a->u.x >= b->l.x) && (b->u.x >= a->l.x) &&
+               (a->u.y >= b->l.y) && (b->u.y >= a->l.y) &&
+               (a->u.z >= b->l.z) && (b->u.z >= a->l.z);
+    }
+
+    SweepAndPrune::SweepAndPrune()
+    {
+        num_inserted = 0;
+        num_sorted = 0;
+        max_extent = 0.0;
+    }
+
+    SweepAndPrune::~SweepAndPrune()
+    {
+        for (size_t i = 0; i < proxies.size(); i++)
+        {
+            if (proxies[i] != NULL)
+            {
+                proxies[i]->proxy = -1;
+            }
+        }
+    }
+
+    bool SweepAndPrune::endpoint_less(const struct Endpoint &a, const struct Endpoint &b)
+    {
+        return (a.value < b.value) || ((a.value == b.value) && !a.is_max && b.is_max);
+    }
+
+    uint64_t SweepAndPrune::pair_key(uint32_t a, uint32_t b)
+    {
+        return (a < b ? (((uint64_t)a << 32) | b) : (((uint64_t)b << 32) | a));
+    }
+
+    bool SweepAndPrune::overlaps(uint32_t a, uint32_t b)
+    {
+        struct AABB &ba = boxes[a];
+        struct AABB &bb = boxes[b];
+        for (int32_t d = 0; d < 3; d++)
+        {
+            if ((AABB_U(ba, d) < AABB_L(bb, d)) || (AABB_U(bb, d) < AABB_L(ba, d)))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void SweepAndPrune::insert(PO *obj)
+    {
+        uint32_t p;
+        if (free_proxies.size() > 0)
+        {
+            p = free_proxies.back();
+            free_proxies.pop_back();
+            proxies[p] = obj;
+        }
+        else
+        {
+            p = (uint32_t)proxies.size();
+            proxies.push_back(obj);
+        }
+        obj->proxy = p;
+
+        // The values are filled in on the next update, at which point the new endpoints get
+        // sorted into place along with everything else.
+        for (int32_t d = 0; d < 3; d++)
+        {
+            axes[d].push_back({0.0, p, false});
+            axes[d].push_back({0.0, p, true});
+        }
+        num_inserted++;
+    }
+
+    void SweepAndPrune::remove(PO *obj)
+    {
+        if (obj->proxy < 0)
+        {
+            return;
+        }
+
+        // The endpoints and pairs are cleaned up in bulk on the next update, and the proxy
+        // isn't reused until then so that stale pairs can't be mistaken for new ones.
+        proxies[obj->proxy] = NULL;
+        removed_proxies.push_back((uint32_t)obj->proxy);
+        obj->proxy = -1;
+    }
+
+    void SweepAndPrune::purge()
+    {
+        if (removed_proxies.size() == 0)
+        {
+            return;
+        }
+
+        for (int32_t d = 0; d < 3; d++)
+        {
+            axes[d].erase(std::remove_if(axes[d].begin(), axes[d].end(),
+                                         [this](const struct Endpoint &e)
+                                         { return proxies[e.proxy] == NULL; }),
+                          axes[d].end());
+        }
+
+        for (std::unordered_set<uint64_t>::iterator it = pairs.begin(); it != pairs.end();)
+        {
+            if ((proxies[(uint32_t)(*it >> 32)] == NULL) || (proxies[(uint32_t)(*it & 0xFFFFFFFF)] == NULL))
+            {
+                it = pairs.erase(it);
+            }
+            else
+            {
+                it++;
+            }
+        }
+
+        free_proxies.insert(free_proxies.end(), removed_proxies.begin(), removed_proxies.end());
+        removed_proxies.clear();
+    }
+
+    void SweepAndPrune::sort_axis(int32_t d)
+    {
+        std::vector<struct Endpoint> &a = axes[d];
+
+        for (size_t i = 1; i < a.size(); i++)
+        {
+            struct Endpoint e = a[i];
+            size_t j = i;
+
+            while ((j > 0) && endpoint_less(e, a[j - 1]))
+            {
+                struct Endpoint &p = a[j - 1];
+
+                // A lower end moving down past an upper end means the two intervals have
+                // started to overlap on this axis, so they might overlap on all of them.
+                // An upper end moving down past a lower end means they no longer overlap.
+                // Swaps between two ends of the same kind don't change anything.
+                if (!e.is_max && p.is_max)
+                {
+                    if (overlaps(e.proxy, p.proxy))
+                    {
+                        pairs.insert(pair_key(e.proxy, p.proxy));
+                    }
+                }
+                else if (e.is_max && !p.is_max)
+                {
+                    pairs.erase(pair_key(e.proxy, p.proxy));
+                }
+
+                a[j] = p;
+                j--;
+            }
+
+            a[j] = e;
+        }
+    }
+
+    void SweepAndPrune::rebuild()
+    {
+        for (int32_t d = 0; d < 3; d++)
+        {
+            std::sort(axes[d].begin(), axes[d].end(), endpoint_less);
+        }
+
+        pairs.clear();
+
+        // Sweep along X, keeping track of the intervals we're inside of, and test each new
+        // interval against all of those on the other two axes.
+        std::vector<uint32_t> active;
+        std::vector<size_t> active_index(proxies.size(), 0);
+        std::vector<struct Endpoint> &a = axes[0];
+
+        for (size_t i = 0; i < a.size(); i++)
+        {
+            uint32_t p = a[i].proxy;
+            if (a[i].is_max)
+            {
+                // Swap-remove it from the active list.
+                size_t k = active_index[p];
+                active[k] = active.back();
+                active_index[active[k]] = k;
+                active.pop_back();
+            }
+            else
+            {
+                for (size_t k = 0; k < active.size(); k++)
+                {
+                    if (overlaps(p, active[k]))
+                    {
+                        pairs.insert(pair_key(p, active[k]));
+                    }
+                }
+                active_index[p] = active.size();
+                active.push_back(p);
+            }
+        }
+    }
+
+    void SweepAndPrune::update()
+    {
+        purge();
+
+        boxes.resize(proxies.size());
+        max_extent = 0.0;
+        for (size_t i = 0; i < proxies.size(); i++)
+        {
+            if (proxies[i] != NULL)
+            {
+                boxes[i] = proxies[i]->box;
+                max_extent = MAX(max_extent, boxes[i].u.x - boxes[i].l.x);
+            }
+        }
+
+        for (int32_t d = 0; d < 3; d++)
+        {
+            std::vector<struct Endpoint> &a = axes[d];
+            for (size_t i = 0; i < a.size(); i++)
+            {
+                struct AABB &b = boxes[a[i].proxy];
+                a[i].value = (a[i].is_max ? AABB_U(b, d) : AABB_L(b, d));
+            }
+        }
+
+        // A large batch of new objects each have to travel a long way through the lists from
+        // the end, so past a point it is cheaper to start over than to sort incrementally.
+        if ((num_inserted * 4) > (axes[0].size() / 2))
+        {
+            rebuild();
+        }
+        else
+        {
+            for (int32_t d = 0; d < 3; d++)
+            {
+                sort_axis(d);
+            }
+        }
+
+        num_inserted = 0;
+        num_sorted = axes[0].size();
+    }
+
+    void SweepAndPrune::get_pairs(std::vector<struct BroadPhasePair> &out)
+    {
+        out.clear();
+        out.reserve(pairs.size());
+        for (std::unordered_set<uint64_t>::iterator it = pairs.begin(); it != pairs.end(); it++)
+        {
+            out.push_back({proxies[(uint32_t)(*it >> 32)], proxies[(uint32_t)(*it & 0xFFFFFFFF)]});
+        }
+    }
+
+    void SweepAndPrune::query(struct AABB *box, std::vector<PO *> &out)
+    {
+        // No box is wider than max_extent along X, so anything that overlaps this one has its lower
+        // end somewhere in [l - max_extent, u] on the X endpoint list, as sorted by the last update.
+        std::vector<struct Endpoint>::iterator begin = axes[0].begin();
+        struct Endpoint start = {box->l.x - max_extent, 0, false};
+        size_t i = std::lower_bound(begin, begin + num_sorted, start, endpoint_less) - begin;
+
+        for (; (i < num_sorted) && (axes[0][i].value <= box->u.x); i++)
+        {
+            uint32_t p = axes[0][i].proxy;
+            if (!axes[0][i].is_max && (proxies[p] != NULL) && aabb_overlap(box, &boxes[p]))
+            {
+                out.push_back(proxies[p]);
+            }
+        }
+    }
+
+    SpatialHashGrid::SpatialHashGrid(double cell_size)
+    {
+        this->cell_size = cell_size;
+        base_size = cell_size;
+        bucket_mask = 0;
+        buckets.push_back(0);
+        buckets.push_back(0);
+    }
+
+    SpatialHashGrid::~SpatialHashGrid()
+    {
+        for (size_t i = 0; i < proxies.size(); i++)
+        {
+            if (proxies[i] != NULL)
+            {
+                proxies[i]->proxy = -1;
+            }
+        }
+    }
+
+    bool SpatialHashGrid::cell_equal(const struct Cell &a, const struct Cell &b)
+    {
+        return (a.x == b.x) && (a.y == b.y) && (a.z == b.z) && (a.level == b.level);
+    }
+
+    uint64_t SpatialHashGrid::cell_hash(const struct Cell &c)
+    {
+        // Large primes from Teschner et al., Optimized Spatial Hashing for Collision Detection
+        // of Deformable Objects.
+        uint64_t h = ((uint64_t)c.x * 73856093ULL) ^ ((uint64_t)c.y * 19349663ULL) ^
+                     ((uint64_t)c.z * 83492791ULL) ^ ((uint64_t)c.level * 2654435761ULL);
+        return (h ^ (h >> 29)) & bucket_mask;
+    }
+
+    struct SpatialHashGrid::Cell SpatialHashGrid::cell_of(struct Vector3 *v, int32_t level)
+    {
+        double size = ldexp(base_size, level);
+        struct Cell c;
+        c.x = (int64_t)floor(v->x / size);
+        c.y = (int64_t)floor(v->y / size);
+        c.z = (int64_t)floor(v->z / size);
+        c.level = level;
+        return c;
+    }
+
+    void SpatialHashGrid::cell_range(struct AABB *box, int32_t level, struct Cell &lo, struct Cell &hi)
+    {
+        lo = cell_of(&box->l, level);
+        hi = cell_of(&box->u, level);
+    }
+
+    void SpatialHashGrid::insert(PO *obj)
+    {
+        uint32_t p;
+        if (free_proxies.size() > 0)
+        {
+            p = free_proxies.back();
+            free_proxies.pop_back();
+            proxies[p] = obj;
+        }
+        else
+        {
+            p = (uint32_t)proxies.size();
+            proxies.push_back(obj);
+            levels.push_back(0);
+        }
+        obj->proxy = p;
+    }
+
+    void SpatialHashGrid::remove(PO *obj)
+    {
+        if (obj->proxy < 0)
+        {
+            return;
+        }
+
+        // The table is rebuilt from scratch on every update, so the proxy can be reused right away.
+        proxies[obj->proxy] = NULL;
+        free_proxies.push_back((uint32_t)obj->proxy);
+        obj->proxy = -1;
+    }
+
+    void SpatialHashGrid::update()
+    {
+        base_size = cell_size;
+        if (!(base_size > 0))
+        {
+            base_size = INFINITY;
+            for (size_t i = 0; i < proxies.size(); i++)
+            {
+                if (proxies[i] != NULL)
+                {
+                    struct AABB &b = proxies[i]->box;
+                    double extent = MAX(b.u.x - b.l.x, MAX(b.u.y - b.l.y, b.u.z - b.l.z));
+                    if (extent > 0)
+                    {
+                        base_size = MIN(base_size, extent);
+                    }
+                }
+            }
+
+            if (isinf(base_size))
+            {
+                base_size = 1.0;
+            }
+        }
+
+        // Pick a level for every box, and list the cells it covers there.
+        boxes.resize(proxies.size());
+        unsorted_entries.clear();
+        std::vector<bool> level_used;
+        for (size_t i = 0; i < proxies.size(); i++)
+        {
+            if (proxies[i] == NULL)
+            {
+                continue;
+            }
+
+            boxes[i] = proxies[i]->box;
+            struct AABB &b = boxes[i];
+            double extent = MAX(b.u.x - b.l.x, MAX(b.u.y - b.l.y, b.u.z - b.l.z));
+            int32_t level = 0;
+            if (extent > base_size)
+            {
+                level = (int32_t)ceil(log2(extent / base_size));
+                // Guard against rounding in log2() leaving the cells just a bit too small.
+                while (ldexp(base_size, level) < extent)
+                {
+                    level++;
+                }
+            }
+            levels[i] = level;
+
+            if ((size_t)level >= level_used.size())
+            {
+                level_used.resize(level + 1, false);
+            }
+            level_used[level] = true;
+
+            struct Cell lo, hi;
+            cell_range(&b, level, lo, hi);
+            for (int64_t x = lo.x; x <= hi.x; x++)
+            {
+                for (int64_t y = lo.y; y <= hi.y; y++)
+                {
+                    for (int64_t z = lo.z; z <= hi.z; z++)
+                    {
+                        unsorted_entries.push_back({{x, y, z, level}, (uint32_t)i});
+                    }
+                }
+            }
+        }
+
+        occupied_levels.clear();
+        for (size_t l = 0; l < level_used.size(); l++)
+        {
+            if (level_used[l])
+            {
+                occupied_levels.push_back((int32_t)l);
+            }
+        }
+
+        // Size the table to keep it at most half full, and then counting-sort the entries
+        // into their buckets.
+        size_t num_buckets = 2;
+        while (num_buckets < 2 * unsorted_entries.size())
+        {
+            num_buckets *= 2;
+        }
+        bucket_mask = num_buckets - 1;
+
+        buckets.assign(num_buckets + 1, 0);
+        for (size_t i = 0; i < unsorted_entries.size(); i++)
+        {
+            buckets[cell_hash(unsorted_entries[i].cell) + 1]++;
+        }
+        for (size_t b = 0; b < num_buckets; b++)
+        {
+            buckets[b + 1] += buckets[b];
+        }
+
+        entries.resize(unsorted_entries.size());
+        std::vector<uint32_t> next(buckets.begin(), buckets.end() - 1);
+        for (size_t i = 0; i < unsorted_entries.size(); i++)
+        {
+            entries[next[cell_hash(unsorted_entries[i].cell)]++] = unsorted_entries[i];
+        }
+    }
+
+    void SpatialHashGrid::get_pairs(std::vector<struct BroadPhasePair> &out)
+    {
+        out.clear();
+
+        for (size_t i = 0; i < proxies.size(); i++)
+        {
+            if (proxies[i] == NULL)
+            {
+                continue;
+            }
+
+            struct AABB &a = boxes[i];
+
+            // Look for boxes on this level and every coarser one. Boxes on finer levels find
+            // this one when it's their turn.
+            std::vector<int32_t>::iterator lit = std::lower_bound(occupied_levels.begin(), occupied_levels.end(), levels[i]);
+            for (; lit != occupied_levels.end(); lit++)
+            {
+                int32_t level = *lit;
+                struct Cell lo, hi, c;
+                cell_range(&a, level, lo, hi);
+                c.level = level;
+
+                for (c.x = lo.x; c.x <= hi.x; c.x++)
+                {
+                    for (c.y = lo.y; c.y <= hi.y; c.y++)
+                    {
+                        for (c.z = lo.z; c.z <= hi.z; c.z++)
+                        {
+                            uint64_t h = cell_hash(c);
+                            for (uint32_t e = buckets[h]; e < buckets[h + 1]; e++)
+                            {
+                                struct Entry &en = entries[e];
+                                // Pairs on the same level are seen from both sides, so only
+                                // report them from one.
+                                if (!cell_equal(en.cell, c) || ((level == levels[i]) && (en.proxy <= i)))
+                                {
+                                    continue;
+                                }
+
+                                struct AABB &b = boxes[en.proxy];
+                                if (!aabb_overlap(&a, &b))
+                                {
+                                    continue;
+                                }
+
+                                // Two boxes can share more than one cell. The corner of their
+                                // intersection is in exactly one of those, and that's the only
+                                // one the pair is reported from.
+                                struct Vector3 corner = {MAX(a.l.x, b.l.x), MAX(a.l.y, b.l.y), MAX(a.l.z, b.l.z)};
+                                if (!cell_equal(cell_of(&corner, level), c))
+                                {
+                                    continue;
+                                }
+
+                                out.push_back({proxies[i], proxies[en.proxy]});
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    void SpatialHashGrid::query(struct AABB *box, std::vector<PO *> &out)
+    {
+        for (size_t l = 0; l < occupied_levels.size(); l++)
+        {
+            int32_t level = occupied_levels[l];
+            struct Cell lo, hi, c;
+            cell_range(box, level, lo, hi);
+            c.level = level;
+
+            // A large query box on a fine level can cover a lot of cells, most of them empty,
+            // so it's faster to just check every entry on the level instead.
+            double num_cells = (double)(hi.x - lo.x + 1) * (double)(hi.y - lo.y + 1) * (double)(hi.z - lo.z + 1);
+            if (num_cells > (double)entries.size())
+            {
+                for (size_t e = 0; e < entries.size(); e++)
+                {
+                    struct Entry &en = entries[e];
+                    if (en.cell.level != level)
+                    {
+                        continue;
+                    }
+
+                    struct AABB &b = boxes[en.proxy];
+                    struct Vector3 corner = {MAX(box->l.x, b.l.x), MAX(box->l.y, b.l.y), MAX(box->l.z, b.l.z)};
+                    if (aabb_overlap(box, &b) && cell_equal(cell_of(&corner, level), en.cell))
+                    {
+                        out.push_back(proxies[en.proxy]);
+                    }
+                }
+                continue;
+            }
+
+            for (c.x = lo.x; c.x <= hi.x; c.x++)
+            {
+                for (c.y = lo.y; c.y <= hi.y; c.y++)
+                {
+                    for (c.z = lo.z; c.z <= hi.z; c.z++)
+                    {
+                        uint64_t h = cell_hash(c);
+                        for (uint32_t e = buckets[h]; e < buckets[h + 1]; e++)
+                        {
+                            struct Entry &en = entries[e];
+                            if (!cell_equal(en.cell, c))
+                            {
+                                continue;
+                            }
+
+                            struct AABB &b = boxes[en.proxy];
+                            struct Vector3 corner = {MAX(box->l.x, b.l.x), MAX(box->l.y, b.l.y), MAX(box->l.z, b.l.z)};
+                            if (aabb_overlap(box, &b) && cell_equal(cell_of(&corner, level), c))
+                            {
+                                out.push_back(proxies[en.proxy]);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Union of two boxes.
+    static void aabb_union(struct AABB *a, struct AABB *b, struct AABB *out)
+    {
+        out->l.x = MIN(a->l.x, b->l.x);
+        out->l.y = MIN(a->l.y, b->l.y);
+        out->l.z = MIN(a->l.z, b->l.z);
+        out->u.x = MAX(a->u.x, b->u.x);
+        out->u.y = MAX(a->u.y, b->u.y);
+        out->u.z = MAX(a->u.z, b->u.z);
+    }
+
+    // Surface area of a box, which is the cost that the tree tries to keep low.
+    static double aabb_area(struct AABB *a)
+    {
+        double dx = a->u.x - a->l.x;
+        double dy = a->u.y - a->l.y;
+        double dz = a->u.z - a->l.z;
+        return 2 * (dx * dy + dy * dz + dz * dx);
+    }
+
+    // Whether a contains b entirely.
+    static bool aabb_contains(struct AABB *a, struct AABB *b)
+    {
+        return (a->l.x <= b->l.x) && (a->l.y <= b->l.y) && (a->l.z <= b->l.z) &&
+               (b->u.x <= a->u.x) && (b->u.y <= a->u.y) && (b->u.z <= a->u.z);
+    }
+
+    AABBTree::AABBTree(double margin, double lookahead)
+    {
+        this->margin = margin;
+        this->lookahead = lookahead;
+        root = -1;
+        free_list = -1;
+    }
+
+    AABBTree::~AABBTree()
+    {
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            if ((nodes[i].height == 0) && (nodes[i].obj != NULL))
+            {
+                nodes[i].obj->proxy = -1;
+            }
+        }
+    }
+
+    uint64_t AABBTree::pair_key(int32_t a, int32_t b)
+    {
+        return (a < b ? (((uint64_t)a << 32) | (uint32_t)b) : (((uint64_t)b << 32) | (uint32_t)a));
+    }
+
+    int32_t AABBTree::alloc_node()
+    {
+        int32_t n;
+        if (free_list != -1)
+        {
+            n = free_list;
+            free_list = nodes[n].parent;
+        }
+        else
+        {
+            n = (int32_t)nodes.size();
+            nodes.push_back(TreeNode());
+        }
+
+        nodes[n].obj = NULL;
+        nodes[n].parent = -1;
+        nodes[n].child1 = -1;
+        nodes[n].child2 = -1;
+        nodes[n].height = 0;
+        return n;
+    }
+
+    void AABBTree::free_node(int32_t n)
+    {
+        nodes[n].obj = NULL;
+        nodes[n].parent = free_list;
+        nodes[n].height = -1;
+        free_list = n;
+    }
+
+    void AABBTree::fatten(PO *obj, struct AABB *fat)
+    {
+        // Use the largest dimension, so that flat or thin boxes still get some room to move.
+        struct AABB *box = &obj->box;
+        double extent = MAX(box->u.x - box->l.x, MAX(box->u.y - box->l.y, box->u.z - box->l.z));
+        double m = margin * extent;
+        fat->l.x = box->l.x - m;
+        fat->l.y = box->l.y - m;
+        fat->l.z = box->l.z - m;
+        fat->u.x = box->u.x + m;
+        fat->u.y = box->u.y + m;
+        fat->u.z = box->u.z + m;
+
+        // Then stretch it out ahead of the object, so that it has somewhere to go before it needs
+        // a new box. Stretching only the leading side keeps the box small for fast objects.
+        struct Vector3 d = obj->velocity;
+        Vector3_scale(&d, lookahead);
+        fat->l.x += MIN(d.x, 0.0);
+        fat->l.y += MIN(d.y, 0.0);
+        fat->l.z += MIN(d.z, 0.0);
+        fat->u.x += MAX(d.x, 0.0);
+        fat->u.y += MAX(d.y, 0.0);
+        fat->u.z += MAX(d.z, 0.0);
+    }
+
+    void AABBTree::insert_leaf(int32_t leaf)
+    {
+        if (root == -1)
+        {
+            root = leaf;
+            nodes[root].parent = -1;
+            return;
+        }
+
+        // Walk down the tree towards the sibling that would add the least surface area, stopping
+        // when making a new parent right here is cheaper than descending any further.
+        struct AABB leaf_box = nodes[leaf].box;
+        struct AABB combined;
+        int32_t index = root;
+        while (nodes[index].child1 != -1)
+        {
+            int32_t c1 = nodes[index].child1;
+            int32_t c2 = nodes[index].child2;
+
+            double area = aabb_area(&nodes[index].box);
+            aabb_union(&nodes[index].box, &leaf_box, &combined);
+            double combined_area = aabb_area(&combined);
+
+            // Cost of a new parent for this node and the new leaf.
+            double cost = 2 * combined_area;
+            // Minimum cost of pushing the leaf further down the tree.
+            double inheritance_cost = 2 * (combined_area - area);
+
+            double cost1, cost2;
+            aabb_union(&nodes[c1].box, &leaf_box, &combined);
+            cost1 = aabb_area(&combined) + inheritance_cost;
+            if (nodes[c1].child1 != -1)
+            {
+                cost1 -= aabb_area(&nodes[c1].box);
+            }
+            aabb_union(&nodes[c2].box, &leaf_box, &combined);
+            cost2 = aabb_area(&combined) + inheritance_cost;
+            if (nodes[c2].child1 != -1)
+            {
+                cost2 -= aabb_area(&nodes[c2].box);
+            }
+
+            if ((cost < cost1) && (cost < cost2))
+            {
+                break;
+            }
+
+            index = (cost1 < cost2 ? c1 : c2);
+        }
+
+        int32_t sibling = index;
+        int32_t old_parent = nodes[sibling].parent;
+        int32_t new_parent = alloc_node();
+        nodes[new_parent].parent = old_parent;
+        aabb_union(&leaf_box, &nodes[sibling].box, &nodes[new_parent].box);
+        nodes[new_parent].height = nodes[sibling].height + 1;
+        nodes[new_parent].child1 = sibling;
+        nodes[new_parent].child2 = leaf;
+        nodes[sibling].parent = new_parent;
+        nodes[leaf].parent = new_parent;
+
+        if (old_parent == -1)
+        {
+            root = new_parent;
+        }
+        else if (nodes[old_parent].child1 == sibling)
+        {
+            nodes[old_parent].child1 = new_parent;
+        }
+        else
+        {
+            nodes[old_parent].child2 = new_parent;
+        }
+
+        refit(nodes[leaf].parent);
+    }
+
+    void AABBTree::remove_leaf(int32_t leaf)
+    {
+        if (leaf == root)
+        {
+            root = -1;
+            return;
+        }
+
+        int32_t parent = nodes[leaf].parent;
+        int32_t grandparent = nodes[parent].parent;
+        int32_t sibling = (nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1);
+
+        // The sibling takes the parent's place.
+        nodes[sibling].parent = grandparent;
+        free_node(parent);
+        nodes[leaf].parent = -1;
+
+        if (grandparent == -1)
+        {
+            root = sibling;
+            return;
+        }
+
+        if (nodes[grandparent].child1 == parent)
+        {
+            nodes[grandparent].child1 = sibling;
+        }
+        else
+        {
+            nodes[grandparent].child2 = sibling;
+        }
+        refit(grandparent);
+    }
+
+    void AABBTree::refit(int32_t n)
+    {
+        while (n != -1)
+        {
+            n = balance(n);
+
+            struct TreeNode &node = nodes[n];
+            struct TreeNode &c1 = nodes[node.child1];
+            struct TreeNode &c2 = nodes[node.child2];
+            node.height = 1 + MAX(c1.height, c2.height);
+            aabb_union(&c1.box, &c2.box, &node.box);
+
+            n = node.parent;
+        }
+    }
+
+    int32_t AABBTree::balance(int32_t ia)
+    {
+        struct TreeNode &a = nodes[ia];
+        if ((a.child1 == -1) || (a.height < 2))
+        {
+            return ia;
+        }
+
+        int32_t ib = a.child1;
+        int32_t ic = a.child2;
+        struct TreeNode &b = nodes[ib];
+        struct TreeNode &c = nodes[ic];
+        int32_t skew = c.height - b.height;
+
+        // Which of a's children gets promoted, and which of the promoted child's own children
+        // takes its place under a.
+        int32_t ip, iq;
+        if (skew > 1)
+        {
+            ip = ic;
+            iq = ib;
+        }
+        else if (skew < -1)
+        {
+            ip = ib;
+            iq = ic;
+        }
+        else
+        {
+            return ia;
+        }
+
+        struct TreeNode &p = nodes[ip];
+        struct TreeNode &q = nodes[iq];
+        int32_t if_ = p.child1;
+        int32_t ig = p.child2;
+        struct TreeNode &f = nodes[if_];
+        struct TreeNode &g = nodes[ig];
+
+        // Promote p to a's position.
+        p.child1 = ia;
+        p.parent = a.parent;
+        a.parent = ip;
+
+        if (p.parent == -1)
+        {
+            root = ip;
+        }
+        else if (nodes[p.parent].child1 == ia)
+        {
+            nodes[p.parent].child1 = ip;
+        }
+        else
+        {
+            nodes[p.parent].child2 = ip;
+        }
+
+        // The taller of p's children stays with p, and the shorter one moves under a, in the
+        // slot that p used to occupy.
+        int32_t keep = (f.height > g.height ? if_ : ig);
+        int32_t give = (f.height > g.height ? ig : if_);
+        p.child2 = keep;
+        if (a.child1 == ip)
+        {
+            a.child1 = give;
+        }
+        else
+        {
+            a.child2 = give;
+        }
+        nodes[give].parent = ia;
+
+        aabb_union(&q.box, &nodes[give].box, &a.box);
+        a.height = 1 + MAX(q.height, nodes[give].height);
+        aabb_union(&a.box, &nodes[keep].box, &p.box);
+        p.height = 1 + MAX(a.height, nodes[keep].height);
+
+        return ip;
+    }
+
+    void AABBTree::insert(PO *obj)
+    {
+        int32_t leaf = alloc_node();
+        nodes[leaf].obj = obj;
+        obj->proxy = leaf;
+
+        // The box isn't valid until the next update, so the leaf goes into the tree then.
+        moved.push_back(leaf);
+    }
+
+    void AABBTree::remove(PO *obj)
+    {
+        if (obj->proxy < 0)
+        {
+            return;
+        }
+
+        // Take it out of the tree right away, so that no queries can find it after the object
+        // is gone. The leaf isn't reused until its pairs have been purged in the next update,
+        // so that stale pairs can't be mistaken for new ones.
+        int32_t leaf = obj->proxy;
+        if ((nodes[leaf].parent != -1) || (root == leaf))
+        {
+            remove_leaf(leaf);
+        }
+        nodes[leaf].obj = NULL;
+        removed.push_back(leaf);
+        obj->proxy = -1;
+    }
+
+    void AABBTree::purge()
+    {
+        if (removed.size() == 0)
+        {
+            return;
+        }
+
+        for (std::unordered_set<uint64_t>::iterator it = pairs.begin(); it != pairs.end();)
+        {
+            if ((nodes[(int32_t)(*it >> 32)].obj == NULL) || (nodes[(int32_t)(*it & 0xFFFFFFFF)].obj == NULL))
+            {
+                it = pairs.erase(it);
+            }
+            else
+            {
+                it++;
+            }
+        }
+
+        // Leaves that were added and then removed before an update are still in the list of
+        // moved leaves, and shouldn't be looked at once they're freed.
+        moved.erase(std::remove_if(moved.begin(), moved.end(),
+                                   [this](int32_t n)
+                                   { return nodes[n].obj == NULL; }),
+                    moved.end());
+
+        for (size_t i = 0; i < removed.size(); i++)
+        {
+            free_node(removed[i]);
+        }
+        removed.clear();
+    }
+
+    void AABBTree::update()
+    {
+        purge();
+
+        // New leaves go into the tree for the first time. They don't have any cached pairs yet,
+        // so count them as misses.
+        size_t num_new = moved.size();
+        for (size_t i = 0; i < moved.size(); i++)
+        {
+            int32_t leaf = moved[i];
+            fatten(nodes[leaf].obj, &nodes[leaf].box);
+            insert_leaf(leaf);
+        }
+
+        // Leaves that escaped from their fat boxes get a new one, and a new place in the tree.
+        cache_hits = 0;
+        cache_misses = 0;
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            struct TreeNode &node = nodes[i];
+            if ((node.height != 0) || (node.obj == NULL))
+            {
+                continue;
+            }
+
+            if (aabb_contains(&node.box, &node.obj->box))
+            {
+                cache_hits++;
+                continue;
+            }
+
+            cache_misses++;
+            remove_leaf((int32_t)i);
+            fatten(nodes[i].obj, &nodes[i].box);
+            insert_leaf((int32_t)i);
+            moved.push_back((int32_t)i);
+        }
+        cache_hits -= num_new;
+        cache_misses += num_new;
+
+        // Only leaves that moved can have new pairs.
+        for (size_t i = 0; i < moved.size(); i++)
+        {
+            int32_t leaf = moved[i];
+            struct AABB box = nodes[leaf].box;
+
+            stack.clear();
+            stack.push_back(root);
+            while (stack.size() > 0)
+            {
+                int32_t n = stack.back();
+                stack.pop_back();
+
+                if ((n == leaf) || !aabb_overlap(&nodes[n].box, &box))
+                {
+                    continue;
+                }
+
+                if (nodes[n].child1 == -1)
+                {
+                    pairs.insert(pair_key(leaf, n));
+                }
+                else
+                {
+                    stack.push_back(nodes[n].child1);
+                    stack.push_back(nodes[n].child2);
+                }
+            }
+        }
+        moved.clear();
+    }
+
+    void AABBTree::get_pairs(std::vector<struct BroadPhasePair> &out)
+    {
+        out.clear();
+        out.reserve(pairs.size());
+
+        for (std::unordered_set<uint64_t>::iterator it = pairs.begin(); it != pairs.end();)
+        {
+            struct TreeNode &a = nodes[(int32_t)(*it >> 32)];
+            struct TreeNode &b = nodes[(int32_t)(*it & 0xFFFFFFFF)];
+
+            if (!aabb_overlap(&a.box, &b.box))
+            {
+                it = pairs.erase(it);
+                continue;
+            }
+
+            out.push_back({a.obj, b.obj});
+            it++;
+        }
+    }
+
+    void AABBTree::query(struct AABB *box, std::function<bool(PO *)> visit)
+    {
+        if (root == -1)
+        {
+            return;
+        }
+
+        // Queries can run on several threads at once, so they can't share the scratch stack.
+        std::vector<int32_t> stack;
+        stack.reserve(2 * (nodes[root].height + 1));
+        stack.push_back(root);
+        while (stack.size() > 0)
+        {
+            int32_t n = stack.back();
+            stack.pop_back();
+
+            if (!aabb_overlap(&nodes[n].box, box))
+            {
+                continue;
+            }
+
+            if (nodes[n].child1 == -1)
+            {
+                if (!visit(nodes[n].obj))
+                {
+                    return;
+                }
+            }
+            else
+            {
+                stack.push_back(nodes[n].child1);
+                stack.push_back(nodes[n].child2);
+            }
+        }
+    }
+
+    void AABBTree::query(struct AABB *box, std::vector<PO *> &out)
+    {
+        query(box, [&out](PO *obj)
+              {
+                  out.push_back(obj);
+                  return true; });
+    }
+
+    int32_t AABBTree::height()
+    {
+        return (root == -1 ? 0 : nodes[root].height);
+    }
+
+    BroadPhase *BroadPhase_create(int32_t type, double grid_cell_size, double tree_margin, double tree_lookahead)
+    {
+        switch (type)
+        {
+        case BROADPHASE_SORTED_LIST:
+            return NULL;
+        case BROADPHASE_SWEEP_AND_PRUNE:
+            return new SweepAndPrune();
+        case BROADPHASE_HASH_GRID:
+            return new SpatialHashGrid(grid_cell_size);
+        case BROADPHASE_AABB_TREE:
+            return new AABBTree(tree_margin, tree_lookahead);
+        default:
+            throw std::runtime_error("BroadPhase_create::UnknownBroadPhaseType");
+        }
+    }
+}
@@ -0,0 +1,213 @@
+#include "ephemeris.hpp"
+#include "physics.hpp"
+
+#include <math.h>
+#include <stdexcept>
+#include <algorithm>
+
+// Orbits with less eccentricity than this are treated as circular, since the direction to
+// periapsis isn't well defined for them.
+#define CIRCULAR_CUTOFF 1e-12
+// Newton's method on Kepler's equation converges quadratically, so this is plenty.
+#define KEPLER_MAX_ITERATIONS 32
+#define KEPLER_TOLERANCE 1e-15
+// Chains of parents longer than this are assumed to loop back on themselves.
+#define RAILS_MAX_DEPTH 1024
+
+namespace Diana
+{
+    typedef struct Vector3 V3;
+
+    void KeplerOrbit_from_state(struct KeplerOrbit *orbit, double mu, V3 *position, V3 *velocity, double epoch)
+    {
+        double r = Vector3_length(position);
+        double v2 = Vector3_length2(velocity);
+        if ((r <= 0.0) || (mu <= 0.0))
+        {
+            throw std::runtime_error("Ephemeris::DegenerateOrbit");
+        }
+
+        // Vis-viva gives the semi-major axis, which is only positive for bound orbits.
+        double a = 1.0 / (2.0 / r - v2 / mu);
+        if (!(a > 0.0))
+        {
+            throw std::runtime_error("Ephemeris::UnboundOrbit");
+        }
+
+        // Angular momentum, and the eccentricity vector, which points at periapsis.
+        V3 h;
+        Vector3_cross(&h, position, velocity);
+        double h_len = Vector3_length(&h);
+        if (h_len <= 0.0)
+        {
+            throw std::runtime_error("Ephemeris::DegenerateOrbit");
+        }
+
+        V3 ev;
+        Vector3_cross(&ev, velocity, &h);
+        Vector3_scale(&ev, 1.0 / mu);
+        Vector3_fmad(&ev, -1.0 / r, position);
+        double e = Vector3_length(&ev);
+
+        orbit->mu = mu;
+        orbit->a = a;
+        orbit->n = sqrt(mu / (a * a * a));
+        orbit->epoch = epoch;
+
+        double E;
+        if (e < CIRCULAR_CUTOFF)
+        {
+            // Measure from where the object is now.
+            orbit->e = 0.0;
+            Vector3_scale(&orbit->P, position, 1.0 / r);
+            E = 0.0;
+        }
+        else
+        {
+            orbit->e = e;
+            Vector3_scale(&orbit->P, &ev, 1.0 / e);
+            double cosE = (1.0 - r / a) / e;
+            double sinE = Vector3_dot(position, velocity) / (e * sqrt(mu * a));
+            E = atan2(sinE, cosE);
+        }
+
+        Vector3_cross(&orbit->Q, &h, &orbit->P);
+        Vector3_scale(&orbit->Q, 1.0 / h_len);
+        orbit->M0 = E - orbit->e * sin(E);
+    }
+
+    void KeplerOrbit_evaluate(struct KeplerOrbit *orbit, double t, V3 *position, V3 *velocity)
+    {
+        double e = orbit->e;
+
+        // Keep the mean anomaly small so that the sines and cosines don't lose precision after
+        // many orbits.
+        double M = fmod(orbit->M0 + orbit->n * (t - orbit->epoch), 2 * M_PI);
+        if (M > M_PI)
+        {
+            M -= 2 * M_PI;
+        }
+        else if (M < -M_PI)
+        {
+            M += 2 * M_PI;
+        }
+
+        // Solve Kepler's equation, M = E - e sin(E), for the eccentric anomaly.
+        double E = (e < 0.8 ? M : (M < 0.0 ? -M_PI : M_PI));
+        for (int32_t i = 0; i < KEPLER_MAX_ITERATIONS; i++)
+        {
+            double step = (E - e * sin(E) - M) / (1.0 - e * cos(E));
+            E -= step;
+            if (fabs(step) < KEPLER_TOLERANCE)
+            {
+                break;
+            }
+        }
+
+        double cosE = cos(E);
+        double sinE = sin(E);
+        double b = sqrt(1.0 - e * e);
+        double r = orbit->a * (1.0 - e * cosE);
+        double x = orbit->a * (cosE - e);
+        double y = orbit->a * b * sinE;
+        double k = sqrt(orbit->mu * orbit->a) / r;
+        double vx = -k * sinE;
+        double vy = k * b * cosE;
+
+        Vector3_scale(position, &orbit->P, x);
+        Vector3_fmad(position, y, &orbit->Q);
+        Vector3_scale(velocity, &orbit->P, vx);
+        Vector3_fmad(velocity, vy, &orbit->Q);
+    }
+
+    void EphemerisTable_add(struct EphemerisTable *table, double t, V3 *position, V3 *velocity)
+    {
+        if ((table->times.size() > 0) && !(t > table->times.back()))
+        {
+            throw std::runtime_error("Ephemeris::TableOrder");
+        }
+
+        table->times.push_back(t);
+        table->positions.push_back(*position);
+        table->velocities.push_back(*velocity);
+    }
+
+    void EphemerisTable_evaluate(struct EphemerisTable *table, double t, V3 *position, V3 *velocity)
+    {
+        size_t n = table->times.size();
+        if (n == 0)
+        {
+            throw std::runtime_error("Ephemeris::EmptyTable");
+        }
+
+        // Before the first sample or after the last, carry on in a straight line.
+        size_t i = std::upper_bound(table->times.begin(), table->times.end(), t) - table->times.begin();
+        if ((i == 0) || (i == n))
+        {
+            size_t k = (i == 0 ? 0 : n - 1);
+            *position = table->positions[k];
+            Vector3_fmad(position, t - table->times[k], &table->velocities[k]);
+            *velocity = table->velocities[k];
+            return;
+        }
+
+        // Cubic Hermite spline between samples i - 1 and i, which matches both the positions and
+        // the velocities at each end.
+        double t0 = table->times[i - 1];
+        double h = table->times[i] - t0;
+        double s = (t - t0) / h;
+        double s2 = s * s;
+        double s3 = s2 * s;
+
+        V3 *p0 = &table->positions[i - 1];
+        V3 *p1 = &table->positions[i];
+        V3 *v0 = &table->velocities[i - 1];
+        V3 *v1 = &table->velocities[i];
+
+        Vector3_scale(position, p0, 2 * s3 - 3 * s2 + 1);
+        Vector3_fmad(position, h * (s3 - 2 * s2 + s), v0);
+        Vector3_fmad(position, -2 * s3 + 3 * s2, p1);
+        Vector3_fmad(position, h * (s3 - s2), v1);
+
+        Vector3_scale(velocity, p0, (6 * s2 - 6 * s) / h);
+        Vector3_fmad(velocity, 3 * s2 - 4 * s + 1, v0);
+        Vector3_fmad(velocity, (-6 * s2 + 6 * s) / h, p1);
+        Vector3_fmad(velocity, 3 * s2 - 2 * s, v1);
+    }
+
+    void Rails_evaluate(struct Rails *rails, double t, V3 *position, V3 *velocity)
+    {
+        switch (rails->type)
+        {
+        case RAILS_KEPLER:
+            KeplerOrbit_evaluate(&rails->orbit, t, position, velocity);
+            break;
+        case RAILS_TABLE:
+            EphemerisTable_evaluate(&rails->table, t, position, velocity);
+            break;
+        default:
+            throw std::runtime_error("Ephemeris::UnknownRailsType");
+        }
+
+        if (rails->parent != NULL)
+        {
+            Vector3_add(position, &rails->parent->position);
+            Vector3_add(velocity, &rails->parent->velocity);
+        }
+    }
+
+    int32_t Rails_depth(struct Rails *rails)
+    {
+        int32_t depth = 0;
+        while ((rails->parent != NULL) && (rails->parent->rails != NULL))
+        {
+            rails = rails->parent->rails;
+            depth++;
+            if (depth > RAILS_MAX_DEPTH)
+            {
+                throw std::runtime_error("Ephemeris::RailsCycle");
+            }
+        }
+        return depth;
+    }
+}
@@ -0,0 +1,452 @@
+#include "gravity.hpp"
+
+#include <math.h>
+#include <algorithm>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// Matches the cutoff that Vector3_normalize() uses.
+#define CHOP_CUTOFF 1e-8
+// Cells with this many attractors or fewer aren't split any further.
+#define LEAF_SIZE 8
+// Cells aren't split past this depth, which stops the tree from going on forever when several
+// attractors are in the same place.
+#define MAX_DEPTH 32
+
+namespace Diana
+{
+    typedef struct PhysicsObject PO;
+    typedef struct Vector3 V3;
+
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+#define MAX(x, y) (((x) > (y)) ? (x) : (y))
+
+    void AttractorSet_init(struct AttractorSet *set)
+    {
+        set->size = 0;
+        set->changed = false;
+    }
+
+    void AttractorSet_add(struct AttractorSet *set, PO *obj)
+    {
+        set->objs.push_back(obj);
+        set->changed = true;
+    }
+
+    void AttractorSet_remove(struct AttractorSet *set, int64_t phys_id)
+    {
+        for (size_t i = 0; i < set->objs.size(); i++)
+        {
+            if (set->objs[i]->phys_id == phys_id)
+            {
+                set->objs.erase(set->objs.begin() + i);
+                set->changed = true;
+                break;
+            }
+        }
+    }
+
+    void AttractorSet_refresh(struct AttractorSet *set)
+    {
+        size_t n = set->objs.size();
+        set->ids.resize(n);
+        set->px.resize(n);
+        set->py.resize(n);
+        set->pz.resize(n);
+        set->vx.resize(n);
+        set->vy.resize(n);
+        set->vz.resize(n);
+        set->mass.resize(n);
+
+        for (size_t i = 0; i < n; i++)
+        {
+            PO *obj = set->objs[i];
+            set->ids[i] = obj->phys_id;
+            set->px[i] = obj->position.x;
+            set->py[i] = obj->position.y;
+            set->pz[i] = obj->position.z;
+            set->vx[i] = obj->velocity.x;
+            set->vy[i] = obj->velocity.y;
+            set->vz[i] = obj->velocity.z;
+            set->mass[i] = obj->mass;
+        }
+        set->size = n;
+    }
+
+    void AttractorSet_interpolate(struct AttractorSet *out, struct AttractorSet *start, struct AttractorSet *end, double s, double dt)
+    {
+        size_t n = std::min(start->size, end->size);
+        out->ids.resize(n);
+        out->px.resize(n);
+        out->py.resize(n);
+        out->pz.resize(n);
+        out->vx.resize(n);
+        out->vy.resize(n);
+        out->vz.resize(n);
+        out->mass.resize(n);
+
+        // Hermite basis functions, for the positions and for the velocities scaled to the interval.
+        double s2 = s * s;
+        double s3 = s2 * s;
+        double h00 = 2 * s3 - 3 * s2 + 1;
+        double h10 = dt * (s3 - 2 * s2 + s);
+        double h01 = -2 * s3 + 3 * s2;
+        double h11 = dt * (s3 - s2);
+        double d00 = (6 * s2 - 6 * s) / dt;
+        double d10 = 3 * s2 - 4 * s + 1;
+        double d01 = (-6 * s2 + 6 * s) / dt;
+        double d11 = 3 * s2 - 2 * s;
+
+        for (size_t i = 0; i < n; i++)
+        {
+            out->ids[i] = end->ids[i];
+            out->mass[i] = end->mass[i];
+            out->px[i] = h00 * start->px[i] + h10 * start->vx[i] + h01 * end->px[i] + h11 * end->vx[i];
+            out->py[i] = h00 * start->py[i] + h10 * start->vy[i] + h01 * end->py[i] + h11 * end->vy[i];
+            out->pz[i] = h00 * start->pz[i] + h10 * start->vz[i] + h01 * end->pz[i] + h11 * end->vz[i];
+            out->vx[i] = d00 * start->px[i] + d10 * start->vx[i] + d01 * end->px[i] + d11 * end->vx[i];
+            out->vy[i] = d00 * start->py[i] + d10 * start->vy[i] + d01 * end->py[i] + d11 * end->vy[i];
+            out->vz[i] = d00 * start->pz[i] + d10 * start->vz[i] + d01 * end->pz[i] + d11 * end->vz[i];
+        }
+        out->size = n;
+    }
+
+    void AttractorSet_pull(struct AttractorSet *set, V3 *g, PO *obj, double G)
+    {
+        // The force from each attractor is G * M * m / d^2 along the normalized ray to it, with
+        // the ray left as it is when it's too short to normalize, the same as gravity() does it.
+        size_t i = 0;
+        size_t n = set->size;
+        double x = obj->position.x;
+        double y = obj->position.y;
+        double z = obj->position.z;
+        double m = obj->mass;
+        V3 sum = { 0.0, 0.0, 0.0 };
+
+#ifdef __AVX2__
+        const __m256d chop = _mm256_set1_pd(CHOP_CUTOFF);
+        const __m256d one = _mm256_set1_pd(1.0);
+        const __m256i self = _mm256_set1_epi64x(obj->phys_id);
+        const __m256d vG = _mm256_set1_pd(G);
+        const __m256d vm = _mm256_set1_pd(m);
+        const __m256d vx = _mm256_set1_pd(x);
+        const __m256d vy = _mm256_set1_pd(y);
+        const __m256d vz = _mm256_set1_pd(z);
+        __m256d ax = _mm256_setzero_pd();
+        __m256d ay = _mm256_setzero_pd();
+        __m256d az = _mm256_setzero_pd();
+
+        for (; i + 4 <= n; i += 4)
+        {
+            __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(&set->px[i]), vx);
+            __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(&set->py[i]), vy);
+            __m256d dz = _mm256_sub_pd(_mm256_loadu_pd(&set->pz[i]), vz);
+            __m256d d2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)), _mm256_mul_pd(dz, dz));
+            __m256d f = _mm256_div_pd(_mm256_mul_pd(_mm256_mul_pd(vG, _mm256_loadu_pd(&set->mass[i])), vm), d2);
+
+            __m256d l = _mm256_sqrt_pd(d2);
+            __m256d inv = _mm256_blendv_pd(_mm256_div_pd(one, l), one, _mm256_cmp_pd(l, chop, _CMP_LT_OQ));
+
+            // An object can't attract itself.
+            __m256d is_self = _mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_loadu_si256((__m256i *)&set->ids[i]), self));
+
+            ax = _mm256_add_pd(ax, _mm256_andnot_pd(is_self, _mm256_mul_pd(_mm256_mul_pd(dx, inv), f)));
+            ay = _mm256_add_pd(ay, _mm256_andnot_pd(is_self, _mm256_mul_pd(_mm256_mul_pd(dy, inv), f)));
+            az = _mm256_add_pd(az, _mm256_andnot_pd(is_self, _mm256_mul_pd(_mm256_mul_pd(dz, inv), f)));
+        }
+
+        double lanes[4];
+        _mm256_storeu_pd(lanes, ax);
+        sum.x = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+        _mm256_storeu_pd(lanes, ay);
+        sum.y = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+        _mm256_storeu_pd(lanes, az);
+        sum.z = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+
+        for (; i < n; i++)
+        {
+            if (set->ids[i] == obj->phys_id)
+            {
+                continue;
+            }
+
+            double dx = set->px[i] - x;
+            double dy = set->py[i] - y;
+            double dz = set->pz[i] - z;
+            double d2 = dx * dx + dy * dy + dz * dz;
+            double f = G * set->mass[i] * m / d2;
+
+            double l = sqrt(d2);
+            double inv = (l < CHOP_CUTOFF ? 1.0 : 1.0 / l);
+            sum.x += dx * inv * f;
+            sum.y += dy * inv * f;
+            sum.z += dz * inv * f;
+        }
+
+        Vector3_add(g, &sum);
+    }
+
+    BarnesHutTree::BarnesHutTree(double theta)
+    {
+        this->theta = theta;
+    }
+
+    size_t BarnesHutTree::size()
+    {
+        return ids.size();
+    }
+
+    void BarnesHutTree::build(struct AttractorSet *set)
+    {
+        size_t n = set->size;
+        nodes.clear();
+        positions.resize(n);
+        masses.resize(n);
+        ids.resize(n);
+        order.resize(n);
+        scratch.resize(n);
+        octants.resize(n);
+
+        if (n == 0)
+        {
+            return;
+        }
+
+        V3 l = { set->px[0], set->py[0], set->pz[0] };
+        V3 u = l;
+        for (size_t i = 0; i < n; i++)
+        {
+            V3 p = { set->px[i], set->py[i], set->pz[i] };
+            positions[i] = p;
+            masses[i] = set->mass[i];
+            ids[i] = set->ids[i];
+            order[i] = (uint32_t)i;
+
+            l.x = MIN(l.x, p.x);
+            l.y = MIN(l.y, p.y);
+            l.z = MIN(l.z, p.z);
+            u.x = MAX(u.x, p.x);
+            u.y = MAX(u.y, p.y);
+            u.z = MAX(u.z, p.z);
+        }
+
+        // The root is the smallest cube around every attractor, padded a little so that nothing
+        // sits right on its boundary.
+        struct TreeNode root;
+        root.center.x = 0.5 * (l.x + u.x);
+        root.center.y = 0.5 * (l.y + u.y);
+        root.center.z = 0.5 * (l.z + u.z);
+        root.half = 0.5 * MAX(MAX(u.x - l.x, u.y - l.y), u.z - l.z);
+        root.half = root.half * (1.0 + 1e-9) + 1e-9;
+        nodes.push_back(root);
+        build_node(0, 0, (uint32_t)n, 0);
+
+        // Put the attractors in tree order, so that each cell's attractors are next to each other.
+        std::vector<V3> sorted_positions(n);
+        std::vector<double> sorted_masses(n);
+        std::vector<int64_t> sorted_ids(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            sorted_positions[i] = positions[order[i]];
+            sorted_masses[i] = masses[order[i]];
+            sorted_ids[i] = ids[order[i]];
+        }
+        positions.swap(sorted_positions);
+        masses.swap(sorted_masses);
+        ids.swap(sorted_ids);
+    }
+
+    void BarnesHutTree::build_node(int32_t n, uint32_t begin, uint32_t end, int32_t depth)
+    {
+        // Only the node's center and size are filled in by the time we get here. Note that adding
+        // children can move the nodes around, so node n is always looked up by index.
+        nodes[n].begin = begin;
+        nodes[n].end = end;
+        nodes[n].first_child = -1;
+        nodes[n].num_children = 0;
+
+        if ((end - begin <= LEAF_SIZE) || (depth >= MAX_DEPTH))
+        {
+            double mass = 0.0;
+            V3 com = { 0.0, 0.0, 0.0 };
+            for (uint32_t i = begin; i < end; i++)
+            {
+                V3 *p = &positions[order[i]];
+                double m = masses[order[i]];
+                mass += m;
+                com.x += m * p->x;
+                com.y += m * p->y;
+                com.z += m * p->z;
+            }
+
+            nodes[n].mass = mass;
+            if (mass > 0.0)
+            {
+                Vector3_scale(&com, 1.0 / mass);
+                nodes[n].com = com;
+            }
+            else
+            {
+                nodes[n].com = nodes[n].center;
+            }
+            return;
+        }
+
+        // Sort the attractors into octants with a counting sort.
+        V3 c = nodes[n].center;
+        uint32_t counts[8] = { 0 };
+        for (uint32_t i = begin; i < end; i++)
+        {
+            V3 *p = &positions[order[i]];
+            uint8_t oct = (p->x >= c.x) | ((p->y >= c.y) << 1) | ((p->z >= c.z) << 2);
+            octants[i] = oct;
+            counts[oct]++;
+        }
+
+        uint32_t starts[8];
+        uint32_t offset = begin;
+        for (int32_t k = 0; k < 8; k++)
+        {
+            starts[k] = offset;
+            offset += counts[k];
+        }
+
+        uint32_t next[8];
+        std::copy(starts, starts + 8, next);
+        for (uint32_t i = begin; i < end; i++)
+        {
+            scratch[next[octants[i]]++] = order[i];
+        }
+        std::copy(scratch.begin() + begin, scratch.begin() + end, order.begin() + begin);
+
+        // Add a child for each octant that has something in it, and then build each of them.
+        double half = 0.5 * nodes[n].half;
+        int32_t first_child = (int32_t)nodes.size();
+        int32_t num_children = 0;
+        for (int32_t k = 0; k < 8; k++)
+        {
+            if (counts[k] == 0)
+            {
+                continue;
+            }
+
+            struct TreeNode child;
+            child.center.x = c.x + ((k & 1) ? half : -half);
+            child.center.y = c.y + ((k & 2) ? half : -half);
+            child.center.z = c.z + ((k & 4) ? half : -half);
+            child.half = half;
+            nodes.push_back(child);
+            num_children++;
+        }
+        nodes[n].first_child = first_child;
+        nodes[n].num_children = num_children;
+
+        int32_t child = first_child;
+        for (int32_t k = 0; k < 8; k++)
+        {
+            if (counts[k] > 0)
+            {
+                build_node(child++, starts[k], starts[k] + counts[k], depth + 1);
+            }
+        }
+
+        // The cell's mass and center of mass follow from those of its children.
+        double mass = 0.0;
+        V3 com = { 0.0, 0.0, 0.0 };
+        for (int32_t i = first_child; i < first_child + num_children; i++)
+        {
+            double m = nodes[i].mass;
+            mass += m;
+            com.x += m * nodes[i].com.x;
+            com.y += m * nodes[i].com.y;
+            com.z += m * nodes[i].com.z;
+        }
+
+        nodes[n].mass = mass;
+        if (mass > 0.0)
+        {
+            Vector3_scale(&com, 1.0 / mass);
+            nodes[n].com = com;
+        }
+        else
+        {
+            nodes[n].com = c;
+        }
+
+        // Measuring the distance from the center of mass alone lets through cells whose mass is
+        // bunched up on the side nearest the object, so the opening distance is pushed out by
+        // how far the center of mass is from the middle of the cell.
+        double skew = Vector3_distance(&nodes[n].com, &c);
+        double open = (theta > 0.0 ? 2.0 * nodes[n].half / theta + skew : INFINITY);
+        nodes[n].open2 = open * open;
+    }
+
+    // This is the same as gravity() in universe.cpp, with the attractor's position and mass
+    // taken from the tree.
+    static inline void add_force(V3 *g, V3 *p, double m, V3 *q, double M, double G)
+    {
+        V3 cg;
+        double f = G * M * m / Vector3_distance2(q, p);
+        Vector3_ray(&cg, p, q);
+        Vector3_scale(&cg, f);
+        Vector3_add(g, &cg);
+    }
+
+    void BarnesHutTree::add_body(V3 *g, V3 *p, double m, uint32_t i, double G)
+    {
+        add_force(g, p, m, &positions[i], masses[i], G);
+    }
+
+    void BarnesHutTree::pull(V3 *g, PO *obj, double G)
+    {
+        if (nodes.size() == 0)
+        {
+            return;
+        }
+
+        V3 *p = &obj->position;
+        double m = obj->mass;
+        // Each level of the walk adds at most eight nodes to the stack, and takes one off.
+        int32_t stack[8 * MAX_DEPTH + 1];
+        int32_t top = 0;
+        stack[top++] = 0;
+
+        while (top > 0)
+        {
+            struct TreeNode *node = &nodes[stack[--top]];
+
+            if (node->first_child < 0)
+            {
+                for (uint32_t i = node->begin; i < node->end; i++)
+                {
+                    // An object can't attract itself.
+                    if (ids[i] != obj->phys_id)
+                    {
+                        add_body(g, p, m, i, G);
+                    }
+                }
+                continue;
+            }
+
+            // A cell is only treated as a single body if the object isn't inside it, which also
+            // guarantees that an attractor never ends up pulling on itself.
+            bool inside = (fabs(p->x - node->center.x) <= node->half) &&
+                          (fabs(p->y - node->center.y) <= node->half) &&
+                          (fabs(p->z - node->center.z) <= node->half);
+
+            if (!inside && (Vector3_distance2(&node->com, p) > node->open2))
+            {
+                add_force(g, p, m, &node->com, node->mass, G);
+                continue;
+            }
+
+            for (int32_t i = node->first_child; i < node->first_child + node->num_children; i++)
+            {
+                stack[top++] = i;
+            }
+        }
+    }
+}
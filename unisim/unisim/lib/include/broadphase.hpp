@@ -0,0 +1,299 @@
+#ifndef BROADPHASE_HPP
+#define BROADPHASE_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <functional>
+#include <vector>
+#include <unordered_set>
+
+#include "vector.hpp"
+#include "physics.hpp"
+
+namespace Diana
+{
+    //! The broad-phase collision detection strategies that the universe can use.
+    //!
+    //! The sorted list is the universe's own sort_aabb()/check_collision_loop() sweep, and
+    //! doesn't have a BroadPhase object behind it. All of the others are kept up to date by
+    //! the universe through the BroadPhase interface.
+    enum BroadPhaseType
+    {
+        BROADPHASE_SORTED_LIST = 0,
+        BROADPHASE_SWEEP_AND_PRUNE = 1,
+        BROADPHASE_HASH_GRID = 2,
+        BROADPHASE_AABB_TREE = 3
+    };
+
+    //! A pair of objects whose bounding boxes overlap, and so need a narrow-phase test.
+    struct BroadPhasePair
+    {
+        struct PhysicsObject *obj1;
+        struct PhysicsObject *obj2;
+    };
+
+    //! Interface to a broad-phase structure that persists across physics ticks.
+    //!
+    //! Objects are registered with insert() when they enter the universe, and with remove()
+    //! when they leave it. Each tick, once every tracked object's box has been estimated,
+    //! update() brings the structure up to date and get_pairs() lists the overlapping pairs.
+    //!
+    //! Implementations are free to use the object's proxy member to find their own bookkeeping
+    //! for it, and it is set back to -1 on removal.
+    class BroadPhase
+    {
+    public:
+        BroadPhase() : cache_hits(0), cache_misses(0) {}
+        virtual ~BroadPhase() {}
+
+        //! Start tracking an object. Its box does not need to be valid until the next update().
+        virtual void insert(struct PhysicsObject *obj) = 0;
+        //! Stop tracking an object. The object must not be freed before this is called.
+        virtual void remove(struct PhysicsObject *obj) = 0;
+        //! Bring the structure up to date with the current boxes of every tracked object.
+        virtual void update() = 0;
+        //! Replace the contents of pairs with every pair of tracked objects whose boxes overlap.
+        virtual void get_pairs(std::vector<struct BroadPhasePair> &pairs) = 0;
+        //! Append every tracked object whose box might overlap the given box, as of the last
+        //! update(), to out. This can report a few objects whose boxes don't quite overlap.
+        //!
+        //! Queries only look at the state saved by update(), so several threads can run them at
+        //! once, even while the tracked objects' boxes are changing.
+        virtual void query(struct AABB *box, std::vector<struct PhysicsObject *> &out) = 0;
+
+        //! For structures that cache pairs between updates, the number of objects that were still
+        //! inside their padded boxes at the last update(), and so kept all of their cached pairs
+        //! without a second look, and the number that weren't. Other structures leave these at zero.
+        size_t cache_hits;
+        size_t cache_misses;
+    };
+
+    //! Incremental three-axis sweep-and-prune.
+    //!
+    //! Keeps a sorted list of box endpoints on each axis, as well as the set of pairs that
+    //! overlap, from one tick to the next. Between ticks the endpoint lists are nearly sorted,
+    //! so re-sorting them with insertion sort touches only the endpoints that actually moved
+    //! past each other, and each of those swaps is exactly where a pair can start or stop
+    //! overlapping. The cost of an update then scales with how much objects move relative to
+    //! each other, rather than with the number of objects.
+    //!
+    //! See: http://www.codercorner.com/SAP.pdf
+    class SweepAndPrune : public BroadPhase
+    {
+    public:
+        SweepAndPrune();
+        ~SweepAndPrune();
+
+        void insert(struct PhysicsObject *obj);
+        void remove(struct PhysicsObject *obj);
+        void update();
+        void get_pairs(std::vector<struct BroadPhasePair> &pairs);
+        void query(struct AABB *box, std::vector<struct PhysicsObject *> &out);
+
+    private:
+        struct Endpoint
+        {
+            //! Coordinate of the endpoint along the axis.
+            double value;
+            //! Index of the proxy this endpoint belongs to.
+            uint32_t proxy;
+            //! Whether this is the upper end of the proxy's interval.
+            bool is_max;
+        };
+
+        //! Orders endpoints by coordinate. Lower ends sort before upper ends at the same
+        //! coordinate, so that boxes that are just touching are considered to overlap.
+        static bool endpoint_less(const struct Endpoint &a, const struct Endpoint &b);
+        static uint64_t pair_key(uint32_t a, uint32_t b);
+        bool overlaps(uint32_t a, uint32_t b);
+
+        //! Drop the endpoints and pairs of any proxies removed since the last update.
+        void purge();
+        //! Re-sort one axis from its nearly-sorted state, updating the pairs as endpoints swap.
+        void sort_axis(int32_t d);
+        //! Sort all axes from scratch and rediscover all pairs with a single sweep.
+        void rebuild();
+
+        std::vector<struct Endpoint> axes[3];
+        //! Object tracked by each proxy, NULL for proxies that are free or removed.
+        std::vector<struct PhysicsObject *> proxies;
+        //! Box of each proxy, as of the last update.
+        std::vector<struct AABB> boxes;
+        std::vector<uint32_t> free_proxies;
+        std::vector<uint32_t> removed_proxies;
+        //! Number of proxies inserted since the last update.
+        size_t num_inserted;
+        std::unordered_set<uint64_t> pairs;
+        //! Number of endpoints along X that were sorted by the last update. Endpoints of proxies
+        //! inserted since then are past these.
+        size_t num_sorted;
+        //! Width along X of the widest box as of the last update.
+        double max_extent;
+    };
+
+    //! Multi-level spatial hash grid.
+    //!
+    //! Each level is a uniform grid of cubic cells, with cells twice as large as those of the
+    //! level below. Every object goes into the finest level whose cells are at least as large
+    //! as its box, so it covers at most two cells along each axis, no matter how big it is.
+    //! Only the occupied cells are stored, in a hash table that is rebuilt on every update.
+    //!
+    //! Pairs are found by looking up the cells each box covers, on its own level and every
+    //! coarser one. Objects that are crowded together along one axis, but not on the others,
+    //! stay cheap to test, since the cells are bounded in all three dimensions.
+    //!
+    //! See: Ericson, Real-Time Collision Detection, 7.2
+    class SpatialHashGrid : public BroadPhase
+    {
+    public:
+        //! @param cell_size Size of the cells at the finest level. If this is not positive, the
+        //! size of the smallest box is used instead, and recomputed on every update.
+        SpatialHashGrid(double cell_size);
+        ~SpatialHashGrid();
+
+        void insert(struct PhysicsObject *obj);
+        void remove(struct PhysicsObject *obj);
+        void update();
+        void get_pairs(std::vector<struct BroadPhasePair> &pairs);
+        void query(struct AABB *box, std::vector<struct PhysicsObject *> &out);
+
+    private:
+        struct Cell
+        {
+            int64_t x;
+            int64_t y;
+            int64_t z;
+            int32_t level;
+        };
+
+        struct Entry
+        {
+            struct Cell cell;
+            //! Index of the proxy whose box covers this cell.
+            uint32_t proxy;
+        };
+
+        static bool cell_equal(const struct Cell &a, const struct Cell &b);
+        uint64_t cell_hash(const struct Cell &c);
+        //! Find the cell at the given level that contains a point.
+        struct Cell cell_of(struct Vector3 *v, int32_t level);
+        //! Find the range of cells at the given level that a box covers.
+        void cell_range(struct AABB *box, int32_t level, struct Cell &lo, struct Cell &hi);
+
+        double cell_size;
+        //! Cell size at the finest level, as used by the last update.
+        double base_size;
+        //! Level of each proxy, as of the last update.
+        std::vector<int32_t> levels;
+        //! Levels that hold at least one object, in increasing order.
+        std::vector<int32_t> occupied_levels;
+
+        //! Entries grouped by the hash bucket of their cell. The entries in bucket b are
+        //! entries[buckets[b]] up to, but not including, entries[buckets[b + 1]].
+        std::vector<struct Entry> entries;
+        std::vector<uint32_t> buckets;
+        uint64_t bucket_mask;
+        //! Scratch space used while building the table.
+        std::vector<struct Entry> unsorted_entries;
+
+        //! Object tracked by each proxy, NULL for proxies that are free.
+        std::vector<struct PhysicsObject *> proxies;
+        //! Box of each proxy, as of the last update.
+        std::vector<struct AABB> boxes;
+        std::vector<uint32_t> free_proxies;
+    };
+
+    //! Dynamic AABB tree (bounding volume hierarchy).
+    //!
+    //! Each object is a leaf holding a fattened copy of its box, and internal nodes hold the
+    //! union of their children's boxes. A leaf is only moved when its object's box leaves the
+    //! fat box, and a moved leaf is reinserted next to the sibling that grows the tree's surface
+    //! area the least. The tree is kept balanced with rotations on the way back up.
+    //!
+    //! Since the cost of a query depends on the depth of the tree rather than on how objects
+    //! are spread out along any axis, this handles universes that mix planets with ships, where
+    //! a single huge box overlaps nearly everything along one axis.
+    //!
+    //! Overlapping pairs persist between updates. Only leaves that moved look for new pairs,
+    //! and pairs are dropped once their fat boxes stop overlapping. Fat boxes are stretched
+    //! ahead of each object by how far it would travel in a short lookahead time, so that fast
+    //! objects don't have to be moved on every update.
+    //!
+    //! See: Catto, Dynamic Bounding Volume Hierarchies, GDC 2019
+    class AABBTree : public BroadPhase
+    {
+    public:
+        //! @param margin Fraction of an object's box size to fatten its leaf box by on every side.
+        //! @param lookahead Time (s) of travel at the object's current velocity to stretch its leaf
+        //! box by, in the direction it's moving.
+        AABBTree(double margin, double lookahead);
+        ~AABBTree();
+
+        void insert(struct PhysicsObject *obj);
+        void remove(struct PhysicsObject *obj);
+        void update();
+        void get_pairs(std::vector<struct BroadPhasePair> &pairs);
+        void query(struct AABB *box, std::vector<struct PhysicsObject *> &out);
+
+        //! Call visit() with every tracked object whose fat box overlaps the given box, as of the
+        //! last update(). The query stops early if visit() returns false. Like the other query(),
+        //! this is safe to run on several threads at once.
+        void query(struct AABB *box, std::function<bool(struct PhysicsObject *)> visit);
+
+        //! Height of the tree, where a tree with a single leaf has a height of zero.
+        int32_t height();
+
+    private:
+        struct TreeNode
+        {
+            //! Union of the children's boxes, or the fat box of a leaf.
+            struct AABB box;
+            //! The object at a leaf, NULL for internal nodes and removed leaves.
+            struct PhysicsObject *obj;
+            //! Parent node, or the next free node when this node is free.
+            int32_t parent;
+            //! Children of an internal node. child1 is -1 at a leaf.
+            int32_t child1;
+            int32_t child2;
+            //! Height of the subtree rooted here, where leaves have a height of 0, and free nodes -1.
+            int32_t height;
+        };
+
+        static uint64_t pair_key(int32_t a, int32_t b);
+        int32_t alloc_node();
+        void free_node(int32_t n);
+        void fatten(struct PhysicsObject *obj, struct AABB *fat);
+        void insert_leaf(int32_t leaf);
+        void remove_leaf(int32_t leaf);
+        //! Refit the boxes and heights from the given node up to the root, balancing as we go.
+        void refit(int32_t n);
+        //! Rotate the subtree rooted at n if it's out of balance, and return its new root.
+        int32_t balance(int32_t n);
+        //! Drop the pairs of any leaves removed since the last update, and free their nodes.
+        void purge();
+
+        double margin;
+        double lookahead;
+        int32_t root;
+        int32_t free_list;
+        std::vector<struct TreeNode> nodes;
+
+        //! Leaves that were added or moved since the last update, and so need to look for new pairs.
+        std::vector<int32_t> moved;
+        std::vector<int32_t> removed;
+        std::unordered_set<uint64_t> pairs;
+        //! Scratch stack used when walking the tree during updates.
+        std::vector<int32_t> stack;
+    };
+
+    //! Build the broad-phase structure for the given BroadPhaseType. Returns NULL for the
+    //! sorted list, which is handled directly by the universe.
+    //!
+    //! @param grid_cell_size Passed on to the SpatialHashGrid, and ignored by the other types.
+    //! @param tree_margin Passed on to the AABBTree, and ignored by the other types.
+    //! @param tree_lookahead Passed on to the AABBTree, and ignored by the other types.
+    BroadPhase *BroadPhase_create(int32_t type, double grid_cell_size, double tree_margin, double tree_lookahead);
+}
+
+#endif
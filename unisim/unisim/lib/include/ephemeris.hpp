@@ -0,0 +1,83 @@
+#ifndef EPHEMERIS_HPP
+#define EPHEMERIS_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+#include "vector.hpp"
+
+namespace Diana
+{
+    struct PhysicsObject;
+
+    //! Where the motion of an object on rails comes from.
+    typedef enum RailsType
+    {
+        RAILS_KEPLER = 0,
+        RAILS_TABLE = 1
+    } RailsType;
+
+    //! A bound two-body orbit around a point.
+    //!
+    //! Instead of the classical angles, which aren't defined for circular or flat orbits, the
+    //! orientation is kept as the unit vectors from the focus to periapsis (P) and ninety degrees
+    //! ahead of it in the direction of motion (Q).
+    struct KeplerOrbit
+    {
+        //! Gravitational parameter (G times the mass) of the body being orbited.
+        double mu;
+        //! Semi-major axis in metres.
+        double a;
+        //! Eccentricity, in [0, 1).
+        double e;
+        //! Mean motion in radians/second.
+        double n;
+        //! Mean anomaly, in radians, at the epoch.
+        double M0;
+        //! Time at which the orbit was fixed, in seconds of universe time.
+        double epoch;
+        struct Vector3 P;
+        struct Vector3 Q;
+    };
+
+    //! Position and velocity of an object sampled at increasing times, which are interpolated
+    //! between with cubic Hermite splines. Outside of the sampled times, the object carries on at
+    //! the velocity of the nearest sample.
+    struct EphemerisTable
+    {
+        std::vector<double> times;
+        std::vector<struct Vector3> positions;
+        std::vector<struct Vector3> velocities;
+    };
+
+    //! The motion of an object on rails. Objects on rails are moved to where the orbit or table
+    //! puts them at the universe's current time, instead of being integrated, and aren't moved by
+    //! gravity or collisions. They still attract and collide with everything else.
+    struct Rails
+    {
+        RailsType type;
+        struct KeplerOrbit orbit;
+        struct EphemerisTable table;
+        //! The orbit or table is relative to this object, or to the origin if it is NULL.
+        struct PhysicsObject *parent;
+    };
+
+    //! Fix the orbit that passes through the given position and velocity, relative to the body
+    //! being orbited, at the given time. Only bound orbits are supported.
+    void KeplerOrbit_from_state(struct KeplerOrbit *orbit, double mu, struct Vector3 *position, struct Vector3 *velocity, double epoch);
+    //! Position and velocity along the orbit at the given time, relative to the body being orbited.
+    void KeplerOrbit_evaluate(struct KeplerOrbit *orbit, double t, struct Vector3 *position, struct Vector3 *velocity);
+
+    //! Add a sample to the end of the table. Samples must be added in order of increasing time.
+    void EphemerisTable_add(struct EphemerisTable *table, double t, struct Vector3 *position, struct Vector3 *velocity);
+    void EphemerisTable_evaluate(struct EphemerisTable *table, double t, struct Vector3 *position, struct Vector3 *velocity);
+
+    //! Position and velocity of an object on rails at the given time, including the motion of its parent.
+    void Rails_evaluate(struct Rails *rails, double t, struct Vector3 *position, struct Vector3 *velocity);
+    //! How many parents up the chain there are before reaching one that isn't on rails.
+    int32_t Rails_depth(struct Rails *rails);
+}
+
+#endif
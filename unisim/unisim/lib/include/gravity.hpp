@@ -0,0 +1,126 @@
+#ifndef GRAVITY_HPP
+#define GRAVITY_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+#include "vector.hpp"
+#include "physics.hpp"
+
+namespace Diana
+{
+    //! The attractors in the universe, with their positions and masses mirrored into a structure
+    //! of arrays.
+    //!
+    //! Summing the pull of every attractor on an object is one of the hottest loops in the
+    //! simulation, and going through the packed PhysicsObjects costs a cache miss or two for each
+    //! attractor. Working from the mirror instead streams through a few contiguous arrays, several
+    //! attractors to a vector register where the hardware allows it.
+    //!
+    //! Membership follows the attractors list in the universe, and the positions and masses are
+    //! copied in by AttractorSet_refresh() before each round of object ticks, so every object sees
+    //! the attractors where they were before any of them moved.
+    struct AttractorSet
+    {
+        //! Objects that are attractors, in the order that they became attractors.
+        std::vector<struct PhysicsObject *> objs;
+        //! IDs, positions, velocities and masses of the attractors as of the last refresh.
+        std::vector<int64_t> ids;
+        std::vector<double> px;
+        std::vector<double> py;
+        std::vector<double> pz;
+        std::vector<double> vx;
+        std::vector<double> vy;
+        std::vector<double> vz;
+        std::vector<double> mass;
+        //! Number of attractors as of the last refresh.
+        size_t size;
+        //! Set whenever an attractor is added or removed, and left for the owner to clear.
+        bool changed;
+    };
+
+    void AttractorSet_init(struct AttractorSet *set);
+    void AttractorSet_add(struct AttractorSet *set, struct PhysicsObject *obj);
+    void AttractorSet_remove(struct AttractorSet *set, int64_t phys_id);
+    //! Copy the current positions, velocities and masses of the attractors into the mirror.
+    void AttractorSet_refresh(struct AttractorSet *set);
+    //! Fill out with where the attractors were part way between two refreshes of the same attractors,
+    //! dt apart, where s is in [0, 1]. The path between the two is a cubic Hermite spline, which
+    //! matches the positions and velocities at each end.
+    void AttractorSet_interpolate(struct AttractorSet *out, struct AttractorSet *start, struct AttractorSet *end, double s, double dt);
+    //! Add the gravitational force on obj from every attractor in the mirror, other than obj itself,
+    //! to g. This matches gravity() in universe.cpp summed over the attractors, up to the order that
+    //! the terms are added in.
+    void AttractorSet_pull(struct AttractorSet *set, struct Vector3 *g, struct PhysicsObject *obj, double G);
+
+    //! Barnes-Hut octree for approximating the gravitational pull of many attractors.
+    //!
+    //! The attractors are sorted into an octree of cubic cells, and each cell keeps the total
+    //! mass and centre of mass of everything in it. When working out the pull on an object, a
+    //! cell that is small compared to its distance from the object is treated as a single body
+    //! at its centre of mass, and only nearby cells are opened up and looked at in detail. The
+    //! cost for each object is then logarithmic in the number of attractors, rather than linear.
+    //!
+    //! The tree is a snapshot of the attractors as of the last build(), and is rebuilt from
+    //! scratch every tick.
+    //!
+    //! See: Barnes & Hut, A hierarchical O(N log N) force-calculation algorithm, Nature 324 (1986)
+    class BarnesHutTree
+    {
+    public:
+        //! @param theta Opening angle. A cell is treated as a single body when its width is less than
+        //! theta times its distance from the object. Smaller values are more accurate, and zero
+        //! looks at every attractor individually.
+        BarnesHutTree(double theta);
+
+        //! Rebuild the tree from the positions and masses of the attractors as of the set's last refresh.
+        void build(struct AttractorSet *set);
+        //! Add the gravitational force on obj from every attractor in the tree, other than obj
+        //! itself, to g. This only reads the tree, and is safe to call from several threads at once.
+        void pull(struct Vector3 *g, struct PhysicsObject *obj, double G);
+
+        //! Number of attractors in the tree.
+        size_t size();
+
+    private:
+        struct TreeNode
+        {
+            struct Vector3 center;
+            //! Half of the width of the cell.
+            double half;
+            struct Vector3 com;
+            double mass;
+            //! The cell is opened up when an object is closer than this to its center of mass.
+            //! This is squared.
+            double open2;
+            //! Children are stored next to each other, starting at first_child, and only the
+            //! octants that hold something get one. first_child is -1 at a leaf.
+            int32_t first_child;
+            int32_t num_children;
+            //! The attractors under this node are bodies [begin, end).
+            uint32_t begin;
+            uint32_t end;
+        };
+
+        //! Fill in the node at index n with the bodies in [begin, end), and build everything below it.
+        void build_node(int32_t n, uint32_t begin, uint32_t end, int32_t depth);
+        //! Add the force on an object at p, of mass m, from body i.
+        void add_body(struct Vector3 *g, struct Vector3 *p, double m, uint32_t i, double G);
+
+        double theta;
+        std::vector<struct TreeNode> nodes;
+
+        //! Positions, masses and IDs of the attractors, in the order that they're found in the tree.
+        std::vector<struct Vector3> positions;
+        std::vector<double> masses;
+        std::vector<int64_t> ids;
+        //! Scratch space used while sorting bodies into octants.
+        std::vector<uint32_t> order;
+        std::vector<uint32_t> scratch;
+        std::vector<uint8_t> octants;
+    };
+}
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef NARROWPHASE_HPP
+#define NARROWPHASE_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+#include "physics.hpp"
+
+namespace Diana
+{
+    //! Number of pairs that are gathered into a SweepBatch before it's tested.
+    const size_t SWEEP_BATCH_SIZE = 256;
+
+    //! A batch of candidate pairs for the narrow-phase, laid out as a structure of arrays.
+    //!
+    //! PhysicsObject_collide() works out when two bounding balls touch by solving a quadratic
+    //! in time, and only goes on to the collision normal and energies if they do. Most pairs
+    //! that make it through the broad-phase fail that first part, so the quadratic is solved
+    //! for a whole batch of pairs at once, several to a vector register where the hardware
+    //! allows it, and only the pairs that pass go on to the full test.
+    //!
+    //! The batch test is a filter, and gives the same answer as PhysicsObject_collide() for
+    //! every pair that it turns away. Pairs that are too close to call are passed through.
+    struct SweepBatch
+    {
+        //! The objects in each pair.
+        std::vector<struct PhysicsObject *> obj1;
+        std::vector<struct PhysicsObject *> obj2;
+        //! Position of obj1 relative to obj2.
+        std::vector<double> px;
+        std::vector<double> py;
+        std::vector<double> pz;
+        //! Displacement of obj1 relative to obj2 over the time step.
+        std::vector<double> dx;
+        std::vector<double> dy;
+        std::vector<double> dz;
+        //! Square of the sum of the radii.
+        std::vector<double> r2;
+        //! Whether each pair passed the test, and needs the full test.
+        std::vector<uint8_t> hit;
+        //! Number of pairs in the batch.
+        size_t size;
+    };
+
+    void SweepBatch_init(struct SweepBatch *batch);
+    //! Empty the batch, keeping its storage for the next one.
+    void SweepBatch_clear(struct SweepBatch *batch);
+    //! Add a pair to the batch, using their trajectories over the given time step.
+    void SweepBatch_add(struct SweepBatch *batch, struct PhysicsObject *obj1, struct PhysicsObject *obj2, double dt);
+    //! Find the pairs in the batch whose bounding balls might touch within the time step, and
+    //! return how many there are. The result for each pair is left in hit.
+    size_t SweepBatch_test(struct SweepBatch *batch);
+}
+
+#endif
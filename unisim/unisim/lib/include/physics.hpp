@@ -4,11 +4,13 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <functional>
+#include <vector>
 #include "vector.hpp"
 
 namespace Diana
 {
     class Universe;
+    struct Rails;
 
     // Rigid body physics references
     // + http://www.olhovsky.com/2011/05/physics-engine/
@@ -26,6 +28,16 @@ namespace Diana
     //! Enumeration of the types of physics objects to allow for branching and basic polymorphics with structs.
     enum PhysicsObjectType { PHYSOBJECT, PHYSOBJECT_SMART, BEAM_COMM, BEAM_SCAN, BEAM_SCANRESULT, BEAM_WEAP, UNITIALIZED };
 
+    //! Schemes for moving an object through a tick under gravity and thrust.
+    //! - INTEGRATOR_UNIVERSE uses whatever the universe uses.
+    //! - INTEGRATOR_EULER moves the object with the acceleration at the start of the tick.
+    //! - INTEGRATOR_VERLET is velocity Verlet, which averages the acceleration at each end of the tick,
+    //!   carrying the one at the end over to the start of the next.
+    //! - INTEGRATOR_FOREST_RUTH is a fourth-order symplectic scheme, which works out the acceleration
+    //!   three times during the tick.
+    //!   See: Forest & Ruth, Fourth-order symplectic integration, Physica D 43 (1990)
+    enum Integrator { INTEGRATOR_UNIVERSE = -1, INTEGRATOR_EULER = 0, INTEGRATOR_VERLET = 1, INTEGRATOR_FOREST_RUTH = 2 };
+
     struct SpectrumComponent
     {
         // The wavelength of the component, in metres. (green visible light = 550e-9)
@@ -80,13 +92,10 @@ namespace Diana
             //! Angular velocity in radians/second
             ang_velocity,
             //! Thrust in Newtons
-            thrust,
-            //! Normal vector indicating forward of its local basis
-            forward,
-            //! Normal vector indicating up of its local basis
-            up,
-            //! Normal vector indicating right of its local basis
-            right;
+            thrust;
+        //! Orientation as a unit quaternion. The forward, up, and right vectors of the object's local
+        //! basis are worked out from this with Vector4_get_basis() where they're needed.
+        struct Vector4 orientation;
         //! Mass in kilograms.
         double mass,
             //! Radius of bounding sphere in metres centres on its position
@@ -105,6 +114,40 @@ namespace Diana
         bool dangerous_radiation;
         //! The radiation spectrum of this object.
         struct Spectrum* spectrum;
+        //! Handle used by the universe's broad-phase structure to find its own bookkeeping
+        //! for this object, or -1 if it isn't being tracked by one.
+        int32_t proxy;
+        //! Incremented whenever a collision changes the object's motion, so that collision events
+        //! that were found before then can be recognised as stale.
+        uint32_t generation;
+        //! If not NULL, the object is on rails, and its position and velocity come from here
+        //! instead of being integrated. The object owns this.
+        struct Rails* rails;
+        //! Gravitational acceleration on the object, in metres/second^2, as of the last time that
+        //! it was worked out in full, and an estimate of how fast it's changing, in metres/second^3.
+        //! These are only used when the universe is extrapolating gravity between evaluations.
+        struct Vector3 grav_accel,
+            grav_jerk;
+        //! Universe time at which grav_accel was worked out, and at which it's next due.
+        double grav_time,
+            grav_due;
+        //! Whether grav_accel holds anything yet.
+        bool grav_cached;
+        //! Which Integrator moves this object. Attractors always follow the universe.
+        int8_t integrator;
+        //! Acceleration due to gravity as of the last time it was worked out, and the universe time
+        //! that it was for. Velocity Verlet carries this over from the end of one tick to the start
+        //! of the next, and the universe picks timestep_level from how fast it changes.
+        struct Vector3 last_accel;
+        double last_accel_time;
+        //! The object is moved through each tick in 2^timestep_level equal substeps.
+        int8_t timestep_level;
+        //! Sleeping objects stay where they are, without being moved or having their boxes worked out,
+        //! until something disturbs them. While asleep, last_accel holds the gravity that the object
+        //! fell asleep under.
+        bool asleep;
+        //! Number of ticks in a row that the object has been still enough to sleep.
+        uint8_t still_ticks;
     };
 #pragma pack()
 
@@ -210,16 +253,30 @@ namespace Diana
     void PhysicsObject_init(struct PhysicsObject* obj, Universe* universe, struct Vector3* position, struct Vector3* velocity, struct Vector3* ang_velocity, struct Vector3* thrust, double mass, double radius, char* obj_desc, struct Spectrum* spectrum);
     struct PhysicsObject* PhysicsObject_clone(struct PhysicsObject* obj);
     void PhysicsObject_tick(struct PhysicsObject* obj, struct Vector3* g, double dt);
+    //! Turn the object through its angular velocity over the time step, without moving it.
+    void PhysicsObject_rotate(struct PhysicsObject* obj, double dt);
+    //! Bring a sleeping object back into the simulation, and restart the wait before it can sleep again.
+    void PhysicsObject_wake(struct PhysicsObject* obj);
+    //! Move the object along at its current velocity.
+    void PhysicsObject_drift(struct PhysicsObject* obj, double dt);
+    //! Change the object's velocity by the given acceleration, plus that from its thrust.
+    void PhysicsObject_kick(struct PhysicsObject* obj, struct Vector3* a, double dt);
 
     struct Spectrum* Spectrum_clone(struct Spectrum* src);
     struct Spectrum* Spectrum_allocate(uint32_t n, size_t* total_size = NULL);
     struct Spectrum* Spectrum_perturb(struct Spectrum* src, double limit, std::function<double(void)> get_rand);
     struct Spectrum* Spectrum_combine(struct Spectrum* dst, struct Spectrum* increment);
 
+    //! Set the orientation from the four-tuple sent over the wire, which is the x and y components
+    //! of the forward and up vectors.
     void PhysicsObject_from_orientation(struct PhysicsObject* obj, struct Vector4* orientation);
+    //! The four-tuple to send over the wire for the object's orientation.
+    void PhysicsObject_get_orientation(struct PhysicsObject* obj, struct Vector4* orientation);
 
     void PhysicsObject_collide(struct PhysCollisionResult* cr, struct PhysicsObject* obj1, struct PhysicsObject* obj2, double dt);
-    void PhysicsObject_collision(struct PhysicsObject* obj, struct PhysicsObject* other, double energy, double dt, struct PhysCollisionEffect* effect, double health_cutoff);
+    //! @param spawned Beams that come of the collision, such as the return beam from a scan, are put
+    //! here for the caller to add to the universe, or added straight away if this is NULL.
+    void PhysicsObject_collision(struct PhysicsObject* obj, struct PhysicsObject* other, double energy, double dt, struct PhysCollisionEffect* effect, double health_cutoff, std::vector<struct Beam*>* spawned = NULL);
     void PhysicsObject_resolve_damage(struct PhysicsObject* obj, double energy, double cutoff);
     void PhysicsObject_resolve_phys_collision(struct PhysicsObject* obj, double energy, double dt, struct PhysCollisionEffect* pce);
     void PhysicsObject_estimate_aabb(struct PhysicsObject* obj, struct AABB* b, double dt);
@@ -229,8 +286,14 @@ namespace Diana
     void Beam_init(struct Beam* beam, Universe* universe, struct Vector3* origin, struct Vector3* direction, struct Vector3* up, struct Vector3* right, double cosh, double cosv, double area_factor, double speed, double energy, PhysicsObjectType beam_type, char* comm_msg, char* data, struct Spectrum* spectrum);
     void Beam_init(struct Beam* beam, Universe* universe, struct Vector3* origin, struct Vector3* velocity, struct Vector3* up, double angle_h, double angle_v, double energy, PhysicsObjectType beam_type, char* comm_msg, char* data, struct Spectrum* spectrum);
     
+    //! Work out whether, and when, the beam's wavefront passes over the object in the next dt. The
+    //! crossing is solved for exactly, with the object moving at its current velocity, and bcr->t is
+    //! negative when there is no hit.
     void Beam_collide(struct BeamCollisionResult* bcr, struct Beam* beam, struct PhysicsObject* obj, double dt);
     void Beam_tick(struct Beam* beam, double dt);
+    //! Fill b with a box around everywhere that the beam's wavefront can hit an object over the next
+    //! dt. Beams that spread to 90 degrees or more get a box that covers everything.
+    void Beam_estimate_aabb(struct Beam* beam, struct AABB* b, double dt);
     struct Beam* Beam_make_return_beam(struct Beam* b, double energy, struct Vector3* origin, PhysicsObjectType type);
 
     bool is_big_enough(double m, double r, double cutoff);
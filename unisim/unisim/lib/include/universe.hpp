@@ -3,11 +3,14 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <stdio.h>
 
 //! @todo We should probably namespace all of this at some point.
 
 // We get these from MIMOServer.hpp too
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <set>
 #include <list>
@@ -28,6 +31,11 @@ typedef std::atomic<int64_t> ATOMIC_T;
 #include "MIMOServer.hpp"
 #include "messaging.hpp"
 #include "bson.hpp"
+#include "workerpool.hpp"
+#include "broadphase.hpp"
+#include "narrowphase.hpp"
+#include "gravity.hpp"
+#include "ephemeris.hpp"
 
 // #include "scheduler.hpp"
 
@@ -84,6 +92,12 @@ namespace Diana
     //! The simulation can be run in a non-realtime manner by specifying realtime=false
     //! on construction. This is useful for simulations that do not rely on real-time
     //! constraints and are, perhaps, not interactive.
+    //!
+    //! With a fixed timestep, every tick is the same length, and wall-clock time only decides
+    //! how many ticks are run at a time. Work is split among the worker threads so that every
+    //! result is worked out the same way, and gathered in the same order, whatever the number of
+    //! threads, so two runs of the same scenario go the same way, tick for tick, as long as
+    //! nothing comes in over the network.
     class Universe
     {
     public:
@@ -107,7 +121,12 @@ namespace Diana
                 sphere_tests,
                 simultaneous_collisions,
                 collision_rounds,
-                collisions;
+                collisions,
+                cache_hits,
+                cache_misses;
+            //! Number of candidate tests made by the sorted-list sweep along each of the X, Y and
+            //! Z axes. The sweep only runs along one axis at a time.
+            size_t axis_tests[3];
             HRN_DT aabb_test_ns,
                 sphere_test_ns,
                 total_ns;
@@ -120,7 +139,17 @@ namespace Diana
         struct TickMetrics
         {
             struct CollisionMetrics collision_metrics, multicollision_metrics;
-            uint64_t num_objects;
+            uint64_t num_objects,
+                num_huge_objects,
+                //! Number of objects whose gravitational pull was worked out in full, and the
+                //! number whose pull was extrapolated instead.
+                num_gravity_evaluations,
+                num_gravity_extrapolations,
+                //! The most times that the tick was halved for any object.
+                max_timestep_level,
+                //! Number of objects that are being simulated, and that are asleep, at the end of the tick.
+                num_awake_objects,
+                num_asleep_objects;
             HRN_DT sort_aabb_ns,
                 object_tick_ns,
                 beam_tick_ns,
@@ -135,8 +164,12 @@ namespace Diana
 
     private:
         struct PhysCollisionEvent;
+        struct CollisionIsland;
+        struct GravityStage;
+        struct TickEffects;
 
         friend void *sim(void *u);
+        friend void *sim_fixed(void *u);
 
         friend void Universe_hangup_objects(int32_t c, void *arg);
         friend void Universe_handle_message(int32_t socket, void *arg);
@@ -144,9 +177,16 @@ namespace Diana
         friend void PhysicsObject_init(struct PhysicsObject *obj, Universe *universe, struct Vector3 *position, struct Vector3 *velocity, struct Vector3 *ang_velocity, struct Vector3 *thrust, double mass, double radius, char *obj_desc, struct Spectrum *spectrum);
         friend void Beam_init(struct Beam *beam, Universe *universe, struct Vector3 *origin, struct Vector3 *direction, struct Vector3 *up, struct Vector3 *right, double cosh, double cosv, double area_factor, double speed, double energy, PhysicsObjectType type, char *comm_msg, char *data, struct Spectrum *spectrum);
 
-        friend void obj_tick(Universe *u, struct PhysicsObject *o, double dt);
+        friend void obj_tick(Universe *u, struct PhysicsObject *o, double dt, struct Universe::TickEffects *effects);
         friend void *thread_check_collisions(void *argsV);
         friend struct Universe::CollisionMetrics check_collision_loop(void *argsV);
+        friend struct Universe::CollisionMetrics check_collision_pairs(void *argsV);
+        friend struct Universe::CollisionMetrics check_collision_object(void *argsV);
+        friend struct Universe::CollisionMetrics check_collision_huge(void *argsV);
+        friend void check_collision_boxes(void *argsV, struct PhysicsObject *obj1, struct PhysicsObject *obj2, struct Universe::CollisionMetrics &metrics);
+        friend void check_collision_batch(void *argsV, struct Universe::CollisionMetrics &metrics);
+        friend void check_collision_neighbour(void *argsV, struct PhysicsObject *o, const struct AABB *box, struct Universe::CollisionMetrics &metrics);
+        friend bool collision_event_later(const struct Universe::PhysCollisionEvent &a, const struct Universe::PhysCollisionEvent &b);
         friend bool check_collision_single(Universe *u, struct PhysicsObject *obj1, struct PhysicsObject *obj2, double dt, struct Universe::PhysCollisionEvent &ev);
 
         friend void *vis_data_thread(void *argv);
@@ -163,12 +203,27 @@ namespace Diana
                            num_worker_threads(1),
                            simulation_rate(1.0),
                            no_realtime_physics(false),
+                           fixed_timestep(0.0),
+                           max_fixed_steps(5),
                            gravitational_constant(6.67384e-11),
                            speed_of_light(299792458l),
                            collision_energy_cutoff(1e-9),
                            id_rand_max(1),
                            max_simultaneous_collision_rounds(100),
+                           collision_broadphase(0),
+                           collision_grid_cell_size(0.0),
+                           collision_tree_margin(0.1),
+                           collision_tree_lookahead(0.01),
+                           collision_huge_radius_factor(100.0),
                            gravity_magnitude_cutoff(0.01),
+                           gravity_opening_angle(0.0),
+                           gravity_attractor_substeps(1),
+                           gravity_extrapolation_tolerance(0.0),
+                           integrator(0),
+                           timestep_levels(0),
+                           timestep_tolerance(0.02),
+                           sleep_speed(0.0),
+                           sleep_gravity(1e-6),
                            beam_energy_cutoff(1e-10),
                            radiation_energy_cutoff(1.5e4),
                            spectrum_slush_range(0.01),
@@ -234,6 +289,18 @@ namespace Diana
             // slowdown.
             bool no_realtime_physics;
 
+            // When above zero, every physics tick is exactly this long, in unscaled simulated
+            // seconds, in place of one based on how long the last tick took, and the minimum and
+            // maximum physics frametimes are ignored. In real time, the wall-clock time that has
+            // passed is saved up and spent a tick at a time, and otherwise the ticks run back to
+            // back. Runs of the same scenario then give the same results.
+            double fixed_timestep;
+
+            // The most fixed timesteps that are run to catch up with the wall-clock time before
+            // checking it again. Any further time that the simulation has fallen behind by is
+            // dropped, and the game world runs slower than real time.
+            int32_t max_fixed_steps;
+
             // Universal gravitational constant.
             double gravitational_constant;
 
@@ -259,12 +326,110 @@ namespace Diana
             // in a real simulation scenario.
             double max_simultaneous_collision_rounds;
 
+            // Broad-phase collision detection strategy, used to find the pairs of objects that
+            // are close enough to need an exact collision test.
+            // 0: Sort all objects along the X axis every tick, and sweep along the sorted list.
+            // 1: Incremental sweep-and-prune, which keeps objects sorted on all three axes from
+            // tick to tick, as well as the set of overlapping pairs. This is cheapest when most
+            // objects move only a little relative to each other in each tick.
+            // 2: Multi-level spatial hash grid, which keeps the number of pair tests close to
+            // linear in dense, clustered scenes where many objects share the same X range.
+            // 3: Dynamic AABB tree, which handles universes that mix bodies of very different
+            // sizes, such as planets and ships, where a few huge boxes overlap nearly everything.
+            int32_t collision_broadphase;
+
+            // Size (m) of the cells at the finest level of the spatial hash grid broad-phase.
+            // Each coarser level has cells twice as large as the one below it. If this is zero,
+            // the size of the smallest object's bounding box is used, and is recomputed every tick.
+            double collision_grid_cell_size;
+
+            // Fraction of an object's bounding box size by which its box is enlarged on every side
+            // in the AABB tree broad-phase. Objects only need to be moved in the tree when they
+            // leave their enlarged box, so larger values move objects less often, at the cost of
+            // more pairs that need an exact collision test.
+            double collision_tree_margin;
+
+            // Time (s) of travel at an object's current velocity by which its box is stretched, in the
+            // direction that it's moving, in the AABB tree broad-phase. An object keeps its cached pairs
+            // for as long as it stays inside of its stretched box, so larger values move objects less
+            // often, at the cost of more pairs that need an exact collision test. Tune this using the
+            // cache hits and misses in the collision metrics.
+            double collision_tree_lookahead;
+
+            // Objects with a radius more than this many times the median radius of all objects are
+            // considered huge, and are kept out of the sorted list used by the default broad-phase.
+            // A single huge box overlaps a long stretch of the X axis, which defeats the early exit
+            // of the sweep, so huge objects are instead tested against the others with a dedicated
+            // search of the sorted list. Set to 0 to disable.
+            double collision_huge_radius_factor;
+
             // Objects that would produce a gravitational acceleration below this amount at their
             // bounding radius are not considered attractors in the universe. This is used to
             // optimize the selection of objects that are considered attractors for practical
             // purposes, to reduce the O(N^2) nature of gravitational calculations.
             double gravity_magnitude_cutoff;
 
+            // When positive, the pull of the attractors on each object is approximated with a
+            // Barnes-Hut octree, treating a group of attractors as a single body when its size is
+            // less than this fraction of its distance from the object. This makes gravity
+            // O(N log N) rather than O(N^2), which makes it practical to lower
+            // gravity_magnitude_cutoff so that many more objects attract. Values around 0.5 are
+            // typical, and keep the error in any one object's pull to a few percent. Set to 0 to
+            // sum over every attractor exactly.
+            double gravity_opening_angle;
+
+            // Attractors are moved among themselves before everything else, and each physics tick
+            // is split into this many substeps for them. Raising this keeps close encounters and
+            // tight orbits between attractors accurate at large time steps, and costs one round
+            // of attractor-on-attractor gravity per substep. Everything else moves once per tick
+            // against where the attractors end up.
+            int32_t gravity_attractor_substeps;
+
+            // When positive, the gravitational pull on objects that aren't attractors is only worked
+            // out in full every so often, and extrapolated from how fast it has been changing in
+            // between. The time until the next full evaluation is chosen so that the error in the
+            // extrapolation is about this fraction of the pull. Objects far from any attractor, whose
+            // pull barely changes, are then only looked at occasionally. Set to 0 to work out the
+            // pull on every object in full every tick.
+            double gravity_extrapolation_tolerance;
+
+            // How objects are moved through each tick under gravity and thrust, unless they choose
+            // otherwise themselves. 0 is a single first order step, which takes the pull on the
+            // object from where it starts towards where the attractors end up, so that it shares
+            // the attractors' gravity trees. It is cheap but slowly gains or loses energy in
+            // orbits. 1 is velocity Verlet, which is second
+            // order and symplectic, and costs no more gravity than 0 since the acceleration at the
+            // end of one tick is carried over to the start of the next. 2 is Forest-Ruth, which is
+            // fourth order and symplectic, and works out gravity three times each tick.
+            // Attractors use a drift-kick-drift leapfrog for 0 and 1, and Forest-Ruth for 2.
+            int32_t integrator;
+
+            // Objects whose gravitational pull changes quickly, such as those passing close to an
+            // attractor, are moved through each tick in 2, 4, 8 or more equal substeps, against
+            // where the attractors were at each substep, while everything else still takes the
+            // whole tick in one step. This is the most times that the tick is halved for any
+            // object, and 0 moves everything in one step. The attractors all take the finest
+            // substep that any of them needs.
+            int32_t timestep_levels;
+
+            // With timestep_levels above 0, each object's substep is picked so that its
+            // gravitational acceleration changes by about this fraction of itself over one
+            // substep, going by how fast it changed over the previous tick.
+            double timestep_tolerance;
+
+            // Objects that have moved slower than this, in metres/second, for a little while, with no
+            // thrust or spin and little gravity on them, are put to sleep. Sleeping objects stay
+            // where they are, and are skipped when moving objects and when testing for collisions
+            // among themselves, until an awake object's box touches theirs, a beam hits them, their
+            // client changes their properties, or the gravity on them changes. Set to 0 to keep
+            // every object awake.
+            double sleep_speed;
+
+            // The most gravitational acceleration, in metres/second^2, that an object can be under
+            // and still fall asleep, and the most that the gravity on a sleeping object can change
+            // by before it wakes up.
+            double sleep_gravity;
+
             // On initialization, a beam has a maximum distance that is calculated from it's spread
             // values, energy, and this cutoff. The maximum distance, D, is the amount of distance
             // travelled, such that the wavefront at D distance from the source has less than this
@@ -347,11 +512,57 @@ namespace Diana
         //! Expire all objects in the universe associated with the given client.
         void hangup_objects(int32_t c);
 
+        //! Spawn the bodies in a file laid out like sol.csv, on rails where possible. Each line is
+        //! one of
+        //!
+        //!     M,<id>,<name>,<mass in kg>
+        //!     R,<id>,<name>,<radius in km>
+        //!     P,<id>,<name>,<Julian date>,<date>,<x>,<y>,<z>,<vx>,<vy>,<vz>
+        //!
+        //! with positions in km and velocities in km/s, as in JPL Horizons vector tables. The earliest
+        //! sample in the file is taken to be the universe's current time.
+        //!
+        //! A body with several P lines follows a table of them. A body with only one goes into the
+        //! Kepler orbit through that state, around its parent by NAIF ID: x99 for the moons xNN of
+        //! planet x, and the Sun (10) for everything else. The Sun, and anything that isn't bound to
+        //! its parent, moves freely. The bodies appear on the next physics tick.
+        void load_rails(const char *path);
+        void load_rails(FILE *fp);
+
     private:
         int64_t get_id();
         void broadcast_vis_data();
         struct Universe::TickMetrics tick(double dt);
         void sort_aabb(double dt, bool calc);
+        //! Pick the axis for the sorted list to be sorted and swept along, which is the one that
+        //! the objects are spread out the most along. Returns true if that changed.
+        bool choose_sweep_axis();
+        //! Sort the objects from begin up to num_sorted on their own, with a radix sort, and then
+        //! merge them into the sorted objects in front of them.
+        void sort_burst(size_t begin, double dt, bool calc);
+        //! Drop stale events from the top of an island's collision heap, and then move the earliest
+        //! valid event to the back of the list. Returns false if there are no valid events left.
+        bool pop_collision_event(struct CollisionIsland *island);
+        //! Add an object to the list of objects involved in an island's current collision round.
+        //! Returns false if it was already there.
+        bool add_round_object(struct CollisionIsland *island, struct PhysicsObject *obj);
+        //! Split the pending collisions into islands that share no objects, dropping stale events.
+        void build_islands();
+        //! Resolve collisions in an island, in time order, until there are none left, or until
+        //! it runs into an object outside of the island.
+        void resolve_island(struct CollisionIsland *island, double dt);
+        //! Once every island has stopped, find the collisions between objects in different islands,
+        //! and add them to the pending collisions.
+        void check_island_boundaries(double dt);
+        //! Move the huge objects to the end of phys_objects, past num_sorted, keeping the relative
+        //! order of everything else.
+        void partition_huge();
+
+        //! Box every beam's wavefront over the next dt, and sort the boxes for query_beams().
+        void index_beams(double dt);
+        //! Replace out with the indices in beams, in increasing order, of every beam whose wavefront
+        //! might reach into the given box this tick, as of the last index_beams().
+        void query_beams(struct AABB *box, std::vector<uint32_t> &out);
         void handle_message(int32_t socket);
 
         // Take care of expiring objects from the universe at the end of a physics tick.
@@ -368,6 +579,59 @@ namespace Diana
         void update_list(struct PhysicsObject *obj, std::vector<struct PhysicsObject *> *list, bool newval, bool oldval);
 
         void get_grav_pull(struct Vector3 *g, struct PhysicsObject *obj);
+        //! Gravitational pull on an object from the attractors in the given mirror, using the
+        //! given tree if it isn't NULL.
+        void get_grav_pull(struct Vector3 *g, struct PhysicsObject *obj, struct AttractorSet *set, BarnesHutTree *tree);
+        //! Copy where the attractors are now into the mirror used for gravity, and rebuild the
+        //! gravity tree from it if there is one.
+        void refresh_gravity();
+        //! Move the attractors through the time step under their mutual gravity and their
+        //! thrust, and leave the gravity mirror holding where they end up.
+        void tick_attractors(double dt, struct TickMetrics &metrics);
+        //! Move the attractors through the tick in the given number of equal substeps.
+        void step_attractors(int32_t num_substeps, double dt);
+        //! Move every object that isn't an attractor through the time step, against the gravity
+        //! mirror. This only reads the mirror, so it's split across the worker pool.
+        void tick_particles(double dt, struct TickMetrics &metrics);
+        //! Interpolate where the attractors were at the end of each substep, or at each Forest-Ruth
+        //! kick, for objects that halve the tick the given number of times, between where the
+        //! attractors started the tick and where they ended up.
+        void build_gravity_stages(std::vector<struct GravityStage> &stages, int32_t level, bool forest_ruth, double dt);
+        //! Gravitational pull on an object against where the attractors were at the end of the
+        //! given substep, for objects that halve the tick the given number of times.
+        void get_stage_grav_pull(struct Vector3 *g, struct PhysicsObject *obj, int32_t level, int32_t substep);
+        //! Move an object that isn't an attractor through the tick with the given Integrator scheme, and
+        //! count the full gravity evaluations and extrapolations that it took. If its step turned out
+        //! to be too coarse, the object is left as it was with a finer timestep_level, and this
+        //! returns false.
+        bool integrate_particle(struct PhysicsObject *obj, int32_t scheme, double dt, size_t *evaluations, size_t *extrapolations);
+        //! How many times the tick needs halving for an object whose acceleration changes at the
+        //! given rate, as a fraction of itself per second.
+        int32_t required_timestep_level(double rate, double dt);
+        //! Carry out the side effects of the last round of object ticks that stay inside the
+        //! universe, in order.
+        void apply_tick_effects();
+        //! Send the messages held back from the last tick, from collision resolution and then from
+        //! the object ticks, in order. This is done once the physics lock has been released, so that
+        //! nothing waits on the network while holding it.
+        void send_tick_messages();
+        //! Put an object that has just been moved to sleep if it has been still for long enough.
+        void update_sleep(struct PhysicsObject *obj, double dt);
+        //! Whether the gravity on a sleeping object has changed enough since it fell asleep that it
+        //! should wake up, in which case it is woken. This is only worked out every so often for
+        //! each object, and otherwise comes back false.
+        bool gravity_disturbs(struct PhysicsObject *obj, size_t *evaluations);
+        //! Gravitational pull on an object that isn't an attractor, at time t against the
+        //! attractors where they are now, either worked out in full or extrapolated from the last
+        //! time it was. Returns whether it was worked out in full.
+        bool get_particle_grav_pull(struct Vector3 *g, struct PhysicsObject *obj, double t, double dt);
+        //! Put every object that's on rails where its rails say it is at the given time.
+        void move_rails(double time);
+        //! Add an object to the list of objects on rails, and put it where its rails say it is now.
+        void add_rails(struct PhysicsObject *obj);
+        //! Take an object that's being removed from the universe off of the list of objects on
+        //! rails, and take any objects whose rails are relative to it off of their rails.
+        void remove_rails(struct PhysicsObject *obj);
 
         double time();
 
@@ -423,6 +687,42 @@ namespace Diana
 
         std::map<int64_t, struct SmartPhysicsObject *> smarties;
         std::vector<struct PhysicsObject *> attractors;
+        //! Positions and masses of the attractors, laid out for summing up gravity quickly.
+        struct AttractorSet attractor_set;
+        //! Objects on rails, ordered so that every object comes after the object that its rails
+        //! are relative to.
+        std::vector<struct PhysicsObject *> railed;
+        //! Number of gravity evaluations and extrapolations in each block of objects handed to the
+        //! worker pool when moving everything that isn't an attractor.
+        std::vector<size_t> particle_evaluations;
+        std::vector<size_t> particle_extrapolations;
+        //! Scratch space for the acceleration of each attractor while they're being moved.
+        std::vector<struct Vector3> attractor_accel;
+        //! How fast the acceleration of each attractor changed over the tick, as a fraction of itself
+        //! per second, and each attractor as it was at the start of the tick, in case the tick
+        //! has to be done again with a finer step.
+        std::vector<double> attractor_rates;
+        std::vector<struct PhysicsObject> attractor_saved;
+        //! The most times the tick was halved for any object in each block handed to the worker
+        //! pool, the objects in each block whose step was too coarse, and all of those together.
+        std::vector<uint64_t> particle_levels;
+        std::vector<std::vector<struct PhysicsObject *>> particle_retries;
+        std::vector<struct PhysicsObject *> retry_objects;
+        //! The attractors as they were at the start of the tick.
+        struct AttractorSet attractor_start;
+
+        //! The attractors as they were at some point during the tick, with a gravity tree built from
+        //! them when gravity_tree isn't NULL.
+        struct GravityStage
+        {
+            struct AttractorSet set;
+            BarnesHutTree *tree;
+        };
+        //! For each number of times that the tick is halved, the attractors at the end of every
+        //! substep but the last, and at every Forest-Ruth kick. These are only filled in on ticks
+        //! where something needs them.
+        std::vector<std::vector<struct GravityStage>> step_stages;
+        std::vector<std::vector<struct GravityStage>> forest_ruth_stages;
         std::vector<struct PhysicsObject *> radiators;
         std::vector<struct PhysicsObject *> phys_objects;
         std::vector<struct Beam *> beams;
@@ -432,14 +732,73 @@ namespace Diana
         struct PhysCollisionEvent
         {
             struct PhysicsObject *obj1;
-            size_t obj1_index;
             struct PhysicsObject *obj2;
-            size_t obj2_index;
+            //! Generations of the two objects when the event was found. If either object's generation
+            //! has moved on since, the event is stale.
+            uint32_t generation1;
+            uint32_t generation2;
             struct PhysCollisionResult pcr;
         };
-        // Vector of all collisions encountered in the current tick
+        //! All pending collisions in the current tick, before they're split into islands.
         std::vector<struct PhysCollisionEvent> collisions;
 
+        //! Where an object whose box was re-estimated after a collision stands in its island.
+        struct resolved_object
+        {
+            //! The collision round that the box was last re-estimated in.
+            uint32_t round;
+            //! Position of the object among the objects resolved in that round.
+            size_t index;
+        };
+
+        //! A set of collisions that share objects, directly or through other collisions, and so
+        //! have to be resolved together, in time order. Islands that don't share any objects are
+        //! resolved independently of each other, on separate threads.
+        struct CollisionIsland
+        {
+            //! Position of the island in the list of islands.
+            int32_t id;
+            //! Heap of pending collisions in the island, with the earliest at the top.
+            std::vector<struct PhysCollisionEvent> events;
+            //! Objects involved in the collisions in the current collision round.
+            std::vector<struct PhysicsObject *> round_objects;
+            //! Objects resolved in this island, in the order they were first resolved. Their boxes
+            //! no longer match what the broad-phase knows about them, so re-tests check these directly.
+            std::vector<struct PhysicsObject *> resolved_objects;
+            std::unordered_map<struct PhysicsObject *, struct resolved_object> resolved_rounds;
+            //! Pairs of an object in the island and one outside of it that might collide. Resolution
+            //! stops as soon as one of these turns up, since the other object isn't ours to touch.
+            std::vector<struct BroadPhasePair> boundary;
+            //! Scratch list of candidates returned by the broad-phase during re-tests.
+            std::vector<struct PhysicsObject *> candidates;
+            //! Collision messages for smarties in the island, with the sockets to send them on. These
+            //! are moved to collision_messages, in island order, once every island in the set is done.
+            std::vector<std::pair<int32_t, BSONMessage *>> messages;
+            //! Number of the current collision round. This carries on from the rounds resolved
+            //! in earlier sets of islands in the tick.
+            uint32_t round;
+            struct CollisionMetrics metrics;
+            struct CollisionMetrics retest_metrics;
+        };
+        std::vector<struct CollisionIsland> islands;
+        //! The island that each object belongs to, while islands are being resolved.
+        std::unordered_map<struct PhysicsObject *, int32_t> island_of;
+        //! Objects whose boxes were re-estimated by islands resolved earlier in the current tick,
+        //! and their boxes as of when the latest set of islands started.
+        std::vector<struct PhysicsObject *> resolved_objects;
+        std::vector<struct AABB> resolved_boxes;
+        std::unordered_set<struct PhysicsObject *> resolved_set;
+
+        //! Broad-phase structure that tracks all physics objects, or NULL when using the
+        //! sorted list in phys_objects directly.
+        BroadPhase *broadphase;
+        //! Pairs reported by the broad-phase structure in the current tick.
+        std::vector<struct BroadPhasePair> candidate_pairs;
+
+        //! Octree used to approximate gravity, rebuilt from the attractors at the start of every
+        //! round of object ticks, or NULL when summing over every attractor directly.
+        BarnesHutTree *gravity_tree;
+
         // Represents the pair of IDs that uniquely identifies a beam/object collision event.
         // This is used as the index object for SCAN queries sent to the OSIM.
         struct scan_target
@@ -479,25 +838,92 @@ namespace Diana
         //! added to the universe.
         std::map<struct scan_target, struct scan_origin> queries;
 
+        //! Side effects of ticking a block of objects that reach outside of the objects themselves.
+        //! These are held back so that the blocks can be ticked on separate threads, and carried out
+        //! in the order of the blocks once they're all done, so that the outcome doesn't depend on
+        //! which thread got where first.
+        struct TickEffects
+        {
+            //! Scan queries to wait on a response from the OSim for.
+            std::vector<std::pair<struct scan_target, struct scan_origin>> queries;
+            //! Beams given off by objects that were hit, to be added to the universe.
+            std::vector<struct Beam *> beams;
+            //! Messages for smarties, with the sockets to send them on. These are deleted once sent.
+            std::vector<std::pair<int32_t, BSONMessage *>> messages;
+            //! Scratch space for the beams that might hit an object, reused from one object to the next.
+            std::vector<uint32_t> beam_candidates;
+        };
+        //! The side effects of each block of objects handed to the worker pool in the current tick.
+        std::vector<struct TickEffects> tick_effects;
+        //! Collision messages from every island resolved in the current tick, in island order. These
+        //! are sent along with the rest of the tick's messages, once the physics lock is released.
+        std::vector<std::pair<int32_t, BSONMessage *>> collision_messages;
+
+        //! Boxes around where each beam's wavefront can hit something this tick, sorted by their lower
+        //! bound along beam_axis, and the index in beams of the beam that each belongs to.
+        std::vector<struct AABB> beam_boxes;
+        std::vector<uint32_t> beam_order;
+        //! The largest upper bound along beam_axis of each run of BEAM_INDEX_RUN boxes, so that a
+        //! query can skip over runs that all end before its box starts.
+        std::vector<double> beam_run_upper;
+        int32_t beam_axis;
+
         //! Structure holding the arguments for the threaded checking of collisions
         struct phys_args
         {
             //! Universe to check
             Universe *u;
-            //! Position in the sorted list to start at, 0-based
+            //! Position in the sorted list (or list of candidate pairs) to start at, 0-based
             size_t offset;
-            //! Amount to move along the sorted list after processing.
+            //! Amount to move along the sorted list (or list of candidate pairs) after processing.
             size_t stride;
             //! Time tick to use for real collision testing.
             double dt;
-            //! Whether to test all objects against the original offset object, used in multipass-collision testing.
-            bool test_all;
-            //! Whether or not this worker has finished its work
-            volatile bool done;
+            //! Object to test against all others, used in multipass-collision testing.
+            struct PhysicsObject *obj;
+            //! Island that obj belongs to, used in multipass-collision testing.
+            struct CollisionIsland *island;
+            //! Whether to test the huge objects against everything else, instead of sweeping
+            //! through part of the sorted list.
+            bool huge;
+            //! Collisions found by this worker, kept separate so that workers never contend
+            //! for a shared list. These are gathered into the universe's list after the join.
+            std::vector<struct PhysCollisionEvent> collisions;
+            //! Pairs whose boxes overlap, waiting on the narrow-phase.
+            struct SweepBatch batch;
+            //! Sleeping objects whose boxes overlap an awake object's, to be woken after the join.
+            std::vector<struct PhysicsObject *> wakes;
+            //! Metrics for the most recent pass made by this worker.
+            struct CollisionMetrics metrics;
         };
 
+        //! Arguments for each worker's part of the collision pass. There is one more of these
+        //! than there are threads, and the last is used for testing the huge objects.
         struct phys_args *phys_worker_args;
 
+        //! When using the sorted list for the broad-phase, the axis that it is sorted and swept
+        //! along, where 0, 1 and 2 are X, Y and Z.
+        int32_t sweep_axis;
+        //! When using the sorted list for the broad-phase, the number of objects at the front of
+        //! phys_objects that are sorted by the lower bound of their boxes along sweep_axis.
+        //! Everything after these is a huge object, or was added since the last sort.
+        size_t num_sorted;
+        //! The number of objects at the front of the sorted part of phys_objects that were there
+        //! for the last sort, and so are nearly in order.
+        size_t num_presorted;
+        //! The largest extent along sweep_axis of any box in the sorted part of phys_objects, as
+        //! of the last sort.
+        double max_sorted_extent;
+        //! Scratch space for finding the median radius.
+        std::vector<double> radii;
+        //! The box of each object in phys_objects, as of the last sort. Boxes that are re-estimated
+        //! after a collision aren't in sorted order any more, but this stays sorted, so it can still
+        //! be searched.
+        std::vector<struct AABB> sorted_boxes;
+
+        //! Persistent pool of threads that collision checking is split across.
+        WorkerPool *workers;
+
         //! @todo Move these threaded operations onto the scheduler, let it handle the asynchronous stuff
         THREAD_T sim_thread;
         THREAD_T vis_thread;
@@ -506,7 +932,6 @@ namespace Diana
         LOCK_T phys_lock;
         LOCK_T vis_lock;
         LOCK_T query_lock;
-        LOCK_T collision_lock;
         LOCK_T rand_lock;
 
         //! Rate (1.0 = real time) at which to simulate the world. Useful for speeding up orbital mechanics.
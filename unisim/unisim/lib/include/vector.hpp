@@ -70,6 +70,17 @@ namespace Diana
     void Vector3_rotate_around(struct Vector3* v, struct Vector3* axis, double angle);
     void Vector3_apply_ypr(struct Vector3* forward, struct Vector3* up, struct Vector3* right, struct Vector3* angles);
 
+    //! A unit quaternion, as a Vector4, holds an orientation as the rotation that takes the axes to
+    //! the forward, right and up vectors, in that order.
+    const struct Vector4 vector4d_identity = { 1.0, 0.0, 0.0, 0.0 };
+    //! Turn an orientation through yaw, pitch, and roll angles about its own up, right, and forward
+    //! vectors, in the same sense as Vector3_apply_ypr(), all at once.
+    void Vector4_apply_ypr(struct Vector4* q, struct Vector3* angles);
+    //! The forward, up, and right vectors of an orientation. Any of them may be NULL.
+    void Vector4_get_basis(struct Vector4* q, struct Vector3* forward, struct Vector3* up, struct Vector3* right);
+    //! The orientation with the given forward, up, and right vectors, which have to be orthonormal.
+    void Vector4_from_basis(struct Vector4* q, struct Vector3* forward, struct Vector3* up, struct Vector3* right);
+
     int32_t Vector3_compare_aabb(struct AABB* a, struct AABB* b);
     int32_t Vector3_compare_aabb(struct AABB* a, struct AABB* b, int32_t d);
     int32_t Vector3_compare_aabbX(struct AABB* a, struct AABB* b);
@@ -0,0 +1,69 @@
+#ifndef WORKERPOOL_HPP
+#define WORKERPOOL_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Diana
+{
+    //! A persistent pool of threads used to split up the work in a physics tick.
+    //!
+    //! Work is handed to the pool as a number of independent tasks, identified only by their
+    //! index, that the threads claim one at a time until none are left. The thread that hands
+    //! out the work always participates in it, so a pool of size N only spawns N-1 helpers.
+    //!
+    //! Helpers that have nothing to do block on a condition variable, instead of spinning, so
+    //! an idle pool costs nothing in between ticks.
+    class WorkerPool
+    {
+        friend void *WorkerPool_thread(void *poolV);
+
+    public:
+        //! @param num_threads Total number of threads doing work, including the calling thread.
+        WorkerPool(int32_t num_threads);
+        ~WorkerPool();
+
+        //! Number of threads that participate in work, including the calling thread.
+        int32_t size();
+
+        //! Hand out n tasks to the pool, and then work on them from the calling thread too.
+        //! This returns once the calling thread can't claim any more tasks, which doesn't mean
+        //! that the helpers are finished. Always follow up with a call to join() before
+        //! touching the results, or handing out more work.
+        void run(size_t n, std::function<void(size_t)> work);
+
+        //! Block until every task handed out by the last call to run() has completed.
+        void join();
+
+    private:
+        //! Claim and complete tasks until there are none left.
+        void drain();
+
+        std::vector<std::thread> helpers;
+
+        std::mutex lock;
+        //! Signalled when a new batch of work is ready, or when the pool is shutting down.
+        std::condition_variable work_ready;
+        //! Signalled when the last busy helper finishes with the current batch.
+        std::condition_variable work_done;
+
+        std::function<void(size_t)> work;
+        size_t num_tasks;
+        std::atomic<size_t> next_task;
+
+        //! Incremented for every batch of work, so that helpers can tell new work from spurious wakeups.
+        uint64_t generation;
+        //! Number of helpers that haven't finished with the current batch yet.
+        int32_t busy;
+        bool running;
+    };
+}
+
+#endif
@@ -0,0 +1,167 @@
+#include "narrowphase.hpp"
+
+#include <math.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// Matches the cutoff that Vector3_almost_zeroS() uses.
+#define CHOP_CUTOFF 1e-8
+// Relative slack given to the batch test, so that it never turns away a pair that the full test
+// would have accepted, even if the two were compiled with different rounding behaviour (such as
+// fused multiply-adds in one but not the other).
+#define SWEEP_SLACK 1e-9
+
+namespace Diana
+{
+    typedef struct PhysicsObject PO;
+
+    void SweepBatch_init(struct SweepBatch *batch)
+    {
+        batch->size = 0;
+    }
+
+    void SweepBatch_clear(struct SweepBatch *batch)
+    {
+        batch->size = 0;
+    }
+
+    void SweepBatch_add(struct SweepBatch *batch, PO *obj1, PO *obj2, double dt)
+    {
+        // Grow every array at once, and then fill them in place, so the common case is just stores.
+        size_t i = batch->size;
+        if (i == batch->obj1.size())
+        {
+            size_t n = (i == 0 ? SWEEP_BATCH_SIZE : 2 * i);
+            batch->obj1.resize(n);
+            batch->obj2.resize(n);
+            batch->px.resize(n);
+            batch->py.resize(n);
+            batch->pz.resize(n);
+            batch->dx.resize(n);
+            batch->dy.resize(n);
+            batch->dz.resize(n);
+            batch->r2.resize(n);
+            batch->hit.resize(n);
+        }
+
+        // These are the same quantities, worked out the same way, as in PhysicsObject_collide().
+        batch->obj1[i] = obj1;
+        batch->obj2[i] = obj2;
+        batch->px[i] = obj1->position.x - obj2->position.x;
+        batch->py[i] = obj1->position.y - obj2->position.y;
+        batch->pz[i] = obj1->position.z - obj2->position.z;
+        batch->dx[i] = obj1->velocity.x * dt - obj2->velocity.x * dt;
+        batch->dy[i] = obj1->velocity.y * dt - obj2->velocity.y * dt;
+        batch->dz[i] = obj1->velocity.z * dt - obj2->velocity.z * dt;
+        double r = obj1->radius + obj2->radius;
+        batch->r2[i] = r * r;
+        batch->size++;
+    }
+
+    // Test a single pair. This handles the whole batch when there's no vector unit to use, and
+    // whatever is left over after the vector loop otherwise.
+    //
+    // Following PhysicsObject_collide(), with o the relative position, d the relative displacement,
+    // and r the square of the sum of the radii, the balls touch when
+    //
+    //     t = (-(o.d) +/- sqrt((o.d)^2 - (d.d)(o.o - r))) / (d.d)
+    //
+    // and the pair is turned away if they aren't moving relative to each other, if there's no
+    // solution, or if the earliest one isn't in [0, 1].
+    static inline uint8_t sweep_test_one(struct SweepBatch *b, size_t i)
+    {
+        double dx = b->dx[i];
+        double dy = b->dy[i];
+        double dz = b->dz[i];
+        if ((fabs(dx) < CHOP_CUTOFF) && (fabs(dy) < CHOP_CUTOFF) && (fabs(dz) < CHOP_CUTOFF))
+        {
+            return 0;
+        }
+
+        double px = b->px[i];
+        double py = b->py[i];
+        double pz = b->pz[i];
+        double od = dx * px + dy * py + dz * pz;
+        double oo = px * px + py * py + pz * pz;
+        double dd = dx * dx + dy * dy + dz * dz;
+        double r = b->r2[i];
+
+        double disc = od * od - dd * (oo - r);
+        double slack = SWEEP_SLACK * (od * od + dd * (oo + r));
+        if (disc < -(CHOP_CUTOFF + slack))
+        {
+            return 0;
+        }
+
+        double s = sqrt(disc > 0.0 ? disc : 0.0);
+        double t = (od > -CHOP_CUTOFF ? (s - od) / dd : -(s + od) / dd);
+        return !((t < -(CHOP_CUTOFF + SWEEP_SLACK)) || (t > 1.0 + SWEEP_SLACK));
+    }
+
+    size_t SweepBatch_test(struct SweepBatch *b)
+    {
+        size_t i = 0;
+        size_t n = b->size;
+        size_t num_hits = 0;
+
+#ifdef __AVX2__
+        // Four pairs at a time. The comparisons are all ordered, and so false for NaNs, which
+        // lets those through to the full test, just like the scalar version.
+        const __m256d zero = _mm256_setzero_pd();
+        const __m256d chop = _mm256_set1_pd(CHOP_CUTOFF);
+        const __m256d neg_chop = _mm256_set1_pd(-CHOP_CUTOFF);
+        const __m256d rel_slack = _mm256_set1_pd(SWEEP_SLACK);
+        const __m256d t_lo = _mm256_set1_pd(-(CHOP_CUTOFF + SWEEP_SLACK));
+        const __m256d t_hi = _mm256_set1_pd(1.0 + SWEEP_SLACK);
+        const __m256d abs_mask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7FFFFFFFFFFFFFFFLL));
+
+        for (; i + 4 <= n; i += 4)
+        {
+            __m256d dx = _mm256_loadu_pd(&b->dx[i]);
+            __m256d dy = _mm256_loadu_pd(&b->dy[i]);
+            __m256d dz = _mm256_loadu_pd(&b->dz[i]);
+            __m256d px = _mm256_loadu_pd(&b->px[i]);
+            __m256d py = _mm256_loadu_pd(&b->py[i]);
+            __m256d pz = _mm256_loadu_pd(&b->pz[i]);
+            __m256d r = _mm256_loadu_pd(&b->r2[i]);
+
+            __m256d still = _mm256_and_pd(_mm256_and_pd(
+                                              _mm256_cmp_pd(_mm256_and_pd(dx, abs_mask), chop, _CMP_LT_OQ),
+                                              _mm256_cmp_pd(_mm256_and_pd(dy, abs_mask), chop, _CMP_LT_OQ)),
+                                          _mm256_cmp_pd(_mm256_and_pd(dz, abs_mask), chop, _CMP_LT_OQ));
+
+            __m256d od = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, px), _mm256_mul_pd(dy, py)), _mm256_mul_pd(dz, pz));
+            __m256d oo = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(px, px), _mm256_mul_pd(py, py)), _mm256_mul_pd(pz, pz));
+            __m256d dd = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)), _mm256_mul_pd(dz, dz));
+
+            __m256d odod = _mm256_mul_pd(od, od);
+            __m256d disc = _mm256_sub_pd(odod, _mm256_mul_pd(dd, _mm256_sub_pd(oo, r)));
+            __m256d slack = _mm256_mul_pd(rel_slack, _mm256_add_pd(odod, _mm256_mul_pd(dd, _mm256_add_pd(oo, r))));
+            __m256d no_root = _mm256_cmp_pd(disc, _mm256_sub_pd(neg_chop, slack), _CMP_LT_OQ);
+
+            __m256d s = _mm256_sqrt_pd(_mm256_max_pd(disc, zero));
+            __m256d t_pos = _mm256_div_pd(_mm256_sub_pd(s, od), dd);
+            __m256d t_neg = _mm256_div_pd(_mm256_sub_pd(zero, _mm256_add_pd(s, od)), dd);
+            __m256d t = _mm256_blendv_pd(t_neg, t_pos, _mm256_cmp_pd(od, neg_chop, _CMP_GT_OQ));
+            __m256d out_of_range = _mm256_or_pd(_mm256_cmp_pd(t, t_lo, _CMP_LT_OQ), _mm256_cmp_pd(t, t_hi, _CMP_GT_OQ));
+
+            int32_t reject = _mm256_movemask_pd(_mm256_or_pd(_mm256_or_pd(still, no_root), out_of_range));
+            for (int32_t k = 0; k < 4; k++)
+            {
+                b->hit[i + k] = !((reject >> k) & 1);
+                num_hits += b->hit[i + k];
+            }
+        }
+#endif
+
+        for (; i < n; i++)
+        {
+            b->hit[i] = sweep_test_one(b, i);
+            num_hits += b->hit[i];
+        }
+
+        return num_hits;
+    }
+}
@@ -15,6 +15,9 @@ namespace Diana
     //! Multiplying two angles to give a solid angle area results in sa=2 pi^2 square radians for a full sphere
     //! Converting that to area square length units means multiplying by sa*((2/pi) r^2)=c where sa=Solid Angle, c=cutoff
 #define BEAM_SOLID_ANGLE_FACTOR (2 / M_PI)
+    //! How far from orthonormal a beam's direction, up and right vectors can be before its sweep
+    //! box stops trusting them, and covers everything.
+#define BEAM_FRAME_TOLERANCE 1e-6
 
 #define ABS(x) ((x) < 0 ? -(x) : (x))
 #define MIN(x, y) (((x) < (y)) ? (x) : (y))
@@ -76,10 +79,18 @@ namespace Diana
         obj->radius = radius;
         obj->obj_type = const_cast<char *>(obj_type);
         obj->t = 0.0;
-
-        Vector3_init(&obj->forward, 1, 0, 0);
-        Vector3_init(&obj->right, 0, 1, 0);
-        Vector3_init(&obj->up, 0, 0, 1);
+        obj->proxy = -1;
+        obj->generation = 0;
+        obj->rails = NULL;
+        obj->grav_cached = false;
+        obj->integrator = INTEGRATOR_UNIVERSE;
+        obj->last_accel_time = -INFINITY;
+        obj->timestep_level = 0;
+        obj->asleep = false;
+        obj->still_ticks = 0;
+
+        // Facing along x, with y to the right and z up.
+        obj->orientation = vector4d_identity;
 
         obj->health = mass * 1000000;
         obj->emits_gravity = is_big_enough(mass, radius, universe->params.gravity_magnitude_cutoff);
@@ -106,8 +117,9 @@ namespace Diana
         // (acceleration), but handles the velocity incrementing a little differently as it considers
         // the acceleration in two consecutive frames.
         //
-        // Since we don't have the acceleration (thrust) in the previous frame, this isn't
-        // something we can do, so we'll have to settle with something simpler.
+        // That needs the acceleration at the end of the tick as well, which the universe carries
+        // over between ticks for objects using INTEGRATOR_VERLET. This is the simpler scheme used
+        // by INTEGRATOR_EULER.
 
         // @todo Separate this into separate position deltas, so that the acceleration distance
         // travelled is more accurate, and then add the position delta to the position at the
@@ -126,22 +138,63 @@ namespace Diana
         // We account for the position delta above with the FMAD.
         Vector3_fmad(&obj->velocity, dt / obj->mass, &obj->thrust);
 
+        PhysicsObject_rotate(obj, dt);
+    }
+
+    void PhysicsObject_wake(PO *obj)
+    {
+        obj->asleep = false;
+        obj->still_ticks = 0;
+    }
+
+    void PhysicsObject_drift(PO *obj, double dt)
+    {
+        Vector3_fmad(&obj->position, dt, &obj->velocity);
+    }
+
+    void PhysicsObject_kick(PO *obj, V3 *a, double dt)
+    {
+        Vector3_fmad(&obj->velocity, dt, a);
+        Vector3_fmad(&obj->velocity, dt / obj->mass, &obj->thrust);
+    }
+
+    void PhysicsObject_rotate(PO *obj, double dt)
+    {
         if (!Vector3_almost_zero(&obj->ang_velocity))
         {
             V3 a = {dt * obj->ang_velocity.x, dt * obj->ang_velocity.y, dt * obj->ang_velocity.z};
-            Vector3_apply_ypr(&obj->forward, &obj->up, &obj->right, &a);
+            Vector4_apply_ypr(&obj->orientation, &a);
         }
     }
 
     void PhysicsObject_from_orientation(struct PhysicsObject *obj, struct Vector4 *orientation)
     {
-        obj->forward.x = orientation->w;
-        obj->forward.y = orientation->x;
-        obj->forward.z = 1 - sqrt(obj->forward.x * obj->forward.x + obj->forward.x * obj->forward.y);
+        // Only the x and y components are sent, so the z components are taken to be positive.
+        V3 forward = {orientation->w, orientation->x, 0.0};
+        forward.z = sqrt(MAX(0.0, 1.0 - forward.x * forward.x - forward.y * forward.y));
+        V3 up = {orientation->y, orientation->z, 0.0};
+        up.z = sqrt(MAX(0.0, 1.0 - up.x * up.x - up.y * up.y));
+
+        // Square the basis up, in case rounding on the way over has knocked it askew.
+        V3 right;
+        Vector3_normalize(&forward);
+        Vector3_fmad(&up, -Vector3_dot(&up, &forward), &forward);
+        if (Vector3_almost_zero(&up))
+        {
+            return;
+        }
+        Vector3_normalize(&up);
+        Vector3_cross(&right, &up, &forward);
 
-        obj->up.x = orientation->y;
-        obj->up.y = orientation->z;
-        obj->up.z = 1 - sqrt(obj->up.x * obj->up.x + obj->up.x * obj->up.y);
+        Vector4_from_basis(&obj->orientation, &forward, &up, &right);
+    }
+
+    void PhysicsObject_get_orientation(struct PhysicsObject *obj, struct Vector4 *orientation)
+    {
+        V3 forward;
+        V3 up;
+        Vector4_get_basis(&obj->orientation, &forward, &up, NULL);
+        Vector4_init(orientation, forward.x, forward.y, up.x, up.y);
     }
 
     struct Spectrum *Spectrum_clone(struct Spectrum *src)
@@ -583,7 +636,11 @@ namespace Diana
         // components, which is equivalent to adding the delta in velocity along the normal
         // to the current velocity.
         // Vector3_add(&obj->velocity, &pce->t, &pce->n);
-        Vector3_add(&obj->velocity, &pce->dn);
+        // Objects on rails carry on regardless.
+        if (obj->rails == NULL)
+        {
+            Vector3_add(&obj->velocity, &pce->dn);
+        }
     }
 
     void PhysicsObject_estimate_aabb(PO *obj, struct AABB *b, double dt)
@@ -650,6 +707,8 @@ namespace Diana
                     }
                 }
                 ret->spectrum = Spectrum_clone(obj->spectrum);
+                // The clone is a snapshot, and doesn't share the original's rails.
+                ret->rails = NULL;
             }
         }
         case PHYSOBJECT_SMART:
@@ -674,6 +733,8 @@ namespace Diana
                     }
                 }
                 ret->spectrum = Spectrum_clone(obj->spectrum);
+                // The clone is a snapshot, and doesn't share the original's rails.
+                ret->rails = NULL;
             }
             break;
         }
@@ -735,7 +796,7 @@ namespace Diana
     }
 
     //! @param args This describes the information about the thing that hit obj, that is other.
-    void PhysicsObject_collision(PO *obj, PO *other, double energy, double dt, struct PhysCollisionEffect *effect, double health_cutoff)
+    void PhysicsObject_collision(PO *obj, PO *other, double energy, double dt, struct PhysCollisionEffect *effect, double health_cutoff, std::vector<B *> *spawned)
     {
         switch (other->type)
         {
@@ -772,7 +833,14 @@ namespace Diana
                 {
                     throw std::runtime_error("OOMError::ScanTargetAllocFailed");
                 }
-                obj->universe->add_object(res);
+                if (spawned != NULL)
+                {
+                    spawned->push_back(res);
+                }
+                else
+                {
+                    obj->universe->add_object(res);
+                }
             }
             break;
         }
@@ -857,6 +925,21 @@ namespace Diana
         Beam_init(beam, universe, origin, &direction, &up2, &right, cosh, cosv, area_factor, speed, energy, beam_type, comm_msg, data, spectrum);
     }
 
+    // Whether a position relative to the beam's origin is inside one of the beam's spreads, which is
+    // measured in the plane that axis is normal to. A position on the axis itself is on the edge of
+    // every spread about it, and counts as inside.
+    static bool beam_within_spread(B *b, V3 *p, V3 *axis, double cosine)
+    {
+        V3 proj;
+        Vector3_project_down(&proj, p, axis);
+        double l = Vector3_length(&proj);
+        if (Vector3_almost_zeroS(l))
+        {
+            return true;
+        }
+        return (Vector3_dot(&proj, &b->direction) / l) >= cosine;
+    }
+
     void Beam_collide(struct BeamCollisionResult *bcr, B *b, PO *obj, double dt)
     {
         //! @todo Take radius into account, which will also require triage for multiple ticks
@@ -866,13 +949,8 @@ namespace Diana
 
         //! @todo Take into account how much of the object is in the beam's path.
 
-        //! @todo There might be a way to more quickly reject from here based on distance,
-        //! which could be easie to computer. The problem is that t comes from angle calcs.
-
-        // Move the object position to be relative to the beam's origin.
-        // Then scale the velocity by dt, and add it to the position to get the
-        // start, end, and difference vectors.
         bcr->d = b->direction;
+        bcr->t = -1.0;
 
         // Relative position of object to beam origin.
         V3 p = obj->position;
@@ -883,234 +961,61 @@ namespace Diana
         // about hitting the object we started at.
         if (Vector3_almost_zero(&p) && Vector3_almost_zeroS(b->distance_travelled))
         {
-            bcr->t = -1.0;
             return;
         }
 
-        // Object position delta in this tick.
-        V3 dp = obj->velocity;
-        Vector3_scale(&dp, dt);
-
-        // The object's position at the end of the physics tick.
-        V3 p2;
-        Vector3_add(&p2, &p, &dp);
-
-        //! @todo Early rejection if we're WAY outside of collision distance.
-
-        // Get the components of the position at the start and end of the physics tick
-        // that lie in the plane defined by the up and right vectors of the beam
-        // respectively.
-        //
-        // Note that there's going to be a problem with vectors that are in the plane
-        // defined by the up and right vectors. Vectors in this plane will have 0 dot
-        // product with the direction vector, and so compare unfavourably with the
-        // cosines of the spread.
-        //
-        // - proj_*[0] is the projection DOWN the up vector into the RIGHT/FORWARD plane
-        // - proj_*[1] is the projection DOWN the right vector into the UP/FORWARD plane
-
-        V3 proj_s[2];
-        Vector3_project_down(&proj_s[0], &p, &b->up);
-        Vector3_project_down(&proj_s[1], &p, &b->right);
-        Vector3_normalize(&proj_s[0]);
-        Vector3_normalize(&proj_s[1]);
-
-        V3 proj_e[2];
-        Vector3_project_down(&proj_e[0], &p2, &b->up);
-        Vector3_project_down(&proj_e[1], &p2, &b->right);
-        Vector3_normalize(&proj_e[0]);
-        Vector3_normalize(&proj_e[1]);
-
-        // Now dot with the beam direction to get the angles of the rays make. Do it for
-        // the original position, and for the position plus the position delta. Projecting
-        // down the up vector gets us the horizontal angle, and down the right vector
-        // gets us the vertical angle.
-        //
-        // Note that cosine decreses from 1 to -1 as the angle goes from 0 to 180 (0 to pi).
-        // We are inside, if we are > than the cosine of our beam. Note that since cosine
-        // is symmetric about 0, the beam's cosines are actually from the direction to the
-        // edge of the volume, and we can just test this half-angle.
-
-        double current[2] = {Vector3_dot(&proj_s[0], &b->direction), Vector3_dot(&proj_s[1], &b->direction)};
-        double future[2] = {Vector3_dot(&proj_e[0], &b->direction), Vector3_dot(&proj_e[1], &b->direction)};
-        double delta[2] = {future[0] - current[0], future[1] - current[1]};
-
-        bool current_b[2] = {(current[0] >= b->cosines[0]), (current[1] >= b->cosines[1])};
-        bool future_b[2] = {(future[0] >= b->cosines[0]), (future[1] >= b->cosines[1])};
-
-        double entering = -0.1;
-        double leaving = 1.1;
-
-        //! @todo This should be looked at for efficiency.
-
-        // However, if the direction vector under consideration is in the up/right plane,
-        // Then we need to do something a little different. In this case, we have that at
-        // least one of the two cosines is negative (extends to include a part of this
-        // plane, if they are both negative, then we can just set the value to true, since
-        // the spanned volume contains the entirety of this plane), and that the direction
-        // vector 'matches' the non-negative cosine.
-
-        // Remember:
-        //  - cosines[0] = cosh
-        //  - cosines[1] = cosv
-        //
-        // For the current/future/proj_s/proj_e pairs:
-        //  - [0] = projection into the UP/forward plane
-        //  - [1] = projection into the RIGHT/forward plane
-
-        // If the relative position vector lies in the up/right plane...
-
-        // Current
-        if (Vector3_almost_zeroS(Vector3_dot(&p, &b->direction)))
-        {
-            // Figure out which one failed the cosine test, Then check that the other cosine is < 0 or almost 0.
-            // If that checks out, then get the cosine of the position vector with the appropriate vector:
-            //  - horizontal spread (cosines[0]) => up vector
-            //  - vertical spread => right vector
-            // Then, check that cosine against the cosines of the beam.
-            if (!current_b[0] && ((b->cosines[1] < 0) || Vector3_almost_zeroS(b->cosines[1])))
-            {
-                current[0] = Vector3_dot(&p, &b->up) / Vector3_length(&p);
-                current_b[0] = (current[0] >= b->cosines[0]);
-            }
-            else if (!current_b[1] && ((b->cosines[0] < 0) || Vector3_almost_zeroS(b->cosines[0])))
-            {
-                current[1] = Vector3_dot(&p, &b->right) / Vector3_length(&p);
-                current_b[1] = (current[1] >= b->cosines[1]);
-            }
-        }
+        // The wavefront is a plane normal to the beam's direction, distance_travelled + speed * t
+        // from the origin, and the object's distance along the direction is s + v * t over the
+        // tick. Solve for when the two meet. Beams that spread past 90 degrees also reach behind
+        // the origin, where the object meets the front when -(s + v * t) is the front's distance.
+        double s = Vector3_dot(&p, &b->direction);
+        double v = Vector3_dot(&obj->velocity, &b->direction);
 
-        // Future
-        if (Vector3_almost_zeroS(Vector3_dot(&p2, &b->direction)))
+        double t = INFINITY;
+        if (b->speed - v > 0.0)
         {
-            if (!future_b[0] && ((b->cosines[1] < 0) || Vector3_almost_zeroS(b->cosines[1])))
+            double ahead = (s - b->distance_travelled) / (b->speed - v);
+            if (ahead >= 0.0)
             {
-                future[0] = Vector3_dot(&p2, &b->up) / Vector3_length(&p);
-                future_b[0] = (future[0] >= b->cosines[0]);
-            }
-            else if (!future_b[1] && ((b->cosines[0] < 0) || Vector3_almost_zeroS(b->cosines[0])))
-            {
-                future[1] = Vector3_dot(&p2, &b->right) / Vector3_length(&p);
-                future_b[1] = (future[1] >= b->cosines[1]);
+                t = ahead;
             }
         }
-
-        // This assumes that our position delta is small enough that we can consider things linear
-        // Lots of linear approximation going on.
-        for (int32_t i = 0; i < 2; i++)
+        if (((b->cosines[0] < 0.0) || (b->cosines[1] < 0.0)) && (b->speed + v > 0.0))
         {
-            // We also need to consider the situation where one or both angles are >pi, which
-            // results in some interaction between the two cosine values.
-            //
-            // If the current boolean is false, and the opposite cosine is negative (which
-            // means it extends far enough to look 'backward'), then be optimistic, and
-            // see if the negative of the current dot product matches the cosine restriction
-            //
-            // Check for horizontal...
-            if (!current_b[i] && (b->cosines[1 - i] < 0))
-            {
-                current_b[i] = ((-current[i]) >= b->cosines[i]);
-            }
-            // And the vertical...
-            if (!future_b[i] && (b->cosines[1 - i] < 0))
-            {
-                future_b[i] = ((-future[i]) >= b->cosines[i]);
-            }
-
-            if (!current_b[i])
-            {
-                // If we're out, and coming in
-                if (future_b[i])
-                {
-                    // Note, the delta[i] in the bottom will never be zero.
-                    // It might be close to zero for small objects, slow moving objects,
-                    // or objects far away from the origin.
-                    entering = MAX(entering, ((b->cosines[i] - current[i]) / delta[i]));
-                }
-                // If we're out and staying out
-                else
-                {
-                    bcr->t = -1.0;
-                    return;
-                }
-            }
-            else
+            double behind = (-s - b->distance_travelled) / (b->speed + v);
+            if (behind >= 0.0)
             {
-                // If we're in, and going out
-                if (!future_b[i])
-                {
-                    leaving = MIN(entering, ((current[i] - b->cosines[i]) / delta[i]));
-                }
-                // If we're in and staying in
-                else
-                {
-                    // Do nothing, this is here for clarity.
-                }
+                t = MIN(t, behind);
             }
         }
 
-        // Bail if we are somehow leaving before we are entering.
-        // This can happen if we are entering some planes and leaving others,
-        // and are leaving the plane before we enter the other plane, since
-        // we need to be inside both planes before
-        if (entering > leaving)
+        // The front passes over the object once, so a hit right at the end of the tick is left
+        // for the start of the next.
+        if (!(t < dt))
         {
-            bcr->t = -1.0;
             return;
         }
 
-        // NOTE: I'm not sure if this hunch is right, but I think it is a
-        // close enough approximation. The magic of linear situations might actually
-        // make me right...
-        //
-        // If there are still candidate values of t, then just take the middle of
-        // the interval as the 'collision' time that maximizes the energy transfer.
-        // This only might work for spheres...
-        //
-        // Either way, it is probably good enough.
-
-        // Time that maximizes the energy transfer.
-        // If we are only entering a plane, this is 1.0.
-        // If we are only leaving a plane, this is the time of leaving.
-        // If we are entering and leaving, this is the middle?
-        // Entering
-        if ((entering >= 0.0) && (leaving > 1.0))
-        {
-            bcr->t = 1.0;
-        }
-        else if ((leaving <= 1.0) && (entering < 0.0))
-        {
-            bcr->t = leaving;
-        }
-        else
-        {
-            bcr->t = (entering + leaving) / 2.0;
-        }
-
+        // Where the object is when the front reaches it, which has to be inside both spreads.
+        //  - cosines[0] = cosh, measured in the plane normal to the up vector
+        //  - cosines[1] = cosv, measured in the plane normal to the right vector
         bcr->p = p;
-        Vector3_fmad(&bcr->p, bcr->t, &dp);
-        double collision_dist = abs(Vector3_dot(&bcr->p, &b->direction));
-
-        // If we want collisions for as long as the bounding sphere is intersecting
-        // the front, use:
-        //
-        // if ((collision_dist + obj.radius) >= b.distance_travelled) and ((collision_dist - obj.radius) <= (b.distance_travelled + b.speed * dt)):
-        if ((collision_dist >= b->distance_travelled) &&
-            (collision_dist <= (b->distance_travelled + b->speed * dt)))
+        Vector3_fmad(&bcr->p, t, &obj->velocity);
+        if (!beam_within_spread(b, &bcr->p, &b->up, b->cosines[0]) ||
+            !beam_within_spread(b, &bcr->p, &b->right, b->cosines[1]))
         {
-            double wavefront_area = b->area_factor * collision_dist * collision_dist;
-            double object_surface = M_PI * obj->radius * obj->radius;
-
-            double energy_factor = object_surface / wavefront_area;
-            //! @todo Expire the beam if it's more than some cutoff for energy factor.
-            energy_factor = MIN(1.0, energy_factor);
-            bcr->e = b->energy * energy_factor;
-        }
-        else
-        {
-            bcr->t = -1.0;
             return;
         }
+
+        double collision_dist = b->distance_travelled + b->speed * t;
+        double wavefront_area = b->area_factor * collision_dist * collision_dist;
+        double object_surface = M_PI * obj->radius * obj->radius;
+
+        double energy_factor = object_surface / wavefront_area;
+        //! @todo Expire the beam if it's more than some cutoff for energy factor.
+        energy_factor = MIN(1.0, energy_factor);
+        bcr->e = b->energy * energy_factor;
+        bcr->t = t / dt;
     }
 
     void Beam_tick(B *beam, double dt)
@@ -1124,6 +1029,55 @@ namespace Diana
         }
     }
 
+    void Beam_estimate_aabb(B *beam, struct AABB *b, double dt)
+    {
+        // Beam_collide only counts a hit when the point of impact is inside both spread angles, and
+        // between distance_travelled and distance_travelled + speed * dt along the direction. That's
+        // a slice of a pyramid with a rectangular cross section, so box its eight corners. If the
+        // beam spreads to 90 degrees or more, or the vectors that the spreads are measured against
+        // aren't a proper frame, the slice isn't bounded, and neither is the box.
+        bool bounded = (beam->cosines[0] > 0.0) && !Vector3_almost_zeroS(beam->cosines[0]) &&
+                       (beam->cosines[1] > 0.0) && !Vector3_almost_zeroS(beam->cosines[1]) &&
+                       (ABS(Vector3_dot(&beam->direction, &beam->up)) < BEAM_FRAME_TOLERANCE) &&
+                       (ABS(Vector3_dot(&beam->direction, &beam->right)) < BEAM_FRAME_TOLERANCE) &&
+                       (ABS(Vector3_dot(&beam->up, &beam->right)) < BEAM_FRAME_TOLERANCE) &&
+                       (ABS(Vector3_length2(&beam->direction) - 1.0) < BEAM_FRAME_TOLERANCE) &&
+                       (ABS(Vector3_length2(&beam->up) - 1.0) < BEAM_FRAME_TOLERANCE) &&
+                       (ABS(Vector3_length2(&beam->right) - 1.0) < BEAM_FRAME_TOLERANCE);
+
+        if (!bounded)
+        {
+            Vector3_init(&b->l, -INFINITY, -INFINITY, -INFINITY);
+            Vector3_init(&b->u, INFINITY, INFINITY, INFINITY);
+            return;
+        }
+
+        // Half-widths of the cross section, per unit of distance along the beam.
+        double tan_h = sqrt(1.0 - beam->cosines[0] * beam->cosines[0]) / beam->cosines[0];
+        double tan_v = sqrt(1.0 - beam->cosines[1] * beam->cosines[1]) / beam->cosines[1];
+
+        double near_dist = beam->distance_travelled;
+        double far_dist = beam->distance_travelled + beam->speed * dt;
+
+        double *origin = (double *)&beam->origin;
+        double *direction = (double *)&beam->direction;
+        double *up = (double *)&beam->up;
+        double *right = (double *)&beam->right;
+        double *l = (double *)&b->l;
+        double *u = (double *)&b->u;
+
+        // Along each axis, the centre and width of the cross section both change linearly with the
+        // distance, so the ends of the slice are where the extremes are.
+        for (int32_t d = 0; d < 3; d++)
+        {
+            double spread = tan_h * ABS(right[d]) + tan_v * ABS(up[d]);
+            double near_c = origin[d] + near_dist * direction[d];
+            double far_c = origin[d] + far_dist * direction[d];
+            l[d] = MIN(near_c - near_dist * spread, far_c - far_dist * spread);
+            u[d] = MAX(near_c + near_dist * spread, far_c + far_dist * spread);
+        }
+    }
+
     B *Beam_make_return_beam(B *beam, double energy, V3 *origin, PhysicsObjectType type)
     {
         V3 d = *origin;
@@ -6,6 +6,7 @@
 
 #include <stdio.h>
 #include <algorithm>
+#include <string>
 
 #include "utility.hpp"
 
@@ -21,8 +22,8 @@
 // Memory allocation occurs in the following flows:
 //
 // - Constructor for worker-thread arguments
-//   > A runtime-sized array is allocated to hold return worker information, this
-//     array is deallocated in the destructor.
+//   > A runtime-sized array is allocated to hold return worker information, and the
+//     pool of worker threads is created. Both are deallocated in the destructor.
 //
 // - PhysicalPropertiesMsg received on the network containing a specified obj_type
 //   > A replacement obj_type string is allocated, and if allocation succeeds the
@@ -102,6 +103,107 @@
 #define MAX(x, y) (((x) > (y)) ? (x) : (y))
 #define CLAMP(m, v, M) MIN((M), MAX((v), (m)))
 
+// Fetch the d'th component of the lower or upper corner of a box.
+#define AABB_L(b, d) (((double *)&(b).l)[d])
+#define AABB_U(b, d) (((double *)&(b).u)[d])
+
+// How much more spread out objects have to be along another axis before the sorted list switches
+// to sweeping along it. Switching means sorting from scratch, so don't flip back and forth between
+// two axes that are about the same.
+#define SWEEP_AXIS_HYSTERESIS 1.25
+
+// The number of objects new to the sorted list, past which they're sorted on their own and then
+// merged in, instead of being walked back through the list one at a time by the gnome sort.
+#define SORT_BURST_MIN 32
+
+// When extrapolating gravity, the most that the time between full evaluations can grow by from one
+// evaluation to the next, and the most ticks that it can span.
+#define GRAVITY_MAX_GROWTH 2.0
+#define GRAVITY_MAX_TICKS 64.0
+
+// The most times that a tick can be halved for objects whose gravity changes quickly. Each level
+// costs twice as many interpolated copies of the attractors as the last, for the ticks that use it.
+#define TIMESTEP_MAX_LEVELS 16
+
+// How many ticks in a row an object has to be still before it falls asleep, and how often each
+// sleeping object checks whether the gravity on it has changed.
+#define SLEEP_DELAY_TICKS 16
+#define SLEEP_CHECK_TICKS 16
+
+// The number of sorted beam boxes that share an upper bound in the beam index. Queries skip a whole
+// run at a time when it all ends before their box starts.
+#define BEAM_INDEX_RUN 16
+
+// A splitting of a time step into alternating drifts, at constant velocity, and kicks, at constant
+// position, as fractions of the step. Each kick works out gravity once.
+struct SplittingScheme
+{
+    int32_t num_kicks;
+    double drift[4];
+    double kick[3];
+};
+
+// Drift-kick-drift leapfrog.
+// See: https://en.wikipedia.org/wiki/Leapfrog_integration
+static const struct SplittingScheme leapfrog_scheme = {1, {0.5, 0.5}, {1.0}};
+
+// Forest-Ruth is three leapfrog steps, of theta, 1 - 2 theta, and theta of the step, where the
+// middle one runs backwards. The errors of the outer two and the inner one cancel to fourth order.
+static const double forest_ruth_theta = 1.0 / (2.0 - cbrt(2.0));
+static const struct SplittingScheme forest_ruth_scheme = {
+    3,
+    {0.5 * forest_ruth_theta, 0.5 * (1.0 - forest_ruth_theta), 0.5 * (1.0 - forest_ruth_theta), 0.5 * forest_ruth_theta},
+    {forest_ruth_theta, 1.0 - 2.0 * forest_ruth_theta, forest_ruth_theta}};
+
+// Record the gravitational acceleration on an object as of the given time, and raise rate to how
+// fast it has changed since it was last recorded, as a fraction of itself per second. The rate is
+// left negative until there's something to compare against.
+static void note_accel(struct Diana::PhysicsObject *obj, struct Diana::Vector3 *a, double time, double *rate)
+{
+    double elapsed = fabs(time - obj->last_accel_time);
+    if ((elapsed > 0.0) && (elapsed < INFINITY))
+    {
+        struct Diana::Vector3 change;
+        Diana::Vector3_subtract(&change, a, &obj->last_accel);
+        double len = MAX(Diana::Vector3_length(a), Diana::Vector3_length(&obj->last_accel));
+        *rate = MAX(*rate, (len > 0.0 ? Diana::Vector3_length(&change) / (len * elapsed) : 0.0));
+    }
+
+    obj->last_accel = *a;
+    obj->last_accel_time = time;
+}
+
+// Sleeping objects don't move, so the box that they fell asleep with is still good.
+static inline void estimate_box(struct Diana::PhysicsObject *obj, double dt)
+{
+    if (!obj->asleep)
+    {
+        Diana::PhysicsObject_estimate_aabb(obj, &obj->box, dt);
+    }
+}
+
+// Sleeping objects check the gravity on them every SLEEP_CHECK_TICKS ticks, counted by
+// still_ticks, and whenever an attractor comes or goes.
+static inline bool sleep_check_due(struct Diana::PhysicsObject *obj, bool attractors_changed)
+{
+    return attractors_changed || (obj->still_ticks == SLEEP_CHECK_TICKS - 1);
+}
+
+// Two sleeping objects can't run into each other, so there's no point testing them. When only one
+// of them is asleep, the awake one has come close enough that the sleeper has to be woken, and the
+// pair is tested as normal.
+static inline bool sleepers_can_collide(struct Diana::PhysicsObject *a, struct Diana::PhysicsObject *b,
+                                        std::vector<struct Diana::PhysicsObject *> &wakes)
+{
+    if (a->asleep == b->asleep)
+    {
+        return !a->asleep;
+    }
+
+    wakes.push_back(a->asleep ? a : b);
+    return true;
+}
+
 void spin_sleep_for(std::chrono::microseconds sleep_duration);
 
 namespace Diana
@@ -120,6 +222,9 @@ namespace Diana
                                                      simultaneous_collisions(0),
                                                      collision_rounds(0),
                                                      collisions(0),
+                                                     cache_hits(0),
+                                                     cache_misses(0),
+                                                     axis_tests{0, 0, 0},
                                                      aabb_test_ns(0),
                                                      sphere_test_ns(0),
                                                      total_ns(0) {}
@@ -132,6 +237,12 @@ namespace Diana
         this->simultaneous_collisions += other.simultaneous_collisions;
         this->collision_rounds += other.collision_rounds;
         this->collisions += other.collisions;
+        this->cache_hits += other.cache_hits;
+        this->cache_misses += other.cache_misses;
+        for (int32_t d = 0; d < 3; d++)
+        {
+            this->axis_tests[d] += other.axis_tests[d];
+        }
         this->total_ns += other.total_ns;
         this->aabb_test_ns += other.aabb_test_ns;
         this->sphere_test_ns += other.sphere_test_ns;
@@ -139,15 +250,22 @@ namespace Diana
 
     void Universe::CollisionMetrics::_fprintf(FILE *fd)
     {
-        fprintf(fd, "CollisionMetrics %lu %lu %lu %lu %lu %lu %lu %lu %lu\n",
+        fprintf(fd, "CollisionMetrics %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu\n",
                 primary_aabb_tests, secondary_aabb_tests, sphere_tests,
-                simultaneous_collisions, collision_rounds, collisions,
+                simultaneous_collisions, collision_rounds, collisions, cache_hits, cache_misses,
+                axis_tests[0], axis_tests[1], axis_tests[2],
                 HRN_COUNT(aabb_test_ns), HRN_COUNT(sphere_test_ns), HRN_COUNT(total_ns));
     }
 
     Universe::TickMetrics::TickMetrics() : collision_metrics(),
                                            multicollision_metrics(),
                                            num_objects(0),
+                                           num_huge_objects(0),
+                                           num_gravity_evaluations(0),
+                                           num_gravity_extrapolations(0),
+                                           max_timestep_level(0),
+                                           num_awake_objects(0),
+                                           num_asleep_objects(0),
                                            sort_aabb_ns(0),
                                            object_tick_ns(0),
                                            beam_tick_ns(0),
@@ -160,8 +278,9 @@ namespace Diana
     {
         collision_metrics._fprintf(fd);
         multicollision_metrics._fprintf(fd);
-        fprintf(fd, "TickMetrics %lu %lu %lu %lu %lu %lu %lu %lu\n",
-                num_objects,
+        fprintf(fd, "TickMetrics %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu\n",
+                num_objects, num_huge_objects, num_gravity_evaluations, num_gravity_extrapolations, max_timestep_level,
+                num_awake_objects, num_asleep_objects,
                 HRN_COUNT(sort_aabb_ns), HRN_COUNT(object_tick_ns), HRN_COUNT(beam_tick_ns), HRN_COUNT(thread_join_wait_ns),
                 HRN_COUNT(collision_resolution_ns), HRN_COUNT(object_lifecycle_ns), HRN_COUNT(total_ns));
     }
@@ -173,10 +292,100 @@ namespace Diana
         Vector3_scale(out, m);
     }
 
+    // Sleep for the given number of seconds, spinning for short waits when that's permitted, since
+    // the OS won't reliably wake a sleeping thread on time.
+    static void sim_sleep(double seconds, bool permit_spin_sleep)
+    {
+        // C++11 sleep_for is guaranteed to sleep for AT LEAST as long as requested.
+        //
+        // In practice, a 1ms min frame time actually causes the average
+        // frame tiem to be about 2ms (Tested on Windows 8 and Ubuntu in
+        // a VBox VM).
+        int32_t sleep_duration_us = (int32_t)(1000000 * seconds);
+        std::chrono::microseconds sleep_duration = std::chrono::microseconds(sleep_duration_us);
+
+        if (permit_spin_sleep && (sleep_duration_us < SPIN_SLEEP_MAX_US))
+        {
+            spin_sleep_for(sleep_duration);
+        }
+        else
+        {
+            std::this_thread::sleep_for(sleep_duration);
+        }
+    }
+
+    void *sim_fixed(void *uV)
+    {
+        fprintf(stderr, "Universe (%p) fixed-timestep physics sim thread PID: %u\n", uV, get_this_thread_pid());
+        Universe *u = (Universe *)uV;
+
+        double step = u->params.fixed_timestep;
+        int32_t max_steps = MAX(1, u->params.max_fixed_steps);
+
+        // Wall-clock time that has passed, and that hasn't been simulated yet.
+        double accumulator = 0.0;
+
+        std::chrono::time_point<std::chrono::high_resolution_clock> last, start, end;
+        std::chrono::duration<double> elapsed;
+        last = std::chrono::high_resolution_clock::now();
+
+        while (u->running)
+        {
+            if (u->paused)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds((int32_t)(1000000 * step)));
+                // Time spent paused isn't owed to the simulation.
+                last = std::chrono::high_resolution_clock::now();
+                accumulator = 0.0;
+                continue;
+            }
+
+            int32_t num_steps = 1;
+            if (u->realtime)
+            {
+                end = std::chrono::high_resolution_clock::now();
+                elapsed = end - last;
+                last = end;
+                accumulator = MIN(accumulator + elapsed.count(), max_steps * step);
+
+                if (accumulator < step)
+                {
+                    sim_sleep(step - accumulator, u->params.permit_spin_sleep);
+                    continue;
+                }
+                num_steps = (int32_t)(accumulator / step);
+                accumulator -= num_steps * step;
+            }
+
+            for (int32_t i = 0; (i < num_steps) && u->running; i++)
+            {
+                start = std::chrono::high_resolution_clock::now();
+                u->tick_metrics = u->tick(u->rate * step);
+                end = std::chrono::high_resolution_clock::now();
+
+                elapsed = end - start;
+                u->phys_frametime = elapsed.count();
+                // Ticks that are run to catch up don't wait on the clock, so this is how long
+                // the physics took, as with non-realtime simulations.
+                u->wall_frametime = u->phys_frametime;
+                u->game_frametime = step;
+                u->total_time += u->rate * step;
+                u->num_ticks++;
+            }
+        }
+
+        return NULL;
+    }
+
     void *sim(void *uV)
     {
-        fprintf(stderr, "Universe (%p) physics sim thread PID: %u\n", uV, get_this_thread_pid());
         Universe *u = (Universe *)uV;
+        if (u->params.fixed_timestep > 0.0)
+        {
+            return sim_fixed(uV);
+        }
+
+        fprintf(stderr, "Universe (%p) physics sim thread PID: %u\n", uV, get_this_thread_pid());
 
         // dt is the amount of time that will pass in the game world during the next tick.
         double dt = u->min_frametime;
@@ -212,22 +421,7 @@ namespace Diana
             // interval we can represent with std::chrono.
             while (u->realtime && ((u->min_frametime - e) > dt_cutoff))
             {
-                // C++11 sleep_for is guaranteed to sleep for AT LEAST as long as requested.
-                //
-                // In practice, a 1ms min frame time actually causes the average
-                // frame tiem to be about 2ms (Tested on Windows 8 and Ubuntu in
-                // a VBox VM).
-                int32_t sleep_duration_us = (int32_t)(1000000 * (u->min_frametime - e));
-                std::chrono::microseconds sleep_duration = std::chrono::microseconds(sleep_duration_us);
-
-                if (u->params.permit_spin_sleep && (sleep_duration_us < SPIN_SLEEP_MAX_US))
-                {
-                    spin_sleep_for(sleep_duration);
-                }
-                else
-                {
-                    std::this_thread::sleep_for(sleep_duration);
-                }
+                sim_sleep(u->min_frametime - e, u->params.permit_spin_sleep);
 
                 end = std::chrono::high_resolution_clock::now();
                 elapsed = end - start;
@@ -335,6 +529,11 @@ namespace Diana
         this->min_vis_frametime = _params.min_vis_frametime;
         this->start = std::chrono::high_resolution_clock::now();
 
+        if ((_params.integrator < INTEGRATOR_EULER) || (_params.integrator > INTEGRATOR_FOREST_RUTH))
+        {
+            throw std::runtime_error("Universe::UnknownIntegrator");
+        }
+
         if (realtime && (min_frametime < ABSOLUTE_MIN_FRAMETIME))
         {
             fprintf(stderr, "WARNING: min_framtime set below absolute minimum. Raising it to %g s.\n", ABSOLUTE_MIN_FRAMETIME);
@@ -342,20 +541,36 @@ namespace Diana
             max_frametime = MAX(max_frametime, ABSOLUTE_MIN_FRAMETIME);
         }
 
-        this->num_threads = _params.num_worker_threads;
-        // sched = new libodb::Scheduler(this->num_threads - 1);
+        // There's always at least the sim thread doing the work.
+        this->num_threads = MAX(1, _params.num_worker_threads);
+        this->workers = new WorkerPool(this->num_threads);
 
-        this->phys_worker_args = new struct phys_args[this->num_threads]; //(struct phys_args *)malloc(this->num_threads * sizeof(struct phys_args));
+        this->phys_worker_args = new struct phys_args[this->num_threads + 1];
 
-        for (int i = 0; i < this->num_threads; i++)
+        for (int i = 0; i <= this->num_threads; i++)
         {
             phys_worker_args[i].u = this;
             phys_worker_args[i].offset = i;
             phys_worker_args[i].stride = this->num_threads;
             phys_worker_args[i].dt = 0.0;
-            phys_worker_args[i].done = true;
+            phys_worker_args[i].obj = NULL;
+            phys_worker_args[i].island = NULL;
+            SweepBatch_init(&phys_worker_args[i].batch);
+            phys_worker_args[i].huge = (i == this->num_threads);
         }
 
+        this->sweep_axis = 0;
+        this->beam_axis = 0;
+        this->num_sorted = 0;
+        this->num_presorted = 0;
+        this->max_sorted_extent = 0.0;
+        this->broadphase = BroadPhase_create(_params.collision_broadphase, _params.collision_grid_cell_size, _params.collision_tree_margin, _params.collision_tree_lookahead);
+        AttractorSet_init(&this->attractor_set);
+        this->gravity_tree = (_params.gravity_opening_angle > 0.0 ? new BarnesHutTree(_params.gravity_opening_angle) : NULL);
+        AttractorSet_init(&this->attractor_start);
+        this->step_stages.resize(CLAMP(0, _params.timestep_levels, TIMESTEP_MAX_LEVELS) + 1);
+        this->forest_ruth_stages.resize(this->step_stages.size());
+
         total_time = 0.0;
         last_effect_time = 0.0;
         phys_frametime = 0.0;
@@ -376,17 +591,26 @@ namespace Diana
 
     Universe::~Universe()
     {
-        for (int i = 0; i < num_threads; i++)
-        {
-            phys_worker_args[i].done = false;
-        }
-
-        // sched->block_until_done();
-        free(phys_worker_args);
-
         stop_net();
         stop_sim();
-        // delete sched;
+
+        // The sim thread is the only one that hands work to the pool, so once it has stopped
+        // the workers are idle and can be torn down.
+        delete workers;
+        delete[] phys_worker_args;
+        delete broadphase;
+        delete gravity_tree;
+        for (size_t level = 0; level < step_stages.size(); level++)
+        {
+            for (size_t i = 0; i < step_stages[level].size(); i++)
+            {
+                delete step_stages[level][i].tree;
+            }
+            for (size_t i = 0; i < forest_ruth_stages[level].size(); i++)
+            {
+                delete forest_ruth_stages[level][i].tree;
+            }
+        }
     }
 
     void Universe::start_net()
@@ -596,10 +820,7 @@ namespace Diana
                     continue;
                 }
 
-                visdata_msg.orientation.w = o->forward.x;
-                visdata_msg.orientation.x = o->forward.y;
-                visdata_msg.orientation.y = o->up.x;
-                visdata_msg.orientation.z = o->up.y;
+                PhysicsObject_get_orientation(o, &visdata_msg.orientation);
                 int64_t nbytes = visdata_msg.send(vc.socket);
                 client_nbytes += nbytes;
 
@@ -741,6 +962,14 @@ namespace Diana
                         LOCK(add_lock);
                         LOCK(expire_lock);
                         update_list(&smarty->pobj, &attractors, newval, smarty->pobj.emits_gravity);
+                        if (newval)
+                        {
+                            AttractorSet_add(&attractor_set, &smarty->pobj);
+                        }
+                        else
+                        {
+                            AttractorSet_remove(&attractor_set, smarty->pobj.phys_id);
+                        }
                         UNLOCK(add_lock);
                         UNLOCK(expire_lock);
                         smarty->pobj.emits_gravity = newval;
@@ -765,6 +994,16 @@ namespace Diana
 #undef ASSIGN_V3
 #undef ASSIGN_VAL
 
+                // Whatever the client changed, the object isn't sitting still any more.
+                PhysicsObject_wake(&smarty->pobj);
+
+                // Gravity extrapolated from where the object was has nothing to do with where it is now.
+                if (msg->specced[4] || msg->specced[5] || msg->specced[6])
+                {
+                    smarty->pobj.grav_cached = false;
+                    smarty->pobj.last_accel_time = -INFINITY;
+                }
+
                 if (this->params.verbose_logging)
                 {
                     fprintf(stderr,
@@ -1251,238 +1490,1495 @@ namespace Diana
         delete msg_base;
     }
 
-    void Universe::get_grav_pull(V3 *g, PO *obj)
+    void Universe::refresh_gravity()
     {
-        V3 cg;
-        for (size_t i = 0; i < attractors.size(); i++)
+        AttractorSet_refresh(&attractor_set);
+        if (gravity_tree != NULL)
         {
-            // An object can't attract itself.
-            if (attractors[i]->phys_id == obj->phys_id)
-            {
-                continue;
-            }
-
-            gravity(params.gravitational_constant, &cg, attractors[i], obj);
-            Vector3_add(g, &cg);
+            gravity_tree->build(&attractor_set);
         }
     }
 
-    bool check_collision_single(Universe *u, struct PhysicsObject *obj1, struct PhysicsObject *obj2, double dt, struct Universe::PhysCollisionEvent &ev)
+    void Universe::tick_attractors(double dt, struct TickMetrics &metrics)
     {
-        struct PhysCollisionResult phys_result;
-
-        // Return from a phys-phys collision is
-        //    [t, [e1, e2], [obj1  collision data], [obj2 collision data]]
-        // t is in [0,1] and indicates when in the interval the collision happened
-        // energy is obvious.
-        // d1 is the direction obj2 was travelling relative to obj1 whe they collided
-        // p1 is a vector from obj1's position to the collision sport on its bounding ball.
-        // Note that dt here is the remainder of the interval
-        PhysicsObject_collide(&phys_result, obj1, obj2, dt);
+        std::vector<PO *> &objs = attractor_set.objs;
+        size_t n = objs.size();
+        attractor_accel.resize(n);
+
+        // The attractors all pull on each other, so they share one step, which is the finest that
+        // any of them needs.
+        int32_t level = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            level = std::max(level, (int32_t)objs[i]->timestep_level);
+        }
 
-        // We need to make sure that this is in the 'future' of both objects, so we should test it against the
-        // 't' component of both.
-        // Recall that the object's 't' component is in real-time seconds, so compare with the real-time seconds
-        // that the collision happened at. Ensure that the time of the collision is within the time
-        // remaining in the tick of each of the objects.
-        if ((phys_result.t >= 0) &&
-            (phys_result.t * dt <= (dt - obj1->t)) &&
-            (phys_result.t * dt <= (dt - obj2->t)))
+        // Collision handling has already moved each object through the first t of the tick at
+        // its new velocity. Backing it up to where it would have been at the start of the tick
+        // at that velocity lets every attractor be moved through the whole of the tick.
+        for (size_t i = 0; i < n; i++)
         {
-            // By comparing the energy to a cutoff, this will help prevent
-            // spurious collision notifications due to physics time step
-            // increments and temporary object intersection.
+            Vector3_fmad(&objs[i]->position, -objs[i]->t, &objs[i]->velocity);
+            objs[i]->t = 0.0;
+        }
 
-            // Total energy involved. Both objects 'absorb' the same amount
-            // of energy from an 'impact effect' perspective, and that is in
-            // the 'e' field of the collision result.
+        // Everything else interpolates where the attractors were during the tick from here.
+        attractor_start.objs = objs;
+        AttractorSet_refresh(&attractor_start);
 
-            if ((phys_result.e < -u->params.collision_energy_cutoff) ||
-                (phys_result.e > u->params.collision_energy_cutoff))
+        // If the step turns out to be too coarse, the tick is done again from here with a finer one.
+        bool adaptive = (level < (int32_t)step_stages.size() - 1);
+        if (adaptive)
+        {
+            attractor_saved.resize(n);
+            for (size_t i = 0; i < n; i++)
             {
-                ev.obj1 = obj1;
-                ev.obj2 = obj2;
-                ev.pcr = phys_result;
-                return true;
+                attractor_saved[i] = *objs[i];
             }
         }
 
-        return false;
-    }
+        while (true)
+        {
+            step_attractors(std::max(params.gravity_attractor_substeps, (int32_t)1 << level), dt);
 
-    struct Universe::CollisionMetrics check_collision_loop(void *argsV)
-    {
-        struct Universe::phys_args *args = (struct Universe::phys_args *)argsV;
-        Universe *u = args->u;
+            int32_t required = 0;
+            for (size_t i = 0; i < n; i++)
+            {
+                required = std::max(required, required_timestep_level(attractor_rates[i], dt));
+            }
+            if (!adaptive || (required <= level))
+            {
+                break;
+            }
 
-        struct Universe::CollisionMetrics metrics;
-        HRN_T(t0);
-        t0 = HRN;
-        HRN_T(aabb0);
-        HRN_T(sphere0);
+            level = required;
+            for (size_t i = 0; i < n; i++)
+            {
+                *objs[i] = attractor_saved[i];
+            }
+        }
+        metrics.max_timestep_level = std::max(metrics.max_timestep_level, (uint64_t)level);
 
-        struct AABB *a;
-        struct AABB *b;
+        for (size_t i = 0; i < n; i++)
+        {
+            PhysicsObject_rotate(objs[i], dt);
+            // Only take the step back up one level per tick, so that an attractor which passes
+            // through a brief lull doesn't bounce between levels.
+            int32_t own = required_timestep_level(attractor_rates[i], dt);
+            objs[i]->timestep_level = (int8_t)std::max(own, objs[i]->timestep_level - 1);
+        }
 
-        size_t end = args->offset + args->stride;
-        end = MIN(end, u->phys_objects.size() - 1);
+        // This also moves the objects on rails that aren't attractors.
+        move_rails(total_time + dt);
+        refresh_gravity();
+    }
 
-        for (size_t i = args->offset; i < end; i++)
+    void Universe::step_attractors(int32_t num_substeps, double dt)
+    {
+        std::vector<PO *> &objs = attractor_set.objs;
+        size_t n = objs.size();
+        double h = dt / num_substeps;
+        const struct SplittingScheme *scheme = (params.integrator == INTEGRATOR_FOREST_RUTH ? &forest_ruth_scheme : &leapfrog_scheme);
+        attractor_rates.assign(n, -1.0);
+
+        // Attractors on rails are only moved by their rails, which put them where they should be
+        // each time that gravity is worked out.
+        // Both schemes are symplectic, so they keep energy bounded over long runs. Leapfrog is
+        // second order and needs one round of gravity per substep, and Forest-Ruth is fourth
+        // order and needs three.
+        for (int32_t s = 0; s < num_substeps; s++)
         {
-            // In order for a full intersection to be possible, there has to be intersection
-            // of the AABBs in all three dimensions.
-            //
-            // AABBs sorted by their lowest coordinate in the X dimensions.
-            // We can test for potential intersections, first pruning by intersection along
-            // the X axis.
-            //
-            // First test to see if the X projections intersect. If they do, then test the others.
-
-            a = &u->phys_objects[i]->box;
-            for (size_t j = (args->test_all ? 0 : i + 1); j < u->phys_objects.size(); j++)
+            double c = 0.0;
+            for (int32_t k = 0; k <= scheme->num_kicks; k++)
             {
-                aabb0 = HRN;
-
-                // Don't collide objects with themselves.
-                if (i == j)
+                for (size_t i = 0; i < n; i++)
                 {
-                    continue;
+                    if (objs[i]->rails == NULL)
+                    {
+                        Vector3_fmad(&objs[i]->position, scheme->drift[k] * h, &objs[i]->velocity);
+                    }
                 }
+                c += scheme->drift[k];
 
-                b = &u->phys_objects[j]->box;
-
-                double d;
-                d = a->u.x - b->l.x;
-
-                // This is to text if they intersect/touch in X
-                // It's simpler here, because we have a guarantee (thanks to sorting)
-                // about the relative positions of the lower endpoints of the intervals so
-                // we don't need to worry about those here.
-                metrics.primary_aabb_tests++;
-                if (Vector3_almost_zeroS(d) || (d > 0))
+                if (k == scheme->num_kicks)
                 {
-                    // Now do a full test on the Y axis.
-                    metrics.secondary_aabb_tests++;
-                    if (!Vector3_intersect_interval(a->l.y, a->u.y, b->l.y, b->u.y))
-                    {
-                        continue;
-                    }
+                    break;
+                }
 
-                    // And then a full test on Z
-                    metrics.secondary_aabb_tests++;
-                    if (!Vector3_intersect_interval(a->l.z, a->u.z, b->l.z, b->u.z))
+                // Each attractor's pull only reads the mirror, so they can all be worked out at once.
+                double time = total_time + (s + c) * h;
+                move_rails(time);
+                refresh_gravity();
+                workers->run(n, [this, &objs, time](size_t i)
+                             {
+                                 if (objs[i]->rails != NULL)
+                                 {
+                                     attractor_rates[i] = 0.0;
+                                     return;
+                                 }
+                                 V3 g = {0.0, 0.0, 0.0};
+                                 get_grav_pull(&g, objs[i]);
+                                 Vector3_scale(&attractor_accel[i], &g, 1.0 / objs[i]->mass);
+                                 note_accel(objs[i], &attractor_accel[i], time, &attractor_rates[i]);
+                                 Vector3_fmad(&attractor_accel[i], 1.0 / objs[i]->mass, &objs[i]->thrust); });
+                workers->join();
+
+                for (size_t i = 0; i < n; i++)
+                {
+                    if (objs[i]->rails == NULL)
                     {
-                        continue;
+                        Vector3_fmad(&objs[i]->velocity, scheme->kick[k] * h, &attractor_accel[i]);
                     }
+                }
+            }
+        }
+    }
 
-                    metrics.aabb_test_ns += HRN - aabb0;
+    void Universe::tick_particles(double dt, struct TickMetrics &metrics)
+    {
+        // Hand the objects out in blocks, so that claiming work doesn't cost more than doing it.
+        // Each block counts its own evaluations, so that the blocks never contend for a counter.
+        const size_t block = 64;
+        uint64_t built_step_levels = 0;
+        uint64_t built_forest_ruth_levels = 0;
+
+        // Objects whose step turns out to be too coarse are done again with a finer one, after
+        // everything else, until every object has taken a step that's fine enough.
+        std::vector<PO *> *pending = &phys_objects;
+        while (pending->size() > 0)
+        {
+            // Working out where the attractors were part way through the tick is only worth it
+            // for the timestep levels and integrators that something is going to use.
+            uint64_t step_levels = 0;
+            uint64_t forest_ruth_levels = 0;
+            for (size_t i = 0; i < pending->size(); i++)
+            {
+                PO *o = (*pending)[i];
+                if (o->emits_gravity || (o->rails != NULL) || (o->asleep && !sleep_check_due(o, attractor_set.changed)))
+                {
+                    continue;
+                }
 
-                    // If we succeeded on both, count this as a potential collision for
-                    // honest-to-goodness testing and hand it off to bounding-ball testing
-                    // followed by collision effect calculation.
-                    struct Universe::PhysCollisionEvent ev;
-                    metrics.sphere_tests++;
-                    sphere0 = HRN;
-                    if (check_collision_single(u, u->phys_objects[i], u->phys_objects[j], args->dt, ev))
-                    {
-                        ev.obj1_index = i;
-                        ev.obj2_index = j;
-                        LOCK(u->collision_lock);
-                        u->collisions.push_back(ev);
-                        UNLOCK(u->collision_lock);
-                        metrics.collisions++;
-                    }
-                    metrics.sphere_test_ns += HRN - sphere0;
+                int32_t integrator = (o->integrator == INTEGRATOR_UNIVERSE ? params.integrator : o->integrator);
+                if (integrator == INTEGRATOR_FOREST_RUTH)
+                {
+                    forest_ruth_levels |= (uint64_t)1 << o->timestep_level;
                 }
-                else
+                else if (o->timestep_level > 0)
                 {
-                    metrics.aabb_test_ns += HRN - aabb0;
+                    step_levels |= (uint64_t)1 << o->timestep_level;
+                }
+            }
 
-                    // If we fail that X comparison, we know that we will fail for every object
-                    // 'after', so we can bail on the loop.
-                    break;
+            for (int32_t level = 0; level < (int32_t)step_stages.size(); level++)
+            {
+                uint64_t bit = (uint64_t)1 << level;
+                if ((step_levels & ~built_step_levels) & bit)
+                {
+                    build_gravity_stages(step_stages[level], level, false, dt);
+                }
+                if ((forest_ruth_levels & ~built_forest_ruth_levels) & bit)
+                {
+                    build_gravity_stages(forest_ruth_stages[level], level, true, dt);
                 }
             }
+            built_step_levels |= step_levels;
+            built_forest_ruth_levels |= forest_ruth_levels;
+
+            size_t num_blocks = (pending->size() + block - 1) / block;
+            particle_evaluations.assign(num_blocks, 0);
+            particle_extrapolations.assign(num_blocks, 0);
+            particle_levels.assign(num_blocks, 0);
+            particle_retries.resize(num_blocks);
+            workers->run(num_blocks, [this, dt, block, pending](size_t b)
+                         {
+                             particle_retries[b].clear();
+                             size_t end = std::min((b + 1) * block, pending->size());
+                             for (size_t i = b * block; i < end; i++)
+                             {
+                                 PO *o = (*pending)[i];
+                                 if (o->emits_gravity)
+                                 {
+                                     continue;
+                                 }
+
+                                 // Objects on rails have already been moved along them.
+                                 if (o->rails != NULL)
+                                 {
+                                     PhysicsObject_rotate(o, dt);
+                                     continue;
+                                 }
+
+                                 if (o->asleep && !gravity_disturbs(o, &particle_evaluations[b]))
+                                 {
+                                     continue;
+                                 }
+
+                                 int32_t integrator = (o->integrator == INTEGRATOR_UNIVERSE ? params.integrator : o->integrator);
+                                 int32_t level = o->timestep_level;
+                                 if (integrate_particle(o, integrator, dt, &particle_evaluations[b], &particle_extrapolations[b]))
+                                 {
+                                     particle_levels[b] = std::max(particle_levels[b], (uint64_t)level);
+                                     update_sleep(o, dt);
+                                 }
+                                 else
+                                 {
+                                     particle_retries[b].push_back(o);
+                                 }
+                             } });
+            workers->join();
+
+            retry_objects.clear();
+            for (size_t b = 0; b < num_blocks; b++)
+            {
+                metrics.num_gravity_evaluations += particle_evaluations[b];
+                metrics.num_gravity_extrapolations += particle_extrapolations[b];
+                metrics.max_timestep_level = std::max(metrics.max_timestep_level, particle_levels[b]);
+                retry_objects.insert(retry_objects.end(), particle_retries[b].begin(), particle_retries[b].end());
+            }
+            pending = &retry_objects;
         }
 
-        metrics.total_ns = HRN - t0;
-        return metrics;
+        // Whatever was cached before an attractor came or went has now been worked out again.
+        attractor_set.changed = false;
     }
 
-    void *thread_check_collisions(void *argsV)
+    void Universe::build_gravity_stages(std::vector<struct GravityStage> &stages, int32_t level, bool forest_ruth, double dt)
     {
-        struct Universe::phys_args *args = (struct Universe::phys_args *)argsV;
-
-        // Spin until we get the signal to start going.
-        // The universe will flip this after the next workload is ready to go.
-        while (args->done)
+        int32_t num_substeps = 1 << level;
+        // The end of the last substep is where the attractors are now, which doesn't need a stage.
+        size_t num_stages = (forest_ruth ? forest_ruth_scheme.num_kicks * num_substeps : num_substeps - 1);
+        while (stages.size() < num_stages)
         {
+            stages.push_back(GravityStage());
+            AttractorSet_init(&stages.back().set);
+            stages.back().tree = (gravity_tree != NULL ? new BarnesHutTree(params.gravity_opening_angle) : NULL);
         }
 
-        check_collision_loop(argsV);
+        for (size_t i = 0; i < num_stages; i++)
+        {
+            double s;
+            if (forest_ruth)
+            {
+                int32_t k = i % forest_ruth_scheme.num_kicks;
+                s = 0.0;
+                for (int32_t j = 0; j <= k; j++)
+                {
+                    s += forest_ruth_scheme.drift[j];
+                }
+                s = (i / forest_ruth_scheme.num_kicks + s) / num_substeps;
+            }
+            else
+            {
+                s = (double)(i + 1) / num_substeps;
+            }
 
-        // Indicate that we're done, and spin until we get the signal to stop.
-        // The universe will flip this after the next workload is ready to go.
-        args->done = true;
-        while (args->done)
+            AttractorSet_interpolate(&stages[i].set, &attractor_start, &attractor_set, s, dt);
+            if (stages[i].tree != NULL)
+            {
+                stages[i].tree->build(&stages[i].set);
+            }
+        }
+    }
+
+    void Universe::get_stage_grav_pull(V3 *g, PO *obj, int32_t level, int32_t substep)
+    {
+        if (substep == (1 << level) - 1)
         {
+            get_grav_pull(g, obj);
+            return;
         }
 
-        return NULL;
+        struct GravityStage *stage = &step_stages[level][substep];
+        get_grav_pull(g, obj, &stage->set, stage->tree);
+    }
+
+    bool Universe::integrate_particle(PO *obj, int32_t scheme, double dt, size_t *evaluations, size_t *extrapolations)
+    {
+        int32_t level = obj->timestep_level;
+        int32_t num_substeps = 1 << level;
+        double h = dt / num_substeps;
+        double rate = -1.0;
+        V3 g = {0.0, 0.0, 0.0};
+        V3 a;
+
+        // If the step turns out to be too coarse, the object is put back how it was to be done
+        // again with a finer one.
+        bool adaptive = (level < (int32_t)step_stages.size() - 1);
+        struct PhysicsObject saved;
+        if (adaptive)
+        {
+            saved = *obj;
+        }
+
+        // Unless it's taking the whole tick in one step, start from where the object would have
+        // been at the start of the tick at the velocity that collisions have left it with, as
+        // with the attractors.
+        if ((level > 0) || (scheme != INTEGRATOR_EULER))
+        {
+            PhysicsObject_drift(obj, -obj->t);
+            obj->t = 0.0;
+        }
+
+        switch (scheme)
+        {
+        case INTEGRATOR_VERLET:
+        {
+            // The acceleration at the end of the last tick is the one at the start of this one,
+            // unless the object skipped a tick or the attractors have changed since.
+            a = obj->last_accel;
+            if ((fabs(obj->last_accel_time - total_time) > 1e-6 * dt) || attractor_set.changed)
+            {
+                get_grav_pull(&g, obj, &attractor_start, NULL);
+                Vector3_scale(&a, &g, 1.0 / obj->mass);
+                note_accel(obj, &a, total_time, &rate);
+                (*evaluations)++;
+            }
+
+            for (int32_t s = 0; s < num_substeps; s++)
+            {
+                PhysicsObject_kick(obj, &a, 0.5 * h);
+                PhysicsObject_drift(obj, h);
+
+                g = vector3d_zero;
+                if (level > 0)
+                {
+                    get_stage_grav_pull(&g, obj, level, s);
+                    (*evaluations)++;
+                }
+                else if (get_particle_grav_pull(&g, obj, total_time + dt, dt))
+                {
+                    (*evaluations)++;
+                }
+                else
+                {
+                    (*extrapolations)++;
+                }
+                Vector3_scale(&a, &g, 1.0 / obj->mass);
+                note_accel(obj, &a, total_time + (s + 1) * h, &rate);
+                PhysicsObject_kick(obj, &a, 0.5 * h);
+            }
+            PhysicsObject_rotate(obj, dt);
+            break;
+        }
+        case INTEGRATOR_FOREST_RUTH:
+        {
+            // Each kick is against where the attractors were at that point in the tick.
+            for (int32_t s = 0; s < num_substeps; s++)
+            {
+                double c = 0.0;
+                for (int32_t k = 0; k < forest_ruth_scheme.num_kicks; k++)
+                {
+                    PhysicsObject_drift(obj, forest_ruth_scheme.drift[k] * h);
+                    c += forest_ruth_scheme.drift[k];
+
+                    struct GravityStage *stage = &forest_ruth_stages[level][s * forest_ruth_scheme.num_kicks + k];
+                    g = vector3d_zero;
+                    get_grav_pull(&g, obj, &stage->set, stage->tree);
+                    Vector3_scale(&a, &g, 1.0 / obj->mass);
+                    note_accel(obj, &a, total_time + (s + c) * h, &rate);
+                    PhysicsObject_kick(obj, &a, forest_ruth_scheme.kick[k] * h);
+                }
+                PhysicsObject_drift(obj, forest_ruth_scheme.drift[forest_ruth_scheme.num_kicks] * h);
+            }
+            *evaluations += forest_ruth_scheme.num_kicks * num_substeps;
+            PhysicsObject_rotate(obj, dt);
+            break;
+        }
+        default:
+            // The pull for each step is from where the attractors are at the end of it, which is
+            // also when it's taken to be for the extrapolation, as it is for the other schemes.
+            for (int32_t s = 0; s < num_substeps; s++)
+            {
+                g = vector3d_zero;
+                if (level > 0)
+                {
+                    get_stage_grav_pull(&g, obj, level, s);
+                    (*evaluations)++;
+                }
+                else if (get_particle_grav_pull(&g, obj, total_time + dt, dt))
+                {
+                    (*evaluations)++;
+                }
+                else
+                {
+                    (*extrapolations)++;
+                }
+                Vector3_scale(&a, &g, 1.0 / obj->mass);
+                note_accel(obj, &a, total_time + (s + 1) * h, &rate);
+                // This also turns the object.
+                PhysicsObject_tick(obj, &g, h);
+            }
+            break;
+        }
+
+        int32_t required = required_timestep_level(rate, dt);
+        if (adaptive && (required > level))
+        {
+            *obj = saved;
+            obj->timestep_level = (int8_t)required;
+            return false;
+        }
+
+        // Only take the step back up one level per tick, so that an object which passes through a
+        // brief lull doesn't bounce between levels.
+        obj->timestep_level = (int8_t)std::max(required, level - 1);
+        return true;
+    }
+
+    int32_t Universe::required_timestep_level(double rate, double dt)
+    {
+        // With nothing to compare against, there's no telling how fast the acceleration is
+        // changing, so take at least two substeps to find out.
+        int32_t max_level = (int32_t)step_stages.size() - 1;
+        if (rate < 0.0)
+        {
+            return std::min(1, max_level);
+        }
+
+        // Halve the step until the acceleration changes by no more than the tolerance over one
+        // substep, going by how fast it was changing.
+        int32_t level = 0;
+        while ((level < max_level) && (rate * dt > params.timestep_tolerance * (1 << level)))
+        {
+            level++;
+        }
+        return level;
+    }
+
+    void Universe::update_sleep(PO *obj, double dt)
+    {
+        if (params.sleep_speed <= 0.0)
+        {
+            return;
+        }
+
+        bool still = (Vector3_length2(&obj->velocity) < params.sleep_speed * params.sleep_speed) &&
+                     (Vector3_length2(&obj->last_accel) < params.sleep_gravity * params.sleep_gravity) &&
+                     Vector3_almost_zero(&obj->thrust) && Vector3_almost_zero(&obj->ang_velocity);
+        if (!still)
+        {
+            obj->still_ticks = 0;
+            return;
+        }
+
+        obj->still_ticks++;
+        if (obj->still_ticks < SLEEP_DELAY_TICKS)
+        {
+            return;
+        }
+
+        // The object stops dead where it is, and keeps the box that it has there until it wakes.
+        obj->asleep = true;
+        obj->still_ticks = 0;
+        obj->velocity = vector3d_zero;
+        PhysicsObject_estimate_aabb(obj, &obj->box, dt);
+    }
+
+    bool Universe::gravity_disturbs(PO *obj, size_t *evaluations)
+    {
+        bool due = sleep_check_due(obj, attractor_set.changed);
+        obj->still_ticks = (obj->still_ticks + 1) % SLEEP_CHECK_TICKS;
+        if (!due)
+        {
+            return false;
+        }
+
+        V3 g = {0.0, 0.0, 0.0};
+        get_grav_pull(&g, obj);
+        (*evaluations)++;
+
+        V3 change;
+        Vector3_scale(&g, 1.0 / obj->mass);
+        Vector3_subtract(&change, &g, &obj->last_accel);
+        if (Vector3_length(&change) <= params.sleep_gravity)
+        {
+            return false;
+        }
+
+        PhysicsObject_wake(obj);
+        return true;
+    }
+
+    bool Universe::get_particle_grav_pull(V3 *g, PO *obj, double t, double dt)
+    {
+        double tolerance = params.gravity_extrapolation_tolerance;
+        if (tolerance <= 0.0)
+        {
+            get_grav_pull(g, obj);
+            return true;
+        }
+
+        // The pull is extrapolated linearly from the last full evaluation, as long as that's still
+        // good, and it's not due for another one.
+        bool cached = obj->grav_cached && !attractor_set.changed;
+        if (cached && (t < obj->grav_due))
+        {
+            *g = obj->grav_accel;
+            Vector3_fmad(g, t - obj->grav_time, &obj->grav_jerk);
+            Vector3_scale(g, obj->mass);
+            return false;
+        }
+
+        get_grav_pull(g, obj);
+        V3 accel;
+        Vector3_scale(&accel, g, 1.0 / obj->mass);
+
+        // With nothing to compare against, there's no telling how fast the pull is changing, so
+        // check again next tick.
+        double interval = dt;
+        V3 jerk = {0.0, 0.0, 0.0};
+        double elapsed = t - obj->grav_time;
+        if (cached && (elapsed > 0.0))
+        {
+            // Compare what the extrapolation would have given against the real thing. The error
+            // in a linear extrapolation grows with the square of how far ahead it reaches, which
+            // gives how far ahead the next one can reach while staying within the tolerance.
+            V3 err = obj->grav_accel;
+            Vector3_fmad(&err, elapsed, &obj->grav_jerk);
+            Vector3_subtract(&err, &err, &accel);
+            double err_len = Vector3_length(&err);
+            double allowed = tolerance * Vector3_length(&accel);
+
+            interval = (err_len > 0.0 ? elapsed * sqrt(allowed / err_len) : GRAVITY_MAX_GROWTH * elapsed);
+            interval = std::min(interval, GRAVITY_MAX_GROWTH * elapsed);
+            interval = std::min(interval, GRAVITY_MAX_TICKS * dt);
+            interval = std::max(interval, dt);
+
+            jerk = accel;
+            Vector3_subtract(&jerk, &jerk, &obj->grav_accel);
+            Vector3_scale(&jerk, 1.0 / elapsed);
+        }
+
+        obj->grav_accel = accel;
+        obj->grav_jerk = jerk;
+        obj->grav_time = t;
+        // Allow a little slack, so that an interval that's a whole number of ticks isn't pushed
+        // out to the tick after by rounding.
+        obj->grav_due = t + interval - 1e-3 * dt;
+        obj->grav_cached = true;
+        return true;
+    }
+
+    void Universe::move_rails(double time)
+    {
+        // Parents come first, so each object's parent is already where it should be.
+        for (size_t i = 0; i < railed.size(); i++)
+        {
+            PO *obj = railed[i];
+            Rails_evaluate(obj->rails, time, &obj->position, &obj->velocity);
+            obj->t = 0.0;
+        }
+    }
+
+    void Universe::add_rails(PO *obj)
+    {
+        int32_t depth = Rails_depth(obj->rails);
+        size_t i = 0;
+        while ((i < railed.size()) && (Rails_depth(railed[i]->rails) <= depth))
+        {
+            i++;
+        }
+        railed.insert(railed.begin() + i, obj);
+        Rails_evaluate(obj->rails, total_time, &obj->position, &obj->velocity);
+    }
+
+    void Universe::remove_rails(PO *obj)
+    {
+        for (size_t i = 0; i < railed.size(); i++)
+        {
+            if (railed[i] == obj)
+            {
+                railed.erase(railed.begin() + i);
+                i--;
+            }
+            else if (railed[i]->rails->parent == obj)
+            {
+                // With nothing left to be relative to, the object carries on from where it is
+                // under gravity like anything else.
+                delete railed[i]->rails;
+                railed[i]->rails = NULL;
+                railed.erase(railed.begin() + i);
+                i--;
+            }
+        }
+
+        delete obj->rails;
+        obj->rails = NULL;
+    }
+
+    void Universe::get_grav_pull(V3 *g, PO *obj)
+    {
+        get_grav_pull(g, obj, &attractor_set, gravity_tree);
+    }
+
+    void Universe::get_grav_pull(V3 *g, PO *obj, struct AttractorSet *set, BarnesHutTree *tree)
+    {
+        if (tree != NULL)
+        {
+            tree->pull(g, obj, params.gravitational_constant);
+            return;
+        }
+
+        AttractorSet_pull(set, g, obj, params.gravitational_constant);
+    }
+
+    bool check_collision_single(Universe *u, struct PhysicsObject *obj1, struct PhysicsObject *obj2, double dt, struct Universe::PhysCollisionEvent &ev)
+    {
+        struct PhysCollisionResult phys_result;
+
+        // Return from a phys-phys collision is
+        //    [t, [e1, e2], [obj1  collision data], [obj2 collision data]]
+        // t is in [0,1] and indicates when in the interval the collision happened
+        // energy is obvious.
+        // d1 is the direction obj2 was travelling relative to obj1 whe they collided
+        // p1 is a vector from obj1's position to the collision sport on its bounding ball.
+        // Note that dt here is the remainder of the interval
+        PhysicsObject_collide(&phys_result, obj1, obj2, dt);
+
+        // We need to make sure that this is in the 'future' of both objects, so we should test it against the
+        // 't' component of both.
+        // Recall that the object's 't' component is in real-time seconds, so compare with the real-time seconds
+        // that the collision happened at. Ensure that the time of the collision is within the time
+        // remaining in the tick of each of the objects.
+        if ((phys_result.t >= 0) &&
+            (phys_result.t * dt <= (dt - obj1->t)) &&
+            (phys_result.t * dt <= (dt - obj2->t)))
+        {
+            // By comparing the energy to a cutoff, this will help prevent
+            // spurious collision notifications due to physics time step
+            // increments and temporary object intersection.
+
+            // Total energy involved. Both objects 'absorb' the same amount
+            // of energy from an 'impact effect' perspective, and that is in
+            // the 'e' field of the collision result.
+
+            if ((phys_result.e < -u->params.collision_energy_cutoff) ||
+                (phys_result.e > u->params.collision_energy_cutoff))
+            {
+                ev.obj1 = obj1;
+                ev.obj2 = obj2;
+                ev.generation1 = obj1->generation;
+                ev.generation2 = obj2->generation;
+                ev.pcr = phys_result;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    struct Universe::CollisionMetrics check_collision_loop(void *argsV)
+    {
+        struct Universe::phys_args *args = (struct Universe::phys_args *)argsV;
+        Universe *u = args->u;
+
+        struct Universe::CollisionMetrics metrics;
+        HRN_T(t0);
+        t0 = HRN;
+        HRN_T(aabb0);
+
+        struct AABB *a;
+        struct AABB *b;
+
+        // Sweep along the axis that the list is sorted on, and test the other two in full.
+        int32_t d0 = u->sweep_axis;
+        int32_t d1 = (d0 + 1) % 3;
+        int32_t d2 = (d0 + 2) % 3;
+
+        size_t end = args->offset + args->stride;
+        end = MIN(end, (u->num_sorted > 0 ? u->num_sorted - 1 : 0));
+
+        for (size_t i = args->offset; i < end; i++)
+        {
+            // In order for a full intersection to be possible, there has to be intersection
+            // of the AABBs in all three dimensions.
+            //
+            // AABBs sorted by their lowest coordinate along the sweep axis.
+            // We can test for potential intersections, first pruning by intersection along
+            // that axis.
+            //
+            // First test to see if the projections on the sweep axis intersect. If they do, then
+            // test the others.
+
+            a = &u->phys_objects[i]->box;
+            for (size_t j = i + 1; j < u->num_sorted; j++)
+            {
+                aabb0 = HRN;
+                b = &u->phys_objects[j]->box;
+
+                double d;
+                d = AABB_U(*a, d0) - AABB_L(*b, d0);
+
+                // This is to text if they intersect/touch along the sweep axis.
+                // It's simpler here, because we have a guarantee (thanks to sorting)
+                // about the relative positions of the lower endpoints of the intervals so
+                // we don't need to worry about those here.
+                metrics.primary_aabb_tests++;
+                metrics.axis_tests[d0]++;
+                if (Vector3_almost_zeroS(d) || (d > 0))
+                {
+                    // Now do a full test on the next axis.
+                    metrics.secondary_aabb_tests++;
+                    if (!Vector3_intersect_interval(AABB_L(*a, d1), AABB_U(*a, d1), AABB_L(*b, d1), AABB_U(*b, d1)))
+                    {
+                        continue;
+                    }
+
+                    // And then a full test on the last one.
+                    metrics.secondary_aabb_tests++;
+                    if (!Vector3_intersect_interval(AABB_L(*a, d2), AABB_U(*a, d2), AABB_L(*b, d2), AABB_U(*b, d2)))
+                    {
+                        continue;
+                    }
+
+                    metrics.aabb_test_ns += HRN - aabb0;
+
+                    // If we succeeded on both, count this as a potential collision for
+                    // honest-to-goodness testing and hand it off to bounding-ball testing
+                    // followed by collision effect calculation. Those are done in batches.
+                    if (!sleepers_can_collide(u->phys_objects[i], u->phys_objects[j], args->wakes))
+                    {
+                        continue;
+                    }
+                    SweepBatch_add(&args->batch, u->phys_objects[i], u->phys_objects[j], args->dt);
+                    if (args->batch.size >= SWEEP_BATCH_SIZE)
+                    {
+                        check_collision_batch(args, metrics);
+                    }
+                }
+                else
+                {
+                    metrics.aabb_test_ns += HRN - aabb0;
+
+                    // If we fail that comparison, we know that we will fail for every object
+                    // 'after', so we can bail on the loop.
+                    break;
+                }
+            }
+        }
+        check_collision_batch(args, metrics);
+
+        metrics.total_ns = HRN - t0;
+        return metrics;
+    }
+
+    // Run the narrow-phase over the pairs gathered in a worker's batch, and empty it. Pairs that
+    // pass the batched test get the full test, and any collisions are recorded in the worker's list,
+    // in the same order that the pairs were added in.
+    void check_collision_batch(void *argsV, struct Universe::CollisionMetrics &metrics)
+    {
+        struct Universe::phys_args *args = (struct Universe::phys_args *)argsV;
+        struct SweepBatch *batch = &args->batch;
+        if (batch->size == 0)
+        {
+            return;
+        }
+
+        HRN_T(sphere0);
+        sphere0 = HRN;
+        metrics.sphere_tests += batch->size;
+
+        if (SweepBatch_test(batch) > 0)
+        {
+            for (size_t i = 0; i < batch->size; i++)
+            {
+                struct Universe::PhysCollisionEvent ev;
+                if (batch->hit[i] && check_collision_single(args->u, batch->obj1[i], batch->obj2[i], args->dt, ev))
+                {
+                    args->collisions.push_back(ev);
+                    metrics.collisions++;
+                }
+            }
+        }
+
+        SweepBatch_clear(batch);
+        metrics.sphere_test_ns += HRN - sphere0;
+    }
+
+    struct Universe::CollisionMetrics check_collision_pairs(void *argsV)
+    {
+        struct Universe::phys_args *args = (struct Universe::phys_args *)argsV;
+        Universe *u = args->u;
+
+        struct Universe::CollisionMetrics metrics;
+        HRN_T(t0);
+        t0 = HRN;
+
+        size_t end = MIN(args->offset + args->stride, u->candidate_pairs.size());
+
+        // The broad-phase structure has already made sure that the boxes of these pairs
+        // overlap, so they go straight to bounding-ball testing, a batch at a time.
+        for (size_t i = args->offset; i < end; i++)
+        {
+            struct BroadPhasePair &pair = u->candidate_pairs[i];
+            if (!sleepers_can_collide(pair.obj1, pair.obj2, args->wakes))
+            {
+                continue;
+            }
+            SweepBatch_add(&args->batch, pair.obj1, pair.obj2, args->dt);
+            if (args->batch.size >= SWEEP_BATCH_SIZE)
+            {
+                check_collision_batch(args, metrics);
+            }
+        }
+        check_collision_batch(args, metrics);
+
+        metrics.total_ns = HRN - t0;
+        return metrics;
+    }
+
+    // Test a pair of objects for overlapping boxes, and if they do, then for a collision,
+    // recording it in the worker's list.
+    void check_collision_boxes(void *argsV, struct PhysicsObject *obj1, struct PhysicsObject *obj2, struct Universe::CollisionMetrics &metrics)
+    {
+        struct Universe::phys_args *args = (struct Universe::phys_args *)argsV;
+        HRN_T(aabb0);
+        HRN_T(sphere0);
+        aabb0 = HRN;
+
+        struct AABB *a = &obj1->box;
+        struct AABB *b = &obj2->box;
+
+        metrics.primary_aabb_tests++;
+        if (!Vector3_intersect_interval(a->l.x, a->u.x, b->l.x, b->u.x))
+        {
+            metrics.aabb_test_ns += HRN - aabb0;
+            return;
+        }
+
+        metrics.secondary_aabb_tests++;
+        if (!Vector3_intersect_interval(a->l.y, a->u.y, b->l.y, b->u.y))
+        {
+            return;
+        }
+
+        metrics.secondary_aabb_tests++;
+        if (!Vector3_intersect_interval(a->l.z, a->u.z, b->l.z, b->u.z))
+        {
+            return;
+        }
+
+        metrics.aabb_test_ns += HRN - aabb0;
+
+        if (!sleepers_can_collide(obj1, obj2, args->wakes))
+        {
+            return;
+        }
+
+        struct Universe::PhysCollisionEvent ev;
+        metrics.sphere_tests++;
+        sphere0 = HRN;
+        if (check_collision_single(args->u, obj1, obj2, args->dt, ev))
+        {
+            args->collisions.push_back(ev);
+            metrics.collisions++;
+        }
+        metrics.sphere_test_ns += HRN - sphere0;
+    }
+
+    // Whether two boxes overlap, or touch, on all three axes.
+    static bool aabb_overlap(const struct AABB *a, const struct AABB *b)
+    {
+        return Vector3_intersect_interval(a->l.x, a->u.x, b->l.x, b->u.x) &&
+               Vector3_intersect_interval(a->l.y, a->u.y, b->l.y, b->u.y) &&
+               Vector3_intersect_interval(a->l.z, a->u.z, b->l.z, b->u.z);
+    }
+
+    // Re-test an object that was just resolved in an island against one of its neighbours.
+    //
+    // Other islands may be resolving at the same time, so the only objects that it's safe to
+    // look at directly are those in this island, and those that aren't in any island. Objects
+    // in other islands are only compared using their boxes from when the islands started,
+    // passed in as box (or NULL when those are already known to overlap), and anything that
+    // might collide with them is left for later.
+    void check_collision_neighbour(void *argsV, struct PhysicsObject *o, const struct AABB *box, struct Universe::CollisionMetrics &metrics)
+    {
+        struct Universe::phys_args *args = (struct Universe::phys_args *)argsV;
+        Universe *u = args->u;
+        struct Universe::CollisionIsland *island = args->island;
+
+        // Objects already resolved in this island are re-tested from the island's own list.
+        if (island->resolved_rounds.count(o) > 0)
+        {
+            return;
+        }
+
+        std::unordered_map<struct PhysicsObject *, int32_t>::iterator it = u->island_of.find(o);
+        if ((it == u->island_of.end()) && (u->islands.size() == 1))
+        {
+            // With only one island there's nobody else to get in the way of, so it can take in
+            // whatever it runs into.
+            check_collision_boxes(args, args->obj, o, metrics);
+        }
+        else if (it == u->island_of.end())
+        {
+            // Nobody touches objects outside of every island until the islands have all stopped,
+            // so any collision with one has to wait until then.
+            size_t n = args->collisions.size();
+            check_collision_boxes(args, args->obj, o, metrics);
+            if (args->collisions.size() > n)
+            {
+                args->collisions.pop_back();
+                island->boundary.push_back({args->obj, o});
+            }
+        }
+        else if (it->second != island->id)
+        {
+            if ((box == NULL) || aabb_overlap(&args->obj->box, box))
+            {
+                island->boundary.push_back({args->obj, o});
+            }
+        }
+        else
+        {
+            check_collision_boxes(args, args->obj, o, metrics);
+        }
+    }
+
+    struct Universe::CollisionMetrics check_collision_object(void *argsV)
+    {
+        struct Universe::phys_args *args = (struct Universe::phys_args *)argsV;
+        Universe *u = args->u;
+        struct Universe::CollisionIsland *island = args->island;
+
+        struct Universe::CollisionMetrics metrics;
+        HRN_T(t0);
+        t0 = HRN;
+
+        struct PhysicsObject *obj = args->obj;
+        struct Universe::resolved_object &self = island->resolved_rounds[obj];
+
+        // Objects that haven't been resolved in this tick still have the same boxes they had
+        // when the broad-phase last looked at them, so only the nearby ones need a test.
+        if (u->broadphase == NULL)
+        {
+            // No sorted box is wider than max_sorted_extent, so anything that overlaps this one
+            // started somewhere in [l - max_sorted_extent, u] along the sweep axis when the list
+            // was sorted.
+            int32_t d = u->sweep_axis;
+            size_t n = MIN(u->num_sorted, u->sorted_boxes.size());
+            std::vector<struct AABB>::iterator begin = u->sorted_boxes.begin();
+            size_t j = std::lower_bound(begin, begin + n, AABB_L(obj->box, d) - u->max_sorted_extent,
+                                        [d](const struct AABB &b, double x)
+                                        { return AABB_L(b, d) < x; }) -
+                       begin;
+
+            for (; (j < n) && (AABB_L(u->sorted_boxes[j], d) <= AABB_U(obj->box, d)); j++)
+            {
+                struct PhysicsObject *o = u->phys_objects[j];
+                if ((o != obj) && (u->resolved_set.count(o) == 0))
+                {
+                    check_collision_neighbour(args, o, &u->sorted_boxes[j], metrics);
+                }
+            }
+
+            // The huge objects, and anything else past the sorted part, are few enough to test directly.
+            for (j = n; j < u->sorted_boxes.size(); j++)
+            {
+                struct PhysicsObject *o = u->phys_objects[j];
+                if ((o != obj) && (u->resolved_set.count(o) == 0))
+                {
+                    check_collision_neighbour(args, o, &u->sorted_boxes[j], metrics);
+                }
+            }
+        }
+        else
+        {
+            // Everything that the broad-phase returns overlapped its box as of the last update.
+            island->candidates.clear();
+            u->broadphase->query(&obj->box, island->candidates);
+            for (size_t j = 0; j < island->candidates.size(); j++)
+            {
+                struct PhysicsObject *o = island->candidates[j];
+                if ((o != obj) && (u->resolved_set.count(o) == 0))
+                {
+                    check_collision_neighbour(args, o, NULL, metrics);
+                }
+            }
+        }
+
+        // Objects resolved by earlier islands in this tick.
+        for (size_t j = 0; j < u->resolved_objects.size(); j++)
+        {
+            struct PhysicsObject *o = u->resolved_objects[j];
+            if (o != obj)
+            {
+                check_collision_neighbour(args, o, &u->resolved_boxes[j], metrics);
+            }
+        }
+
+        // Objects resolved in this island are tested directly. Pairs resolved in the same round
+        // would be seen from both sides, so those are only tested from the one that comes first.
+        for (size_t j = 0; j < island->resolved_objects.size(); j++)
+        {
+            struct PhysicsObject *o = island->resolved_objects[j];
+            if (o == obj)
+            {
+                continue;
+            }
+
+            struct Universe::resolved_object &other = island->resolved_rounds[o];
+            if ((other.round == self.round) && (other.index < self.index))
+            {
+                continue;
+            }
+
+            check_collision_boxes(args, obj, o, metrics);
+        }
+
+        metrics.total_ns = HRN - t0;
+        return metrics;
+    }
+
+    struct Universe::CollisionMetrics check_collision_huge(void *argsV)
+    {
+        struct Universe::phys_args *args = (struct Universe::phys_args *)argsV;
+        Universe *u = args->u;
+
+        struct Universe::CollisionMetrics metrics;
+        HRN_T(t0);
+        t0 = HRN;
+
+        std::vector<struct PhysicsObject *>::iterator sorted_begin = u->phys_objects.begin();
+        std::vector<struct PhysicsObject *>::iterator sorted_end = u->phys_objects.begin() + u->num_sorted;
+
+        for (size_t i = u->num_sorted; i < u->phys_objects.size(); i++)
+        {
+            struct PhysicsObject *h = u->phys_objects[i];
+
+            // There aren't many huge objects, so just test them against each other directly.
+            for (size_t j = i + 1; j < u->phys_objects.size(); j++)
+            {
+                check_collision_boxes(args, h, u->phys_objects[j], metrics);
+            }
+
+            // No sorted box is wider than max_sorted_extent, so anything that overlaps this one
+            // has to start somewhere in [l - max_sorted_extent, u] along the sweep axis. Find the
+            // start of that range, and sweep through it.
+            int32_t d = u->sweep_axis;
+            double start = AABB_L(h->box, d) - u->max_sorted_extent;
+            std::vector<struct PhysicsObject *>::iterator it = std::lower_bound(
+                sorted_begin, sorted_end, start,
+                [d](struct PhysicsObject *o, double x)
+                { return AABB_L(o->box, d) < x; });
+
+            for (; (it != sorted_end) && (AABB_L((*it)->box, d) <= AABB_U(h->box, d)); it++)
+            {
+                check_collision_boxes(args, h, *it, metrics);
+            }
+        }
+
+        metrics.total_ns = HRN - t0;
+        return metrics;
+    }
+
+    void *thread_check_collisions(void *argsV)
+    {
+        struct Universe::phys_args *args = (struct Universe::phys_args *)argsV;
+        if (args->huge)
+        {
+            args->metrics = check_collision_huge(argsV);
+        }
+        else if (args->u->broadphase == NULL)
+        {
+            args->metrics = check_collision_loop(argsV);
+        }
+        else
+        {
+            args->metrics = check_collision_pairs(argsV);
+        }
+        return NULL;
     }
 
     void Universe::sort_aabb(double dt, bool calc)
     {
-        // Employs gnome sort to sort the lists, computing the bounding boxes along the way
-        // http://en.wikipedia.org/wiki/Gnome_sort
+        // Employs gnome sort to sort the lists, computing the bounding boxes along the way
+        // http://en.wikipedia.org/wiki/Gnome_sort
+
+        struct PhysicsObject *box_swap;
+        size_t max_so_far = 0;
+
+        // Only the front of the list is sorted, but the huge objects at the end still need boxes.
+        if (calc)
+        {
+            for (size_t i = num_sorted; i < phys_objects.size(); i++)
+            {
+                estimate_box(phys_objects[i], dt);
+            }
+        }
+
+        if (num_sorted == 0)
+        {
+            return;
+        }
+
+        // Number of objects at the front of the list to gnome sort. That's all of them, unless a
+        // burst of new objects is sorted separately.
+        size_t n = num_sorted;
+
+        int32_t d = sweep_axis;
+        if (choose_sweep_axis())
+        {
+            // The list isn't anywhere near sorted along a new axis, and gnome sort would take
+            // quadratic time to get it there, so start over.
+            d = sweep_axis;
+            for (size_t i = 0; calc && (i < num_sorted); i++)
+            {
+                estimate_box(phys_objects[i], dt);
+            }
+            std::stable_sort(phys_objects.begin(), phys_objects.begin() + num_sorted,
+                             [d](struct PhysicsObject *a, struct PhysicsObject *b)
+                             { return AABB_L(a->box, d) < AABB_L(b->box, d); });
+            max_so_far = num_sorted;
+        }
+        else
+        {
+            // Walking each new object back through the list is fine for a few of them, but a large
+            // burst of them would take time proportional to the size of the list for each.
+            size_t num_fresh = num_sorted - MIN(num_presorted, num_sorted);
+            if (num_fresh > SORT_BURST_MIN)
+            {
+                n = num_sorted - num_fresh;
+            }
+
+            if (calc && (n > 0))
+            {
+                estimate_box(phys_objects[0], dt);
+            }
+        }
+
+        for (size_t i = 1; i < n;)
+        {
+            if (i > max_so_far)
+            {
+                // We only need to compute the bounding boxes on the first pass.
+                if (calc)
+                {
+                    estimate_box(phys_objects[i], dt);
+                }
+
+                max_so_far = i;
+            }
+
+            //! @todo Could the AABB comparisons be costly?
+
+            // Compare to the previous one if we're not at the first one.
+            int c = Vector3_compare_aabb(&phys_objects[i]->box, &phys_objects[i - 1]->box, d);
+
+            if (c < 0)
+            {
+                box_swap = phys_objects[i];
+                phys_objects[i] = phys_objects[i - 1];
+                phys_objects[i - 1] = box_swap;
+
+                // And then step back if we're not at the start.
+                i -= (i > 1);
+            }
+            else
+            {
+                // Jump back to before we started going backwards swapping.
+                i = max_so_far + 1;
+            }
+        }
+
+        if (n < num_sorted)
+        {
+            sort_burst(n, dt, calc);
+        }
+
+        max_sorted_extent = 0.0;
+        for (size_t i = 0; i < num_sorted; i++)
+        {
+            max_sorted_extent = MAX(max_sorted_extent, AABB_U(phys_objects[i]->box, d) - AABB_L(phys_objects[i]->box, d));
+        }
+
+        sorted_boxes.resize(phys_objects.size());
+        for (size_t i = 0; i < phys_objects.size(); i++)
+        {
+            sorted_boxes[i] = phys_objects[i]->box;
+        }
+    }
+
+    // An object in a burst being sorted, along with its quantized key.
+    struct burst_entry
+    {
+        uint32_t key;
+        struct PhysicsObject *obj;
+    };
+
+    void Universe::sort_burst(size_t begin, double dt, bool calc)
+    {
+        int32_t d = sweep_axis;
+        size_t n = num_sorted - begin;
+        std::vector<struct PhysicsObject *>::iterator first = phys_objects.begin() + begin;
+
+        double lo = INFINITY;
+        double hi = -INFINITY;
+        for (size_t i = begin; i < num_sorted; i++)
+        {
+            struct PhysicsObject *o = phys_objects[i];
+            if (calc)
+            {
+                estimate_box(o, dt);
+            }
+            lo = MIN(lo, AABB_L(o->box, d));
+            hi = MAX(hi, AABB_L(o->box, d));
+        }
+
+        // Quantize the lower bounds over the range that they cover, leaving a bit of room at the top
+        // so that rounding can't overflow the key.
+        double scale = (hi > lo ? 4294967040.0 / (hi - lo) : 0.0);
+        std::vector<struct burst_entry> entries(n);
+        std::vector<struct burst_entry> scratch(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            entries[i].obj = phys_objects[begin + i];
+            entries[i].key = (uint32_t)((AABB_L(entries[i].obj->box, d) - lo) * scale);
+        }
+
+        // Least significant digit first radix sort, a byte at a time. Each pass is stable, so the
+        // order of earlier passes carries through to ties in later ones.
+        for (int32_t shift = 0; shift < 32; shift += 8)
+        {
+            size_t counts[257] = {0};
+            for (size_t i = 0; i < n; i++)
+            {
+                counts[((entries[i].key >> shift) & 0xFF) + 1]++;
+            }
+            for (int32_t b = 0; b < 256; b++)
+            {
+                counts[b + 1] += counts[b];
+            }
+            for (size_t i = 0; i < n; i++)
+            {
+                scratch[counts[(entries[i].key >> shift) & 0xFF]++] = entries[i];
+            }
+            entries.swap(scratch);
+        }
+
+        for (size_t i = 0; i < n; i++)
+        {
+            phys_objects[begin + i] = entries[i].obj;
+        }
+
+        // Objects that fell into the same quantum might still be out of order, but only with their
+        // immediate neighbours, so insertion sort cleans that up quickly.
+        for (size_t i = begin + 1; i < num_sorted; i++)
+        {
+            struct PhysicsObject *o = phys_objects[i];
+            size_t j = i;
+            for (; (j > begin) && (AABB_L(o->box, d) < AABB_L(phys_objects[j - 1]->box, d)); j--)
+            {
+                phys_objects[j] = phys_objects[j - 1];
+            }
+            phys_objects[j] = o;
+        }
+
+        std::inplace_merge(phys_objects.begin(), first, phys_objects.begin() + num_sorted,
+                           [d](struct PhysicsObject *a, struct PhysicsObject *b)
+                           { return AABB_L(a->box, d) < AABB_L(b->box, d); });
+    }
+
+    bool Universe::choose_sweep_axis()
+    {
+        // The variance of the positions along each axis, as a measure of how spread out they are.
+        // When objects are lined up along the sweep axis, nearly every pair overlaps on it, and the
+        // sweep degrades to testing every pair.
+        double sum[3] = {0.0, 0.0, 0.0};
+        double sum2[3] = {0.0, 0.0, 0.0};
+        for (size_t i = 0; i < num_sorted; i++)
+        {
+            double *p = (double *)&phys_objects[i]->position;
+            for (int32_t d = 0; d < 3; d++)
+            {
+                sum[d] += p[d];
+                sum2[d] += p[d] * p[d];
+            }
+        }
 
-        struct PhysicsObject *box_swap;
-        size_t max_so_far = 0;
+        double var[3];
+        int32_t best = sweep_axis;
+        for (int32_t d = 0; d < 3; d++)
+        {
+            var[d] = sum2[d] / num_sorted - (sum[d] / num_sorted) * (sum[d] / num_sorted);
+        }
+        for (int32_t d = 0; d < 3; d++)
+        {
+            if (var[d] > SWEEP_AXIS_HYSTERESIS * var[best])
+            {
+                best = d;
+            }
+        }
 
-        if (calc)
+        if (best == sweep_axis)
         {
-            PhysicsObject_estimate_aabb(phys_objects[0], &phys_objects[0]->box, dt);
+            return false;
         }
+        sweep_axis = best;
+        return true;
+    }
+
+    void Universe::partition_huge()
+    {
+        // Everything that was sorted last time, and that's still at the front of the list, is still
+        // in order. Anything after that is new to the sorted part of the list.
+        size_t prev_sorted = MIN(num_sorted, phys_objects.size());
 
-        for (size_t i = 1; i < phys_objects.size();)
+        if ((params.collision_huge_radius_factor <= 0) || (phys_objects.size() == 0))
         {
-            if (i > max_so_far)
+            num_presorted = prev_sorted;
+            num_sorted = phys_objects.size();
+            return;
+        }
+
+        radii.resize(phys_objects.size());
+        for (size_t i = 0; i < phys_objects.size(); i++)
+        {
+            radii[i] = phys_objects[i]->radius;
+        }
+        std::nth_element(radii.begin(), radii.begin() + radii.size() / 2, radii.end());
+        double cutoff = params.collision_huge_radius_factor * radii[radii.size() / 2];
+
+        // The list is nearly sorted from the last tick, so keep the order of the objects that
+        // stay in the sorted part to keep the sort cheap. Since the partition is stable, those
+        // that were already sorted stay at the front.
+        num_presorted = std::count_if(phys_objects.begin(), phys_objects.begin() + prev_sorted,
+                                      [cutoff](struct PhysicsObject *o)
+                                      { return o->radius <= cutoff; });
+        std::vector<struct PhysicsObject *>::iterator it = std::stable_partition(
+            phys_objects.begin(), phys_objects.end(),
+            [cutoff](struct PhysicsObject *o)
+            { return o->radius <= cutoff; });
+        num_sorted = it - phys_objects.begin();
+    }
+
+    void Universe::index_beams(double dt)
+    {
+        size_t n = beams.size();
+        std::vector<struct AABB> boxes(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            Beam_estimate_aabb(beams[i], &boxes[i], dt);
+        }
+
+        // Sort along whichever axis the beams are most spread out on, going by the centres of the
+        // boxes that are bounded.
+        double sum[3] = {0.0, 0.0, 0.0};
+        double sum2[3] = {0.0, 0.0, 0.0};
+        size_t num_bounded = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            if ((boxes[i].l.x == -INFINITY) || (boxes[i].u.x == INFINITY))
             {
-                // We only need to compute the bounding boxes on the first pass.
-                if (calc)
+                continue;
+            }
+
+            num_bounded++;
+            for (int32_t d = 0; d < 3; d++)
+            {
+                double c = (AABB_L(boxes[i], d) + AABB_U(boxes[i], d)) / 2;
+                sum[d] += c;
+                sum2[d] += c * c;
+            }
+        }
+
+        beam_axis = 0;
+        if (num_bounded > 0)
+        {
+            double best = -1.0;
+            for (int32_t d = 0; d < 3; d++)
+            {
+                double mean = sum[d] / num_bounded;
+                double var = sum2[d] / num_bounded - mean * mean;
+                if (var > best)
                 {
-                    PhysicsObject_estimate_aabb(phys_objects[i], &phys_objects[i]->box, dt);
+                    best = var;
+                    beam_axis = d;
                 }
-
-                max_so_far = i;
             }
+        }
 
-            //! @todo Could the AABB comparisons be costly?
+        int32_t d = beam_axis;
+        beam_order.resize(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            beam_order[i] = (uint32_t)i;
+        }
+        std::sort(beam_order.begin(), beam_order.end(),
+                  [&boxes, d](uint32_t a, uint32_t b)
+                  { return AABB_L(boxes[a], d) < AABB_L(boxes[b], d); });
 
-            // Compare to the previous one if we're not at the first one.
-            int c = Vector3_compare_aabbX(&phys_objects[i]->box, &phys_objects[i - 1]->box);
+        beam_boxes.resize(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            beam_boxes[i] = boxes[beam_order[i]];
+        }
 
-            if (c < 0)
-            {
-                box_swap = phys_objects[i];
-                phys_objects[i] = phys_objects[i - 1];
-                phys_objects[i - 1] = box_swap;
+        beam_run_upper.assign((n + BEAM_INDEX_RUN - 1) / BEAM_INDEX_RUN, -INFINITY);
+        for (size_t i = 0; i < n; i++)
+        {
+            beam_run_upper[i / BEAM_INDEX_RUN] = MAX(beam_run_upper[i / BEAM_INDEX_RUN], AABB_U(beam_boxes[i], d));
+        }
+    }
 
-                // And then step back if we're not at the start.
-                i -= (i > 1);
+    void Universe::query_beams(struct AABB *box, std::vector<uint32_t> &out)
+    {
+        out.clear();
+
+        // Nothing from the first box that starts after this one ends can overlap it.
+        int32_t d = beam_axis;
+        double upper = AABB_U(*box, d);
+        size_t end = std::upper_bound(beam_boxes.begin(), beam_boxes.end(), upper,
+                                      [d](double v, const struct AABB &b)
+                                      { return v < AABB_L(b, d); }) -
+                     beam_boxes.begin();
+
+        for (size_t i = 0; i < end; i++)
+        {
+            if (beam_run_upper[i / BEAM_INDEX_RUN] < AABB_L(*box, d))
+            {
+                i += BEAM_INDEX_RUN - 1 - (i % BEAM_INDEX_RUN);
+                continue;
             }
-            else
+
+            struct AABB *b = &beam_boxes[i];
+            if (Vector3_intersect_interval(box->l.x, box->u.x, b->l.x, b->u.x) &&
+                Vector3_intersect_interval(box->l.y, box->u.y, b->l.y, b->u.y) &&
+                Vector3_intersect_interval(box->l.z, box->u.z, b->l.z, b->u.z))
             {
-                // Jump back to before we started going backwards swapping.
-                i = max_so_far + 1;
+                out.push_back(beam_order[i]);
             }
         }
+
+        // Hits are resolved in the order that the beams are in the universe, as they were before
+        // there was an index.
+        std::sort(out.begin(), out.end());
+    }
+
+    // Copy of a string that a deferred message can own, or NULL.
+    static char *copy_string(const char *src)
+    {
+        if (src == NULL)
+        {
+            return NULL;
+        }
+
+        size_t len = strlen(src) + 1;
+        char *ret = (char *)malloc(sizeof(char) * len);
+        if (ret == NULL)
+        {
+            throw std::runtime_error("OOM::Universe::CopyString");
+        }
+        memcpy(ret, src, len);
+        return ret;
     }
 
     //! @todo Convert this to a private member function.
-    void obj_tick(Universe *u, struct PhysicsObject *o, double dt)
+    //! Objects are ticked on several threads at once, so anything that reaches outside of the object
+    //! goes into effects instead, to be carried out once they're all done.
+    void obj_tick(Universe *u, struct PhysicsObject *o, double dt, struct Universe::TickEffects *effects)
     {
-        V3 g = {0.0, 0.0, 0.0};
         struct BeamCollisionResult beam_result;
 
         // Needed to resolve the physical effects of the collision.
@@ -1490,13 +2986,22 @@ namespace Diana
 
         struct Beam *b;
 
-        for (size_t bi = 0; bi < u->beams.size(); bi++)
+        // Only the beams whose wavefronts reach into the space the object sweeps through need a
+        // closer look.
+        struct AABB box;
+        PhysicsObject_estimate_aabb(o, &box, dt);
+
+        std::vector<uint32_t> &candidates = effects->beam_candidates;
+        u->query_beams(&box, candidates);
+
+        for (size_t ci = 0; ci < candidates.size(); ci++)
         {
-            b = u->beams[bi];
+            b = u->beams[candidates[ci]];
             Beam_collide(&beam_result, b, o, dt);
 
             if (beam_result.t >= 0.0)
             {
+                PhysicsObject_wake(o);
                 phys_result.pce1.d = beam_result.d;
                 phys_result.pce1.p = beam_result.p;
 
@@ -1509,230 +3014,630 @@ namespace Diana
 #endif
                 }
 
-                PhysicsObject_collision(o, (PO *)b, beam_result.e, beam_result.t * dt, &phys_result.pce1, u->params.health_damage_threshold);
+                PhysicsObject_collision(o, (PO *)b, beam_result.e, beam_result.t * dt, &phys_result.pce1, u->params.health_damage_threshold, &effects->beams);
 
                 //! @todo Smarty beam collision messages
                 //! @todo Beam collision messages
                 if (o->type == PHYSOBJECT_SMART)
                 {
                     struct SmartPhysicsObject *s = (SPO *)o;
-                    CollisionMsg cm;
-                    cm.client_id = s->client_id;
-                    cm.server_id = o->phys_id;
-                    cm.direction = beam_result.d;
-                    cm.position = beam_result.p;
-                    Vector3_subtract(&cm.position, &o->position);
-                    cm.energy = beam_result.e;
-                    cm.comm_msg = NULL;
+                    // The messages are sent once every object has been ticked, and own everything
+                    // that they point to until then.
+                    CollisionMsg *cm = new CollisionMsg();
+                    cm->client_id = s->client_id;
+                    cm->server_id = o->phys_id;
+                    cm->direction = beam_result.d;
+                    cm->position = beam_result.p;
+                    Vector3_subtract(&cm->position, &o->position);
+                    cm->energy = beam_result.e;
+                    cm->comm_msg = NULL;
                     // It makes sense that we know about the power levels of the beam here,
                     // since in theory the ship would know about the duration of the beam,
                     // even if we're not simulating that.
-                    cm.spectrum = Spectrum_clone(b->spectrum);
-                    cm.spec_all();
+                    cm->spectrum = Spectrum_clone(b->spectrum);
+                    cm->spec_all();
 
                     // Note that there is no comm message (yet, maybe), so that's unspecced.
-                    cm.specced[cm.num_el - 4] = false;
+                    cm->specced[cm->num_el - 4] = false;
 
                     switch (b->type)
                     {
                     case BEAM_COMM:
-                        cm.specced[cm.num_el - 4] = true;
-                        cm.set_colltype((char *)"COMM");
-                        cm.comm_msg = b->comm_msg;
-                        cm.send(s->socket);
-                        cm.comm_msg = NULL;
+                        cm->specced[cm->num_el - 4] = true;
+                        cm->set_colltype((char *)"COMM");
+                        cm->comm_msg = copy_string(b->comm_msg);
+                        effects->messages.push_back({s->socket, cm});
                         break;
                     case BEAM_SCAN:
                     {
-                        cm.set_colltype((char *)"SCAN");
-                        cm.send(s->socket);
-
-                        ScanQueryMsg sqm;
-                        sqm.client_id = s->client_id;
-                        sqm.server_id = o->phys_id;
-                        sqm.scan_id = b->phys_id;
-                        sqm.energy = cm.energy;
-                        sqm.direction = cm.direction;
-                        sqm.spectrum = Spectrum_clone(b->spectrum);
-                        sqm.spec_all();
-
-                        // Note that we need to ensure that the queries map is ready for a response before sending
-                        // the query, otherwise we're in one hell of a race condition.
-
-                        // Ignore multiple hits of the same beam/object pair.
-                        // Could, in theory, use a multimap for queries instead, but really, multiple hits are spurious.
-                        struct Universe::scan_target st = {b->phys_id, o->phys_id};
-                        LOCK(u->query_lock);
-                        const std::map<struct Universe::scan_target, struct Universe::scan_origin>::iterator it = u->queries.find(st);
-                        if ((it == u->queries.end()) || !(st == (it->first)))
+                        cm->set_colltype((char *)"SCAN");
+                        effects->messages.push_back({s->socket, cm});
+
+                        ScanQueryMsg *sqm = new ScanQueryMsg();
+                        sqm->client_id = s->client_id;
+                        sqm->server_id = o->phys_id;
+                        sqm->scan_id = b->phys_id;
+                        sqm->energy = cm->energy;
+                        sqm->direction = cm->direction;
+                        sqm->spectrum = Spectrum_clone(b->spectrum);
+                        sqm->spec_all();
+
+                        // Add the query to the universe so that it can send the response beam
+                        // when the osim responds. The queries are all in place before any message
+                        // goes out, so the response can't beat its query.
+                        // Clone the beam so that if the beam expires before the return beam is sent, we don't access the freed space.
+                        B *b_copy = (B *)malloc(sizeof(B));
+                        PO *o_copy = PhysicsObject_clone(o);
+                        if ((b_copy == NULL) || (o_copy == NULL))
                         {
-                            // Add the query to the universe so that it can send the response beam
-                            // when the osim responds.
-                            // Beam_make_return_beam(b, energy, &effect->p, BEAM_SCANRESULT);
-                            // Clone the beam so that if the beam expires before the return beam is sent, we don't access the freed space.
-                            B *b_copy = (B *)malloc(sizeof(B));
-                            PO *o_copy = PhysicsObject_clone(o);
-                            if ((b_copy == NULL) || (o_copy == NULL))
-                            {
-                                throw std::runtime_error("OOM::Universe::BeamHitObjClone");
-                            }
-
-                            *b_copy = *b;
-                            b_copy->data = NULL;
-                            b_copy->comm_msg = NULL;
-                            b_copy->scan_target = o_copy;
-                            b_copy->spectrum = Spectrum_clone(b->spectrum);
-                            u->queries[st] = {b_copy, cm.energy, beam_result.p};
+                            throw std::runtime_error("OOM::Universe::BeamHitObjClone");
                         }
-                        UNLOCK(u->query_lock);
+
+                        *b_copy = *b;
+                        b_copy->data = NULL;
+                        b_copy->comm_msg = NULL;
+                        b_copy->scan_target = o_copy;
+                        b_copy->spectrum = Spectrum_clone(b->spectrum);
+                        struct Universe::scan_target st = {b->phys_id, o->phys_id};
+                        effects->queries.push_back({st, {b_copy, cm->energy, beam_result.p}});
 
                         if (u->params.verbose_logging)
                         {
-                            fprintf(stderr, "%g Sending SCANQUERY to %ld for object %ld\n", u->time(), sqm.client_id, sqm.server_id);
+                            fprintf(stderr, "%g Sending SCANQUERY to %ld for object %ld\n", u->time(), sqm->client_id, sqm->server_id);
                         }
 
-                        sqm.send(s->socket);
+                        effects->messages.push_back({s->socket, sqm});
                         break;
                     }
                     case BEAM_SCANRESULT:
                     {
                         //! @todo This feels forced, ugh... Enum?
-                        cm.set_colltype((char *)"SCRE");
-                        cm.send(s->socket);
+                        cm->set_colltype((char *)"SCRE");
+                        effects->messages.push_back({s->socket, cm});
 
                         //! @todo Should we consider only sending this message if the phys_id of the object matches that of the originator?
                         // We'd need to add that information to the beaming chain.
-                        ScanResultMsg srm;
-                        srm.client_id = s->client_id;
-                        srm.server_id = s->pobj.phys_id;
-                        srm.position = b->scan_target->position;
-                        Vector3_subtract(&srm.position, &o->position);
-                        srm.velocity = b->scan_target->velocity;
-                        Vector3_subtract(&srm.velocity, &o->velocity);
-                        srm.thrust = b->scan_target->thrust;
-                        srm.mass = b->scan_target->mass;
-                        srm.radius = b->scan_target->radius;
-                        srm.orientation = {b->scan_target->forward.x, b->scan_target->forward.y, b->scan_target->up.x, b->scan_target->up.y};
-                        srm.obj_type = b->scan_target->obj_type;
-                        srm.beam_spectrum = Spectrum_clone(b->spectrum);
-                        srm.data = b->data;
-                        srm.spec_all();
+                        ScanResultMsg *srm = new ScanResultMsg();
+                        srm->client_id = s->client_id;
+                        srm->server_id = s->pobj.phys_id;
+                        srm->position = b->scan_target->position;
+                        Vector3_subtract(&srm->position, &o->position);
+                        srm->velocity = b->scan_target->velocity;
+                        Vector3_subtract(&srm->velocity, &o->velocity);
+                        srm->thrust = b->scan_target->thrust;
+                        srm->mass = b->scan_target->mass;
+                        srm->radius = b->scan_target->radius;
+                        PhysicsObject_get_orientation(b->scan_target, &srm->orientation);
+                        srm->obj_type = copy_string(b->scan_target->obj_type);
+                        srm->beam_spectrum = Spectrum_clone(b->spectrum);
+                        srm->data = copy_string(b->data);
+                        srm->spec_all();
 
                         if (b->data == NULL)
                         {
-                            srm.specced[srm.num_el - 7] = false;
+                            srm->specced[srm->num_el - 7] = false;
                         }
 
                         // If the spectrum for the object we hit is NULL, then we should unmark
                         // the spectrum parts of the message.
                         if (b->scan_target->spectrum == NULL)
                         {
-                            srm.specced[srm.num_el - 3] = false;
-                            srm.specced[srm.num_el - 2] = false;
-                            srm.specced[srm.num_el - 1] = false;
-                            srm.obj_spectrum = NULL;
+                            srm->specced[srm->num_el - 3] = false;
+                            srm->specced[srm->num_el - 2] = false;
+                            srm->specced[srm->num_el - 1] = false;
+                            srm->obj_spectrum = NULL;
                         }
                         else
                         {
-                            srm.obj_spectrum = Spectrum_clone(b->scan_target->spectrum);
+                            srm->obj_spectrum = Spectrum_clone(b->scan_target->spectrum);
                         }
 
                         if (u->params.verbose_logging)
                         {
-                            fprintf(stderr, "%g Sending SCANRESULT to %ld for object %ld\n", u->time(), srm.client_id, srm.server_id);
+                            fprintf(stderr, "%g Sending SCANRESULT to %ld for object %ld\n", u->time(), srm->client_id, srm->server_id);
                         }
 
-                        srm.send(s->socket);
-
-                        // The message object will go out-of-scope, but is currently pointing to the beam's
-                        // target's object type, which we don't want to free in the message's constructor.
-                        // Re-point it to NULL here, so we don't try to free it in the next line.
-                        srm.obj_type = NULL;
-                        srm.data = NULL;
-
+                        effects->messages.push_back({s->socket, srm});
                         break;
                     }
                     case BEAM_WEAP:
-                        cm.set_colltype((char *)"WEAP");
-                        cm.send(s->socket);
+                        cm->set_colltype((char *)"WEAP");
+                        effects->messages.push_back({s->socket, cm});
                         break;
                     default:
+                        delete cm;
                         break;
                     }
                 }
             }
         }
 
-        //! @todo Multithread this.
-        V3 pd;
-        PO *other;
-        double distance_sq;
+        V3 pd;
+        PO *other;
+        double distance_sq;
+
+        if ((u->total_time - u->last_effect_time) >= 1.0)
+        {
+            for (size_t i = 0; i < u->radiators.size(); i++)
+            {
+                other = u->radiators[i];
+                // Don't collide an object with it's own radiation
+                if (other->phys_id == o->phys_id)
+                {
+                    continue;
+                }
+
+                Vector3_subtract(&pd, &other->position, &o->position);
+                distance_sq = Vector3_length2(&pd);
+                if (distance_sq < other->spectrum->safe_distance_sq)
+                {
+                    double energy = o->radius * o->radius * other->spectrum->total_power / (4 * distance_sq);
+
+                    if (o->type == PHYSOBJECT_SMART)
+                    {
+                        struct SmartPhysicsObject *s = (SPO *)o;
+                        CollisionMsg *cm = new CollisionMsg();
+                        cm->client_id = s->client_id;
+                        cm->server_id = o->phys_id;
+                        Vector3_scale(&pd, 1.0 / Vector3_length(&pd));
+                        cm->direction = pd;
+                        Vector3_scale(&pd, o->radius);
+                        cm->position = pd;
+                        cm->energy = energy;
+                        cm->comm_msg = NULL;
+                        cm->spectrum = Spectrum_clone(other->spectrum);
+                        //! @todo Ok, this four-character string is starting to feel forced.
+                        cm->set_colltype((char *)"RADN");
+                        cm->spec_all();
+
+                        // Note that there is no comm message, so that's unspecced.
+                        cm->specced[cm->num_el - 4] = false;
+                        effects->messages.push_back({s->socket, cm});
+                    }
+                    else if (o->type == PHYSOBJECT)
+                    {
+                        PhysicsObject_resolve_damage(o, energy, u->params.health_damage_threshold);
+                    }
+                }
+            }
+        }
+
+    }
+
+    // Heap ordering for collision events, which puts the earliest event at the top of the heap.
+    bool collision_event_later(const struct Universe::PhysCollisionEvent &a, const struct Universe::PhysCollisionEvent &b)
+    {
+        return a.pcr.t > b.pcr.t;
+    }
+
+    bool Universe::pop_collision_event(struct CollisionIsland *island)
+    {
+        std::vector<struct PhysCollisionEvent> &events = island->events;
+        while (events.size() > 0)
+        {
+            std::pop_heap(events.begin(), events.end(), collision_event_later);
+            struct PhysCollisionEvent &ev = events.back();
+            if ((ev.generation1 == ev.obj1->generation) && (ev.generation2 == ev.obj2->generation))
+            {
+                return true;
+            }
+            events.pop_back();
+        }
+        return false;
+    }
+
+    bool Universe::add_round_object(struct CollisionIsland *island, struct PhysicsObject *obj)
+    {
+        std::unordered_map<struct PhysicsObject *, struct resolved_object>::iterator it = island->resolved_rounds.find(obj);
+        if ((it != island->resolved_rounds.end()) && (it->second.round == island->round))
+        {
+            return false;
+        }
+
+        if (it == island->resolved_rounds.end())
+        {
+            island->resolved_objects.push_back(obj);
+        }
+        island->resolved_rounds[obj] = {island->round, island->round_objects.size()};
+        island->round_objects.push_back(obj);
+        return true;
+    }
+
+    // Find the root of the set that i belongs to, flattening the path to it along the way.
+    static int32_t island_root(std::vector<int32_t> &parent, int32_t i)
+    {
+        while (parent[i] != i)
+        {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    }
+
+    void Universe::build_islands()
+    {
+        // Stale events would only join islands together for no reason.
+        size_t n = 0;
+        for (size_t i = 0; i < collisions.size(); i++)
+        {
+            struct PhysCollisionEvent &ev = collisions[i];
+            if ((ev.generation1 == ev.obj1->generation) && (ev.generation2 == ev.obj2->generation))
+            {
+                collisions[n++] = ev;
+            }
+        }
+        collisions.resize(n);
+
+        // Number the objects in the order they first turn up, and join the two objects of every
+        // event into the same set.
+        island_of.clear();
+        std::vector<int32_t> parent;
+        for (size_t i = 0; i < collisions.size(); i++)
+        {
+            struct PhysicsObject *objs[2] = {collisions[i].obj1, collisions[i].obj2};
+            int32_t roots[2];
+            for (int32_t k = 0; k < 2; k++)
+            {
+                std::pair<std::unordered_map<struct PhysicsObject *, int32_t>::iterator, bool> ins =
+                    island_of.insert(std::make_pair(objs[k], (int32_t)parent.size()));
+                if (ins.second)
+                {
+                    parent.push_back((int32_t)parent.size());
+                }
+                roots[k] = island_root(parent, ins.first->second);
+            }
+
+            if (roots[0] != roots[1])
+            {
+                parent[MAX(roots[0], roots[1])] = MIN(roots[0], roots[1]);
+            }
+        }
+
+        // Islands are numbered in the order of their first events, so that the result doesn't depend
+        // on how the hash table happens to be laid out.
+        std::vector<int32_t> ids(parent.size(), -1);
+        size_t num_islands = 0;
+        for (size_t i = 0; i < collisions.size(); i++)
+        {
+            int32_t root = island_root(parent, island_of[collisions[i].obj1]);
+            if (ids[root] < 0)
+            {
+                ids[root] = (int32_t)num_islands++;
+                if (islands.size() < num_islands)
+                {
+                    islands.resize(num_islands);
+                }
+
+                struct CollisionIsland &island = islands[num_islands - 1];
+                island.id = ids[root];
+                island.events.clear();
+                island.round_objects.clear();
+                island.resolved_objects.clear();
+                island.resolved_rounds.clear();
+                island.boundary.clear();
+                island.messages.clear();
+                island.round = 0;
+                island.metrics = CollisionMetrics();
+                island.retest_metrics = CollisionMetrics();
+            }
+            islands[ids[root]].events.push_back(collisions[i]);
+        }
+        islands.resize(num_islands);
+        collisions.clear();
+
+        std::unordered_map<struct PhysicsObject *, int32_t>::iterator it;
+        for (it = island_of.begin(); it != island_of.end(); ++it)
+        {
+            it->second = ids[island_root(parent, it->second)];
+        }
+
+        for (size_t i = 0; i < islands.size(); i++)
+        {
+            std::make_heap(islands[i].events.begin(), islands[i].events.end(), collision_event_later);
+        }
+    }
+
+    // Message telling a smarty about a physical collision, which has no spectrum or comm message.
+    static CollisionMsg *phys_collision_msg(struct SmartPhysicsObject *s, struct PhysCollisionEffect *pce, double energy)
+    {
+        CollisionMsg *cm = new CollisionMsg();
+        cm->set_colltype((char *)"PHYS");
+        cm->comm_msg = NULL;
+        cm->spec_all();
+
+        // Since this is a physical collision, there's no spectrum attached.
+        cm->spectrum = NULL;
+        cm->specced[cm->num_el - 1] = false;
+        cm->specced[cm->num_el - 2] = false;
+        cm->specced[cm->num_el - 3] = false;
+
+        cm->client_id = s->socket;
+        cm->server_id = s->pobj.phys_id;
+        cm->direction = pce->d;
+        cm->position = pce->p;
+        cm->energy = energy;
+        return cm;
+    }
+
+    void Universe::resolve_island(struct CollisionIsland *island, double dt)
+    {
+        struct phys_args args;
+        args.u = this;
+        args.offset = 0;
+        args.stride = 0;
+        args.dt = dt;
+        args.obj = NULL;
+        args.island = island;
+        args.huge = false;
+
+        // The value in params.max_simultaneous_collision_rounds defines the number of rounds that we'll consider
+        // multiple collision at the same instant.
+        // After this cutoff, only one collision per instant is considered, and the rest discarded for the sake
+        // of interactivity. After enough rounds, the eventual effects of the extra energy distribution will be
+        // negligible.
+        while (pop_collision_event(island))
+        {
+            island->round++;
+            // Simultaneous collision handling is not obvious, but ends up working out to be not too complex.
+            //
+            // We need to ensure conservation of momentum and energy in all of the simultenaous collisions that
+            // involve a specific object, the object can't end up with more energy or momentum as a result of
+            // the combined effects of multiple collisions than was present in the original system (of all
+            // objects of interest). This actually turns out to come for 'free' in some sense as a consequence
+            // of the conservation of momentuem/energy in the two-body case.
+            //
+            // Because the elastic collision of two objects can be reduced to a one-dimensional problem, they
+            // are easy to solve, and the solution conserves momentum and energy in that two-object system.
+            // This can be extended to address N-body collisions, but considering all necessary two-body
+            // collisions, each of which conserves energy/momentum, and applying all of their effects in
+            // summation only gets us part way. That is, each collisions results in a delta-v for each object,
+            // and so applying the sum of all delta-v (to both objects) in all collisions involving an object
+            // will result in a conserved system still MOMENTUM conserved system, but not energy.
+            //
+            // To regain energy conservation, it is important to realize that, in a collision, an object
+            // exchanges more energy with it's neighbours than it possessed in the original system. This results
+            // in a final system that contains more energy than the original system possessed. To reconcile this
+            // it is possible to calculate the energy in the final system, and original system, which will be
+            // related by E'=kE, with k>=1. Conservation can be regained by scaling all resulting velocities
+            // by 1/sqrt(k).
+            //
+            // IMPORTANT NOTE: This approximation is physically incorrect, since it will return conservation of
+            // energy, but destroy conservation of momentum. This is a fine approximation, since it results in
+            // a system that has a slightly too 'spread-out' (in some sense) set of resulting velocities. But
+            // at least the magnitudes, directions, and energiers are approximately, and qualitatively, right.
+            //
+            // Since islands share no objects, the energy of each one is conserved on its own, and the scaling
+            // is worked out separately for each.
+            //
+            // The only tricky part is ensuring that we're keeping the dt stepping of each object correct.
+
+            // Now resolve the collisions on the objects, setting the time-delta to be the time from the last-moved
+            // time of the object we're moving, to the time that this collision happened
+            // Note that we're setting the object's ticked time to an actual amount of interval simulated time, not a
+            // proportion of the interval.
+            //
+            // The proportional time-interval value, 't' in the physics collicion result, is the proportion of the
+            // original total interval. We want to pass the time elapsed since the last notable event to the
+            // collision resolution code. This elapsed time is the proportion times dt, since we do the consideration
+            // earlier that ensures that any collisions that we're considering are happening in the future, and
+            // within the remainder of the time interval, of ALL objects involved.
+
+            // Keep track of the number of simultaneous collisions.
+            size_t n_simultaneous = 0;
+
+            // All of the objects involved in the collisions in this round.
+            island->round_objects.clear();
+            double energy0 = 0.0;
+
+            // The earliest valid event is at the back of the list, and every other valid event that
+            // happens at the same time as it is pulled off of the heap to join it.
+            double round_t = island->events.back().pcr.t;
+            while (true)
+            {
+                // For each collision that happens at the same time as the first, apply it to the objects involved
+                struct PhysCollisionEvent collision_event = island->events.back();
+                island->events.pop_back();
+                struct PhysicsObject *obj1 = collision_event.obj1;
+                struct PhysicsObject *obj2 = collision_event.obj2;
+                struct PhysCollisionResult phys_result = collision_event.pcr;
+
+                if ((island->round == 1) && params.verbose_logging)
+                {
+#if __x86_64__
+                    fprintf(stderr, "%g Collision: %lu <-> %lu (%.15g J)\n", this->time(), obj1->phys_id, obj2->phys_id, phys_result.e);
+#else
+                    fprintf(stderr, "%g Collision: %llu <-> %llu (%.15g J)\n", this->time(), obj1->phys_id, obj2->phys_id, phys_result.e);
+#endif
+                }
+
+                // Note that when applying the collision, we need to make sure that each object is observing the
+                // correct time-delta to have elapsed since their last physics event. This is why we take the
+                // collision results 't' parameter portion of the total tick time (t*dt), and subtract off the
+                // object's alread-ticked time. This gives us the delta since the last time that object had it's
+                // velocity accounted for.
+
+                // Have we already seen the object in question in this round? Should be true if this is the
+                // first collision in the round that involves it.
+                bool never_seen;
+
+                // While we're at it, keep track of all distinct objects that we've collided by adding them to
+                // the list, in case we haven't seen them already. Additionally, take this time to calculate the
+                // kinetic energy of all objects before any collisions are taken into consideration, store it in
+                // energy0.
+                never_seen = add_round_object(island, obj1);
+                energy0 += (never_seen ? obj1->mass * Vector3_length2(&obj1->velocity) : 0.0);
+                PhysicsObject_collision(obj1, obj2, phys_result.e, never_seen * phys_result.t * dt, &phys_result.pce1, params.health_damage_threshold);
+                never_seen = add_round_object(island, obj2);
+                energy0 += (never_seen ? obj2->mass * Vector3_length2(&obj2->velocity) : 0.0);
+                PhysicsObject_collision(obj2, obj1, phys_result.e, never_seen * phys_result.t * dt, &phys_result.pce2, params.health_damage_threshold);
+
+                // Alert the smarties that there was a collision, if either re smart.
+                // Only physical collisions are generated here, beams are elsewhere. Several smarties
+                // can share a socket, and their islands can be resolved on different threads, so the
+                // messages are queued with the island and sent once all of the islands are done.
+                if (obj1->type == PHYSOBJECT_SMART)
+                {
+                    SPO *s = (SPO *)obj1;
+                    island->messages.push_back({s->socket, phys_collision_msg(s, &phys_result.pce1, phys_result.e)});
+                }
+
+                if (obj2->type == PHYSOBJECT_SMART)
+                {
+                    SPO *s = (SPO *)obj2;
+                    island->messages.push_back({s->socket, phys_collision_msg(s, &phys_result.pce2, phys_result.e)});
+                }
+
+                n_simultaneous++;
+
+                // To prevent hanging in the situation where there's a constant feedback of collisions,
+                // limit the number of rounds we'll support.
+                if (island->round > params.max_simultaneous_collision_rounds)
+                {
+                    break;
+                }
+
+                // Stop at the first valid event that doesn't happen at the same time. Events that involve
+                // objects we've already seen in this round stay valid until the round is over, since
+                // they're simultaneous.
+                if (!pop_collision_event(island) || !Vector3_almost_zeroS(round_t - island->events.back().pcr.t))
+                {
+                    break;
+                }
+            }
+
+            // The scaling factor for the post-collision velocities to restore energy conservation, if there is
+            // only one collision, then the two-body solution conserves energy.
+            double k = 1.0;
+            if (n_simultaneous > 1)
+            {
+                // Post-collision system energy
+                double energy1 = 0.0;
+                for (size_t i = 0; i < island->round_objects.size(); i++)
+                {
+                    energy1 += island->round_objects[i]->mass * Vector3_length2(&island->round_objects[i]->velocity);
+                }
+
+                // If there's more than one collision, then this factor is the ratio of original to final
+                // energy.
+                k = sqrt(energy0 / energy1);
+            }
+
+            // Note that these collisions have invalidated the correctness of future collisions involving any
+            // object that we've already considered. Bumping the generation of each object marks all of those
+            // as stale, and they're skipped when they come off of the heap.
+            for (size_t i = 0; i < island->round_objects.size(); i++)
+            {
+                if (island->round_objects[i]->rails == NULL)
+                {
+                    Vector3_scale(&island->round_objects[i]->velocity, k);
+                }
+                island->round_objects[i]->generation++;
+            }
+
+            // Re-collide the affected objects by calling back to check_collision_loop() with appropriate args.
+            // Remaining time left in the tick is the total time minus what has been accounted for so far.
+            // Note that obj1 and obj2 should have identical values here, that should be assert()-able
+            //
+            // Note that, really, EVERY physics object should be ticked to this point. All further comparisons
+            // can assume that other physics objects are 'valid' up until the point of the collision we just
+            // resolved. It's important to note, as well, that we have to consider the whole tick event for every
+            // object, and we will have to consider the 't' parameter of objects, to make sure we're still within
+            // the interval of the objects of interest. This consideration is done in check_collision_single().
+
+            // Bring all of the boxes up to date first, so that each object is re-tested against
+            // where the others are now.
+            for (size_t i = 0; i < island->round_objects.size(); i++)
+            {
+                struct PhysicsObject *o = island->round_objects[i];
+                PhysicsObject_wake(o);
+                PhysicsObject_estimate_aabb(o, &o->box, dt);
+            }
+
+            for (size_t i = 0; i < island->round_objects.size(); i++)
+            {
+                args.obj = island->round_objects[i];
+                island->retest_metrics.add(check_collision_object(&args));
+            }
+
+            // Any new events go on the heap.
+            for (size_t i = 0; i < args.collisions.size(); i++)
+            {
+                island->events.push_back(args.collisions[i]);
+                std::push_heap(island->events.begin(), island->events.end(), collision_event_later);
+            }
+            args.collisions.clear();
+
+            island->metrics.simultaneous_collisions += n_simultaneous;
+
+            // Once the island has run into something outside of itself, its later events can't be
+            // trusted until whatever that is has been resolved too.
+            if (island->boundary.size() > 0)
+            {
+                break;
+            }
+        }
+    }
+
+    void Universe::check_island_boundaries(double dt)
+    {
+        std::vector<struct BroadPhasePair> pairs;
+        for (size_t i = 0; i < islands.size(); i++)
+        {
+            pairs.insert(pairs.end(), islands[i].boundary.begin(), islands[i].boundary.end());
+        }
 
-        if ((u->total_time - u->last_effect_time) >= 1.0)
+        // Objects in different islands only compared themselves to where each other started, so
+        // sweep over the objects that moved in this set of islands to see if they've run into each
+        // other since.
+        if (islands.size() > 1)
         {
-            for (size_t i = 0; i < u->radiators.size(); i++)
+            std::vector<struct PhysicsObject *> moved;
+            for (size_t i = 0; i < islands.size(); i++)
             {
-                other = u->radiators[i];
-                // Don't collide an object with it's own radiation
-                if (other->phys_id == o->phys_id)
-                {
-                    continue;
-                }
+                moved.insert(moved.end(), islands[i].resolved_objects.begin(), islands[i].resolved_objects.end());
+            }
+            std::sort(moved.begin(), moved.end(), [](struct PhysicsObject *a, struct PhysicsObject *b)
+                      { return a->box.l.x < b->box.l.x; });
 
-                Vector3_subtract(&pd, &other->position, &o->position);
-                distance_sq = Vector3_length2(&pd);
-                if (distance_sq < other->spectrum->safe_distance_sq)
+            for (size_t i = 0; i < moved.size(); i++)
+            {
+                int32_t id = island_of[moved[i]];
+                for (size_t j = i + 1; (j < moved.size()) && (moved[j]->box.l.x <= moved[i]->box.u.x); j++)
                 {
-                    double energy = o->radius * o->radius * other->spectrum->total_power / (4 * distance_sq);
-
-                    if (o->type == PHYSOBJECT_SMART)
-                    {
-                        struct SmartPhysicsObject *s = (SPO *)o;
-                        CollisionMsg cm;
-                        cm.client_id = s->client_id;
-                        cm.server_id = o->phys_id;
-                        Vector3_scale(&pd, 1.0 / Vector3_length(&pd));
-                        cm.direction = pd;
-                        Vector3_scale(&pd, o->radius);
-                        cm.position = pd;
-                        cm.energy = energy;
-                        cm.comm_msg = NULL;
-                        cm.spectrum = Spectrum_clone(other->spectrum);
-                        //! @todo Ok, this four-character string is starting to feel forced.
-                        cm.set_colltype((char *)"RADN");
-                        cm.spec_all();
-
-                        // Note that there is no comm message, so that's unspecced.
-                        cm.specced[cm.num_el - 4] = false;
-                        cm.send(s->socket);
-                    }
-                    else if (o->type == PHYSOBJECT)
+                    if ((island_of[moved[j]] != id) && aabb_overlap(&moved[i]->box, &moved[j]->box))
                     {
-                        PhysicsObject_resolve_damage(o, energy, u->params.health_damage_threshold);
+                        pairs.push_back({moved[i], moved[j]});
                     }
                 }
             }
         }
 
-        u->get_grav_pull(&g, o);
-        PhysicsObject_tick(o, &g, dt);
-    }
-
-    // Append a value to the end of a list, assuming there's enough room, if it's not already in the list
-    // Return whether or not the value was added to the list (true if it was added, false if it was already
-    // there.)
-    bool unique_append(size_t *list, size_t max_index, size_t val)
-    {
-        for (size_t i = 0; i < max_index; i++)
+        // The same pair can turn up from both of its islands. Ordering them by ID, rather than by
+        // where they happen to be in memory, keeps the order of the events the same from run to run.
+        for (size_t i = 0; i < pairs.size(); i++)
         {
-            if (val == list[i])
+            if (pairs[i].obj2->phys_id < pairs[i].obj1->phys_id)
             {
-                return false;
+                std::swap(pairs[i].obj1, pairs[i].obj2);
             }
         }
+        std::sort(pairs.begin(), pairs.end(), [](const struct BroadPhasePair &a, const struct BroadPhasePair &b)
+                  { return (a.obj1->phys_id < b.obj1->phys_id) ||
+                           ((a.obj1->phys_id == b.obj1->phys_id) && (a.obj2->phys_id < b.obj2->phys_id)); });
 
-        list[max_index] = val;
-        return true;
+        for (size_t i = 0; i < pairs.size(); i++)
+        {
+            if ((i > 0) && (pairs[i].obj1 == pairs[i - 1].obj1) && (pairs[i].obj2 == pairs[i - 1].obj2))
+            {
+                continue;
+            }
+
+            struct PhysCollisionEvent ev;
+            if (check_collision_single(this, pairs[i].obj1, pairs[i].obj2, dt, ev))
+            {
+                collisions.push_back(ev);
+            }
+        }
     }
 
     void Universe::handle_expired()
@@ -1795,6 +3700,11 @@ namespace Diana
                             smarties.erase(*it);
                         }
 
+                        if (broadphase != NULL)
+                        {
+                            broadphase->remove(po);
+                        }
+
                         if (phys_objects[i]->emits_gravity)
                         {
                             // This is nicer to read than the iterator in the for loop method.
@@ -1806,6 +3716,7 @@ namespace Diana
                                     break;
                                 }
                             }
+                            AttractorSet_remove(&attractor_set, *it);
                         }
 
                         if (phys_objects[i]->dangerous_radiation)
@@ -1821,9 +3732,14 @@ namespace Diana
                             }
                         }
 
+                        remove_rails(po);
                         free(po->spectrum);
                         free(po);
                         phys_objects.erase(phys_objects.begin() + i);
+                        if (i < num_sorted)
+                        {
+                            num_sorted--;
+                        }
                         it = expired.erase(it);
                         i--;
                         break;
@@ -1860,14 +3776,23 @@ namespace Diana
                 case PHYSOBJECT:
                 {
                     phys_objects.push_back(added[i]);
+                    if (broadphase != NULL)
+                    {
+                        broadphase->insert(added[i]);
+                    }
                     if (added[i]->emits_gravity)
                     {
                         attractors.push_back(added[i]);
+                        AttractorSet_add(&attractor_set, added[i]);
                     }
                     if (added[i]->dangerous_radiation)
                     {
                         radiators.push_back(added[i]);
                     }
+                    if (added[i]->rails != NULL)
+                    {
+                        add_rails(added[i]);
+                    }
                     break;
                 }
                 case PHYSOBJECT_SMART:
@@ -1876,14 +3801,23 @@ namespace Diana
                     //! @todo Check to make sure this smarty adding is right.
                     smarties[obj->pobj.phys_id] = obj;
                     phys_objects.push_back(added[i]);
+                    if (broadphase != NULL)
+                    {
+                        broadphase->insert(added[i]);
+                    }
                     if (added[i]->emits_gravity)
                     {
                         attractors.push_back(added[i]);
+                        AttractorSet_add(&attractor_set, added[i]);
                     }
                     if (added[i]->dangerous_radiation)
                     {
                         radiators.push_back(added[i]);
                     }
+                    if (added[i]->rails != NULL)
+                    {
+                        add_rails(added[i]);
+                    }
                     break;
                 }
                 case BEAM_COMM:
@@ -1927,316 +3861,172 @@ namespace Diana
         //! @todo Have some concept of collision destruction criteria here.
         //! @todo Temporally ordered collision resolution. (See multi-level collision detection)
 
+        // Anything on rails starts the tick wherever its rails say it should be.
+        move_rails(total_time);
+
         metrics.num_objects = phys_objects.size();
         if (phys_objects.size() > 1)
         {
+            // The number of work items to split up among the workers, which is either the number
+            // of objects in the sorted list, or the number of pairs from the broad-phase structure.
+            size_t num_items;
+
             t0 = HRN;
-            sort_aabb(dt, true);
+            if (broadphase == NULL)
+            {
+                partition_huge();
+                sort_aabb(dt, true);
+                num_items = num_sorted;
+            }
+            else
+            {
+                for (size_t i = 0; i < phys_objects.size(); i++)
+                {
+                    estimate_box(phys_objects[i], dt);
+                }
+                broadphase->update();
+                broadphase->get_pairs(candidate_pairs);
+                metrics.collision_metrics.cache_hits = broadphase->cache_hits;
+                metrics.collision_metrics.cache_misses = broadphase->cache_misses;
+                num_items = candidate_pairs.size();
+            }
             metrics.sort_aabb_ns = HRN - t0;
 
             // How many worker threads, in addition to this main thread.
             // In single-threaded operation, this will result in `n == 0`
-            int32_t n = (int32_t)(phys_objects.size() / MIN_OBJECTS_PER_THREAD);
+            int32_t n = (int32_t)(num_items / MIN_OBJECTS_PER_THREAD);
             n = CLAMP(0, n, num_threads - 1);
 
             // If we're using more than 1 thread, try to split them evenly.
             // Note that this clamps (rounds) down in absolute value, so we'll have extra slack
             // that we'll need to pick up at the end.
-            int32_t d = (int32_t)(phys_objects.size() / (n + 1));
+            int32_t d = (int32_t)(num_items / (n + 1));
 
-            // Reserve one spot for this main thread, all others get primed for work.
-            for (int i = 0; i < n; i++)
+            for (int i = 0; i <= n; i++)
             {
                 phys_worker_args[i].offset = i * d;
                 phys_worker_args[i].stride = d;
                 phys_worker_args[i].dt = dt;
-                phys_worker_args[i].done = false;
-                phys_worker_args[i].test_all = false;
-                // sched->add_work(thread_check_collisions, &phys_worker_args[i], NULL, libodb::Scheduler::NONE);
-                metrics.collision_metrics.add(check_collision_loop(&phys_worker_args[i]));
+                phys_worker_args[i].obj = NULL;
+                phys_worker_args[i].collisions.clear();
             }
 
-            // Save one work unit for this thread, so it isn't just sitting doing nothing useful.
-            phys_worker_args[n].offset = n * d;
-            // Also note that it has to pick up slack objcts not accounted for by the other threads
+            // The last work unit has to pick up slack items not accounted for by the others.
             // There's at most num_threads-1 such slack, so it isn't going to affect computation time a lot.
-            phys_worker_args[n].stride = phys_objects.size() - (n * d);
-            phys_worker_args[n].dt = dt;
-            phys_worker_args[n].done = false;
-            phys_worker_args[n].test_all = false;
-            metrics.collision_metrics.add(check_collision_loop(&phys_worker_args[n]));
+            phys_worker_args[n].stride = num_items - (n * d);
+
+            // The huge objects get a work unit of their own, in the extra slot past the threads.
+            struct phys_args *huge_args = &phys_worker_args[num_threads];
+            huge_args->dt = dt;
+            huge_args->collisions.clear();
+            int32_t num_units = n + 1;
+            if ((broadphase == NULL) && (num_sorted < phys_objects.size()))
+            {
+                num_units++;
+            }
+            metrics.num_huge_objects = (broadphase == NULL ? phys_objects.size() - num_sorted : 0);
+
+            // Every thread in the pool, including this one, claims work units until there are none left.
+            workers->run(num_units, [this, n](size_t i)
+                         { thread_check_collisions(&phys_worker_args[(int32_t)i <= n ? i : num_threads]); });
 
             // Wait for the workers to report that they are done.
-            // This depends on the volatility of their 'done' variable. We don't need
-            // atomicity, but we need it to break cache.
             t0 = HRN;
-            for (int i = 0; i < n; i++)
+            workers->join();
+            metrics.thread_join_wait_ns = HRN - t0;
+
+            // Gather the collisions from each worker in order, so that the list is the same
+            // regardless of how many threads were involved or which finished first.
+            for (int i = 0; i <= n; i++)
             {
-                while (!phys_worker_args[i].done)
+                metrics.collision_metrics.add(phys_worker_args[i].metrics);
+                collisions.insert(collisions.end(), phys_worker_args[i].collisions.begin(), phys_worker_args[i].collisions.end());
+                phys_worker_args[i].collisions.clear();
+            }
+            if (num_units > n + 1)
+            {
+                metrics.collision_metrics.add(huge_args->metrics);
+                collisions.insert(collisions.end(), huge_args->collisions.begin(), huge_args->collisions.end());
+                huge_args->collisions.clear();
+            }
+
+            // Sleeping objects that an awake object came near enough to test against are woken up,
+            // whether or not they actually collided.
+            for (int32_t i = 0; i <= num_threads; i++)
+            {
+                for (size_t j = 0; j < phys_worker_args[i].wakes.size(); j++)
                 {
+                    PhysicsObject_wake(phys_worker_args[i].wakes[j]);
                 }
+                phys_worker_args[i].wakes.clear();
             }
-            metrics.thread_join_wait_ns = HRN - t0;
 
-            // Set this once, we'll use it in all loops in the following.
-            phys_worker_args[0].dt = dt;
-            phys_worker_args[0].stride = 1;
-            phys_worker_args[0].done = false;
-            phys_worker_args[0].test_all = true;
-
-            // At this point all collisions should be in the collision list.
-            // Sort it by time of collisions (everything should be >= 0), and then resolve them one by one
-            // Each collision resolution should have the following steps:
+            // At this point all collisions should be in the collision list, and they're resolved in time
+            // order. Each collision resolution should have the following steps:
             // - The effects are applied to the two objects, including updating how 'far' into the tick
             //    the collisions have taken the objects ths far.
-            // - Any collisions involving either of the two involved objects are discarded from the vector
-            // - The two objects are re-collided with all other objects
-            //   > Test the sizes of the vector before and after the re-collide, any collisions resulting
-            //     from that operation will require a re-sort of the list. Don't re-sort if there's no new events.
-
-            // WHether or not to re-sort the vector after handling a collision, this will be determined by whether
-            // a collision resolution results in new collisions being added.
-            bool re_sort = true;
-
-            // For any smart objects, we'll need this, so pre-set some values.
-            CollisionMsg cm;
-            cm.set_colltype((char *)"PHYS");
-            cm.comm_msg = NULL;
-            cm.spec_all();
-
-            // Since this is a physical collision, there's no spectrum attached.
-            cm.spectrum = NULL;
-            cm.specced[cm.num_el - 1] = false;
-            cm.specced[cm.num_el - 2] = false;
-            cm.specced[cm.num_el - 3] = false;
-
-            // The value in params.max_simultaneous_collision_rounds defines the number of rounds that we'll consider
-            // multiple collision at the same instant.
-            // After this cutoff, only one collision per instant is considered, and the rest discarded for the sake
-            // of interactivity. After enough rounds, the eventual effects of the extra energy distribution will be
-            // negligible.
+            // - Any collisions involving either of the two involved objects are now stale. Rather than
+            //   finding and removing them, the generation of each object is bumped, and stale events
+            //   are recognised and dropped as they come off of the heap.
+            // - The two objects are re-collided with their neighbours, and any new events pushed on the heap.
+            //
+            // Collisions that don't share any objects, directly or through other collisions, can't affect
+            // each other, so the collisions are split into islands that are resolved on separate threads.
+            // An island stops as soon as it runs into an object outside of itself, and once they've all
+            // stopped, whatever they ran into is tested and the whole thing starts over with the collisions
+            // that are left.
 
             // Number of rounds of collisions we've gone through, for fun.
             uint32_t n_rounds = 0;
+            // The most rounds that any island has been through, which the next set of islands carry on from,
+            // so that params.max_simultaneous_collision_rounds still limits how long an island can go on for.
+            uint32_t base_round = 0;
 
             t0 = HRN;
-            while (collisions.size() != 0)
-            {
-                n_rounds++;
-                // If we need to, re-sort collisions by time in the interval.
-                if (re_sort && (collisions.size() > 1))
-                {
-                    std::sort(collisions.begin(), collisions.end(),
-                              [](struct PhysCollisionEvent &a, struct PhysCollisionEvent &b)
-                              { return a.pcr.t < b.pcr.t; });
-                }
-
-                // Simultaneous collision handling is not obvious, but ends up working out to be not too complex.
-                //
-                // We need to ensure conservation of momentum and energy in all of the simultenaous collisions that
-                // involve a specific object, the object can't end up with more energy or momentum as a result of
-                // the combined effects of multiple collisions than was present in the original system (of all
-                // objects of interest). This actually turns out to come for 'free' in some sense as a consequence
-                // of the conservation of momentuem/energy in the two-body case.
-                //
-                // Because the elastic collision of two objects can be reduced to a one-dimensional problem, they
-                // are easy to solve, and the solution conserves momentum and energy in that two-object system.
-                // This can be extended to address N-body collisions, but considering all necessary two-body
-                // collisions, each of which conserves energy/momentum, and applying all of their effects in
-                // summation only gets us part way. That is, each collisions results in a delta-v for each object,
-                // and so applying the sum of all delta-v (to both objects) in all collisions involving an object
-                // will result in a conserved system still MOMENTUM conserved system, but not energy.
-                //
-                // To regain energy conservation, it is important to realize that, in a collision, an object
-                // exchanges more energy with it's neighbours than it possessed in the original system. This results
-                // in a final system that contains more energy than the original system possessed. To reconcile this
-                // it is possible to calculate the energy in the final system, and original system, which will be
-                // related by E'=kE, with k>=1. Conservation can be regained by scaling all resulting velocities
-                // by 1/sqrt(k).
-                //
-                // IMPORTANT NOTE: This approximation is physically incorrect, since it will return conservation of
-                // energy, but destroy conservation of momentum. This is a fine approximation, since it results in
-                // a system that has a slightly too 'spread-out' (in some sense) set of resulting velocities. But
-                // at least the magnitudes, directions, and energiers are approximately, and qualitatively, right.
-                //
-                // The only tricky part is ensuring that we're keeping the dt stepping of each object correct.
-
-                // Now resolve the collisions on the objects, setting the time-delta to be the time from the last-moved
-                // time of the object we're moving, to the time that this collision happened
-                // Note that we're setting the object's ticked time to an actual amount of interval simulated time, not a
-                // proportion of the interval.
-                //
-                // The proportional time-interval value, 't' in the physics collicion result, is the proportion of the
-                // original total interval. We want to pass the time elapsed since the last notable event to the
-                // collision resolution code. This elapsed time is the proportion times dt, since we do the consideration
-                // earlier that ensures that any collisions that we're considering are happening in the future, and
-                // within the remainder of the time interval, of ALL objects involved.
-
-                // Keep track of the number of simultaneous collisions, we'll need to use this information for discarding
-                // invalidated future collisions
-                size_t n_simultaneous = 0;
-
-                // A list of all objects involved in the collisions
-                size_t *objs = (size_t *)malloc(sizeof(size_t) * 2 * collisions.size());
-                if (objs == NULL)
-                {
-                    throw std::runtime_error("Universe::Tick::UnableToAllocateObjectList");
-                }
-
-                // Number of distinct objects we've encountered so far.
-                size_t n_objs = 0;
-                double energy0 = 0.0;
-
-                while ((n_simultaneous < collisions.size()) &&
-                       (Vector3_almost_zeroS(collisions[0].pcr.t - collisions[n_simultaneous].pcr.t)))
-                {
-                    // For each collision that happens at the same time as the first, apply it to the objects involved
-                    // Retrieve the earliest collision details.
-                    struct PhysCollisionEvent collision_event = collisions[n_simultaneous];
-                    struct PhysicsObject *obj1 = collision_event.obj1;
-                    struct PhysicsObject *obj2 = collision_event.obj2;
-                    struct PhysCollisionResult phys_result = collision_event.pcr;
-
-                    if ((n_rounds == 1) && params.verbose_logging)
-                    {
-#if __x86_64__
-                        fprintf(stderr, "%g Collision: %lu <-> %lu (%.15g J)\n", this->time(), obj1->phys_id, obj2->phys_id, phys_result.e);
-#else
-                        fprintf(stderr, "%g Collision: %llu <-> %llu (%.15g J)\n", this->time(), obj1->phys_id, obj2->phys_id, phys_result.e);
-#endif
-                    }
-
-                    // Note that when applying the collision, we need to make sure that each object is observing the
-                    // correct time-delta to have elapsed since their last physics event. This is why we take the
-                    // collision results 't' parameter portion of the total tick time (t*dt), and subtract off the
-                    // object's alread-ticked time. This gives us the delta since the last time that object had it's
-                    // velocity accounted for.
-
-                    // Have we already seen the object in question? (Does it exist in the objs array) Should be true
-                    // if this is a new object not in the array.
-                    bool never_seen;
-
-                    // While we're at it, keep track of all distinct objects that we've collided by adding/counting them
-                    // in the array, in case we haven't seen them already. Additionally, take this time to calculate the
-                    // kinetic energy of all objects before any collisions are taken into consideration, store it in
-                    // energy0.
-                    never_seen = unique_append(objs, n_objs, collision_event.obj1_index);
-                    n_objs += never_seen;
-                    energy0 += (never_seen ? obj1->mass * Vector3_length2(&obj1->velocity) : 0.0);
-                    PhysicsObject_collision(obj1, obj2, phys_result.e, never_seen * phys_result.t * dt, &phys_result.pce1, params.health_damage_threshold);
-                    never_seen = unique_append(objs, n_objs, collision_event.obj2_index);
-                    n_objs += never_seen;
-                    energy0 += (never_seen ? obj2->mass * Vector3_length2(&obj2->velocity) : 0.0);
-                    PhysicsObject_collision(obj2, obj1, phys_result.e, never_seen * phys_result.t * dt, &phys_result.pce2, params.health_damage_threshold);
-
-                    //! @todo This messaging should probably be done asynchronously, out of the physics code,
-                    //! but I don't think, in general, this will cause much of a problem for a 60hz
-                    //! physics refrecsh rate.
-
-                    // Alert the smarties that there was a collision, if either re smart.
-                    // Only physical collisions are generated here, beams are elsewhere.
-                    cm.energy = phys_result.e;
-
-                    if (obj1->type == PHYSOBJECT_SMART)
-                    {
-                        SPO *s = (SPO *)obj1;
-                        cm.client_id = s->socket;
-                        cm.server_id = obj1->phys_id;
-                        cm.direction = phys_result.pce1.d;
-                        cm.position = phys_result.pce1.p;
-                        cm.send(s->socket);
-                    }
-
-                    if (obj2->type == PHYSOBJECT_SMART)
-                    {
-                        SPO *s = (SPO *)obj2;
-                        cm.client_id = s->socket;
-                        cm.server_id = obj2->phys_id;
-                        cm.direction = phys_result.pce2.d;
-                        cm.position = phys_result.pce2.p;
-                        cm.send(s->socket);
-                    }
-
-                    n_simultaneous++;
-
-                    // To prevent hanging in the situation where there's a constant feedback of collisions,
-                    // limit the number of rounds we'll support.
-                    if (n_rounds > params.max_simultaneous_collision_rounds)
-                    {
-                        break;
-                    }
-                }
-
-                // The scaling factor for the post-collision velocities to restore energy conservation, if there is
-                // only one collision, then the two-body solution conserves energy.
-                double k = 1.0;
-                if (n_simultaneous > 1)
+            while (collisions.size() > 0)
+            {
+                build_islands();
+                for (size_t i = 0; i < islands.size(); i++)
                 {
-                    // Post-collision system energy
-                    double energy1 = 0.0;
-                    for (size_t i = 0; i < n_objs; i++)
-                    {
-                        energy1 += phys_objects[objs[i]]->mass * Vector3_length2(&phys_objects[objs[i]]->velocity);
-                    }
-
-                    // If there's more than one collision, then this factor is the ratio of original to final
-                    // energy.
-                    k = sqrt(energy0 / energy1);
+                    islands[i].round = base_round;
                 }
 
-                // Note that these collisions have invalidated the correctness of future collisions, so we need to discard
-                // all future collisions that involve any object that we've already considered, as well as the first
-                // n_simultaneous events, because those have been applied to the world.
-                // @todo There's a bunch of O(N) and other expensive events happening here...
-                // Only both if there's collisions that didn't happen 'now'.
-                for (size_t i = 0; i < n_objs; i++)
+                workers->run(islands.size(), [this, dt](size_t i)
+                             { resolve_island(&islands[i], dt); });
+                workers->join();
+
+                // Gather up the results in island order, so that they're the same regardless of how many
+                // threads were involved or which finished first.
+                uint32_t max_round = base_round;
+                for (size_t i = 0; i < islands.size(); i++)
                 {
-                    Vector3_scale(&phys_objects[objs[i]]->velocity, k);
-                    if (collisions.size() > n_simultaneous)
+                    struct CollisionIsland &island = islands[i];
+                    metrics.collision_metrics.add(island.metrics);
+                    metrics.multicollision_metrics.add(island.retest_metrics);
+                    n_rounds += island.round - base_round;
+                    max_round = MAX(max_round, island.round);
+                    collisions.insert(collisions.end(), island.events.begin(), island.events.end());
+                    collision_messages.insert(collision_messages.end(), island.messages.begin(), island.messages.end());
+                    island.messages.clear();
+
+                    for (size_t j = 0; j < island.resolved_objects.size(); j++)
                     {
-                        for (std::vector<struct PhysCollisionEvent>::iterator it = collisions.begin() + n_simultaneous; it != collisions.end();)
+                        if (resolved_set.insert(island.resolved_objects[j]).second)
                         {
-                            if ((objs[i] == (*it).obj1_index) || (objs[i] == (*it).obj2_index))
-                            {
-                                it = collisions.erase(it);
-                            }
-                            else
-                            {
-                                it++;
-                            }
+                            resolved_objects.push_back(island.resolved_objects[j]);
                         }
                     }
                 }
-                // Note that n_simultaneous >= 1, so this is well defined. This could be handled in the above loop, but
-                // in theory this is a little bit less inefficient.
-                collisions.erase(collisions.begin(), collisions.begin() + n_simultaneous);
-
-                // Re-collide the affected objects by calling back to check_collision_loop() with appropriate args.
-                // Remaining time left in the tick is the total time minus what has been accounted for so far.
-                // Note that obj1 and obj2 should have identical values here, that should be assert()-able
-                //
-                // Note that, really, EVERY physics object should be ticked to this point. All further comparisons
-                // can assume that other physics objects are 'valid' up until the point of the collision we just
-                // resolved. It's important to note, as well, that we have to consider the whole tick event for every
-                // object, and we will have to consider the 't' parameter of objects, to make sure we're still within
-                // the interval of the objects of interest. This consideration is done in check_collision_single().
+                base_round = max_round;
 
-                // Keep track of pre-recollide size, and if it changes, we'll know we have to re-sort on the next loop.
-                size_t pre_size = collisions.size();
-                for (size_t i = 0; i < n_objs; i++)
+                resolved_boxes.resize(resolved_objects.size());
+                for (size_t i = 0; i < resolved_objects.size(); i++)
                 {
-                    struct PhysicsObject *o = phys_objects[objs[i]];
-                    PhysicsObject_estimate_aabb(o, &o->box, phys_worker_args[0].dt);
-                    phys_worker_args[0].offset = objs[i];
-                    metrics.multicollision_metrics.add(check_collision_loop(&phys_worker_args[0]));
+                    resolved_boxes[i] = resolved_objects[i]->box;
                 }
-                // If our vector isn't the same size as before we re-collided, then we'll have to re-sort.
-                re_sort = (collisions.size() != pre_size);
 
-                //! @todo This is inefficient, realloc()?
-                free(objs);
-                objs = NULL;
-                metrics.collision_metrics.simultaneous_collisions += n_simultaneous;
+                check_island_boundaries(dt);
+                island_of.clear();
             }
 
             if ((n_rounds > 1) && params.verbose_logging)
@@ -2244,25 +4034,56 @@ namespace Diana
                 printf("Collision set required %u rounds\n", n_rounds);
             }
 
+            collisions.clear();
+            islands.clear();
+            resolved_objects.clear();
+            resolved_boxes.clear();
+            resolved_set.clear();
+
             metrics.collision_metrics.collision_rounds += n_rounds;
         }
         metrics.collision_resolution_ns = HRN - t0;
 
         t0 = HRN;
-        // Now tick along each object, handling any gravity and radiation while we're at it
+        // Now handle any beams and radiation hitting each object, a block of objects at a time.
+        index_beams(dt);
+        const size_t block = 64;
+        size_t num_blocks = (phys_objects.size() + block - 1) / block;
+        tick_effects.resize(num_blocks);
+        workers->run(num_blocks, [this, dt, block](size_t b)
+                     {
+                         size_t end = std::min((b + 1) * block, phys_objects.size());
+                         for (size_t i = b * block; i < end; i++)
+                         {
+                             obj_tick(this, phys_objects[i], dt, &tick_effects[b]);
+                         } });
+        workers->join();
+        apply_tick_effects();
+
+        // Then move everything. The attractors go first, among themselves, and then everything
+        // else follows against where they ended up.
+        tick_attractors(dt, metrics);
+        tick_particles(dt, metrics);
+        metrics.object_tick_ns = HRN - t0;
+
         for (size_t i = 0; i < phys_objects.size(); i++)
         {
-            obj_tick(this, phys_objects[i], dt);
+            metrics.num_asleep_objects += phys_objects[i]->asleep;
         }
-        metrics.object_tick_ns = HRN - t0;
+        metrics.num_awake_objects = phys_objects.size() - metrics.num_asleep_objects;
 
         // Now tick along each beam while we're here because we won't be
         // needing to reference them afer this.
         t0 = HRN;
-        for (size_t bi = 0; bi < beams.size(); bi++)
-        {
-            Beam_tick(beams[bi], dt);
-        }
+        num_blocks = (beams.size() + block - 1) / block;
+        workers->run(num_blocks, [this, dt, block](size_t b)
+                     {
+                         size_t end = std::min((b + 1) * block, beams.size());
+                         for (size_t bi = b * block; bi < end; bi++)
+                         {
+                             Beam_tick(beams[bi], dt);
+                         } });
+        workers->join();
         metrics.beam_tick_ns = HRN - t0;
 
         t0 = HRN;
@@ -2280,9 +4101,331 @@ namespace Diana
         // Unlock everything
         UNLOCK(phys_lock);
 
+        send_tick_messages();
+
         return metrics;
     }
 
+    void Universe::apply_tick_effects()
+    {
+        // Every query has to be in place before its message goes out, or the response could come
+        // back before there's anything waiting for it.
+        LOCK(query_lock);
+        for (size_t b = 0; b < tick_effects.size(); b++)
+        {
+            std::vector<std::pair<struct scan_target, struct scan_origin>> &pending = tick_effects[b].queries;
+            for (size_t i = 0; i < pending.size(); i++)
+            {
+                // Ignore multiple hits of the same beam/object pair.
+                // Could, in theory, use a multimap for queries instead, but really, multiple hits are spurious.
+                if (queries.count(pending[i].first) == 0)
+                {
+                    queries[pending[i].first] = pending[i].second;
+                }
+                else
+                {
+                    struct Beam *b_copy = pending[i].second.origin_beam;
+                    free(b_copy->scan_target->obj_type);
+                    free(b_copy->scan_target->spectrum);
+                    free(b_copy->scan_target);
+                    free(b_copy->spectrum);
+                    free(b_copy);
+                }
+            }
+            pending.clear();
+        }
+        UNLOCK(query_lock);
+
+        for (size_t b = 0; b < tick_effects.size(); b++)
+        {
+            for (size_t i = 0; i < tick_effects[b].beams.size(); i++)
+            {
+                add_object(tick_effects[b].beams[i]);
+            }
+            tick_effects[b].beams.clear();
+        }
+    }
+
+    // Send each of a list of held back messages on its socket, in order, and delete it.
+    static void send_messages(std::vector<std::pair<int32_t, BSONMessage *>> &messages)
+    {
+        for (size_t i = 0; i < messages.size(); i++)
+        {
+            BSONMessage *msg = messages[i].second;
+            switch (msg->msg_type)
+            {
+            case BSONMessage::MessageType::Collision:
+                ((CollisionMsg *)msg)->send(messages[i].first);
+                break;
+            case BSONMessage::MessageType::ScanQuery:
+                ((ScanQueryMsg *)msg)->send(messages[i].first);
+                break;
+            case BSONMessage::MessageType::ScanResult:
+                ((ScanResultMsg *)msg)->send(messages[i].first);
+                break;
+            default:
+                throw std::runtime_error("Universe::UnsendableMessage");
+            }
+            delete msg;
+        }
+        messages.clear();
+    }
+
+    void Universe::send_tick_messages()
+    {
+        // Collisions were resolved before the objects were ticked, so their messages go first.
+        send_messages(collision_messages);
+        for (size_t b = 0; b < tick_effects.size(); b++)
+        {
+            send_messages(tick_effects[b].messages);
+        }
+    }
+
+    // A body read from a rails file, before it's spawned.
+    struct RailsBody
+    {
+        std::string name;
+        double mass;
+        double radius;
+        //! Julian dates, positions and velocities of each sample, in the order they were read.
+        std::vector<double> dates;
+        std::vector<struct Vector3> positions;
+        std::vector<struct Vector3> velocities;
+        struct PhysicsObject *obj;
+    };
+
+    // Split a line of a rails file on commas, without the surrounding whitespace.
+    static std::vector<std::string> split_csv(const char *line)
+    {
+        std::vector<std::string> parts;
+        const char *start = line;
+        while (true)
+        {
+            const char *end = start;
+            while ((*end != ',') && (*end != '\0') && (*end != '\n') && (*end != '\r'))
+            {
+                end++;
+            }
+
+            const char *l = start;
+            const char *u = end;
+            while ((l < u) && ((*l == ' ') || (*l == '\t')))
+            {
+                l++;
+            }
+            while ((u > l) && ((*(u - 1) == ' ') || (*(u - 1) == '\t')))
+            {
+                u--;
+            }
+            parts.push_back(std::string(l, u - l));
+
+            if (*end != ',')
+            {
+                break;
+            }
+            start = end + 1;
+        }
+        return parts;
+    }
+
+    static double parse_double(const std::string &s)
+    {
+        char *end = NULL;
+        double v = strtod(s.c_str(), &end);
+        if ((s.size() == 0) || (*end != '\0'))
+        {
+            throw std::runtime_error("Universe::RailsFileFormat");
+        }
+        return v;
+    }
+
+    // Where a body from a rails file is at the given universe time, as far as the file says. Bodies
+    // with a single sample are assumed to be there whenever they're asked about.
+    static void rails_body_state(struct RailsBody *body, double t, V3 *position, V3 *velocity)
+    {
+        if (body->dates.size() == 1)
+        {
+            *position = body->positions[0];
+            *velocity = body->velocities[0];
+            return;
+        }
+
+        EphemerisTable_evaluate(&body->obj->rails->table, t, position, velocity);
+    }
+
+    void Universe::load_rails(const char *path)
+    {
+        FILE *fp = fopen(path, "r");
+        if (fp == NULL)
+        {
+            throw std::runtime_error("Universe::RailsFileOpen");
+        }
+
+        try
+        {
+            load_rails(fp);
+        }
+        catch (...)
+        {
+            fclose(fp);
+            throw;
+        }
+        fclose(fp);
+    }
+
+    void Universe::load_rails(FILE *fp)
+    {
+        // Bodies are keyed, and spawned in order of, their NAIF IDs.
+        std::map<int64_t, struct RailsBody> bodies;
+        char line[1024];
+        while (fgets(line, sizeof(line), fp) != NULL)
+        {
+            std::vector<std::string> parts = split_csv(line);
+            if ((parts.size() < 4) || (parts[0].size() == 0))
+            {
+                continue;
+            }
+
+            int64_t id = (int64_t)parse_double(parts[1]);
+            std::map<int64_t, struct RailsBody>::iterator it = bodies.find(id);
+            if (it == bodies.end())
+            {
+                struct RailsBody body;
+                body.name = parts[2] + " (" + parts[1] + ")";
+                body.mass = -1.0;
+                body.radius = -1.0;
+                body.obj = NULL;
+                it = bodies.insert(std::make_pair(id, body)).first;
+            }
+            struct RailsBody &body = it->second;
+
+            // The file is in kilometres and kilometres per second, like the JPL Horizons vectors
+            // that it comes from.
+            if (parts[0] == "M")
+            {
+                body.mass = parse_double(parts[3]);
+            }
+            else if (parts[0] == "R")
+            {
+                body.radius = 1000 * parse_double(parts[3]);
+            }
+            else if (parts[0] == "P")
+            {
+                if (parts.size() < 11)
+                {
+                    throw std::runtime_error("Universe::RailsFileFormat");
+                }
+
+                V3 position = {1000 * parse_double(parts[5]), 1000 * parse_double(parts[6]), 1000 * parse_double(parts[7])};
+                V3 velocity = {1000 * parse_double(parts[8]), 1000 * parse_double(parts[9]), 1000 * parse_double(parts[10])};
+                body.dates.push_back(parse_double(parts[3]));
+                body.positions.push_back(position);
+                body.velocities.push_back(velocity);
+            }
+        }
+
+        // The earliest sample in the file is taken to be now.
+        double date0 = INFINITY;
+        std::map<int64_t, struct RailsBody>::iterator it;
+        for (it = bodies.begin(); it != bodies.end(); ++it)
+        {
+            struct RailsBody &body = it->second;
+            if ((body.mass <= 0.0) || (body.radius <= 0.0) || (body.dates.size() == 0))
+            {
+                throw std::runtime_error("Universe::RailsFileIncomplete");
+            }
+
+            for (size_t i = 0; i < body.dates.size(); i++)
+            {
+                date0 = MIN(date0, body.dates[i]);
+            }
+        }
+
+        for (it = bodies.begin(); it != bodies.end(); ++it)
+        {
+            struct RailsBody &body = it->second;
+
+            PO *obj = (PO *)malloc(sizeof(PO));
+            if (obj == NULL)
+            {
+                throw std::runtime_error("OOM::Universe::LoadRails");
+            }
+            V3 zero = {0.0, 0.0, 0.0};
+            PhysicsObject_init(obj, this, &body.positions[0], &body.velocities[0], &zero, &zero,
+                               body.mass, body.radius, copy_string(body.name.c_str()), NULL);
+            body.obj = obj;
+
+            if (body.dates.size() > 1)
+            {
+                // A run of samples is followed exactly, wherever the file puts the body.
+                obj->rails = new struct Rails();
+                obj->rails->type = RAILS_TABLE;
+                obj->rails->parent = NULL;
+
+                std::vector<size_t> order(body.dates.size());
+                for (size_t i = 0; i < order.size(); i++)
+                {
+                    order[i] = i;
+                }
+                std::sort(order.begin(), order.end(), [&body](size_t a, size_t b)
+                          { return body.dates[a] < body.dates[b]; });
+
+                for (size_t i = 0; i < order.size(); i++)
+                {
+                    double t = total_time + (body.dates[order[i]] - date0) * 86400.0;
+                    EphemerisTable_add(&obj->rails->table, t, &body.positions[order[i]], &body.velocities[order[i]]);
+                }
+            }
+        }
+
+        // Only once every body has an object, since moons come before their planets by ID.
+        for (it = bodies.begin(); it != bodies.end(); ++it)
+        {
+            int64_t id = it->first;
+            struct RailsBody &body = it->second;
+            PO *obj = body.obj;
+
+            if (body.dates.size() == 1)
+            {
+                // Moons go around their planets, and everything else around the Sun, following
+                // the NAIF numbering. A body with nothing to go around is left free.
+                int64_t parent_id = (((id > 100) && (id < 1000) && ((id % 100) != 99)) ? (id / 100) * 100 + 99 : 10);
+                std::map<int64_t, struct RailsBody>::iterator parent = bodies.find(parent_id);
+                if ((parent_id != id) && (parent != bodies.end()))
+                {
+                    struct RailsBody &p = parent->second;
+                    double epoch = total_time + (body.dates[0] - date0) * 86400.0;
+                    V3 position;
+                    V3 velocity;
+                    rails_body_state(&p, epoch, &position, &velocity);
+                    Vector3_subtract(&position, &body.positions[0], &position);
+                    Vector3_subtract(&velocity, &body.velocities[0], &velocity);
+
+                    struct KeplerOrbit orbit;
+                    try
+                    {
+                        KeplerOrbit_from_state(&orbit, params.gravitational_constant * (p.mass + body.mass), &position, &velocity, epoch);
+                        obj->rails = new struct Rails();
+                        obj->rails->type = RAILS_KEPLER;
+                        obj->rails->orbit = orbit;
+                        obj->rails->parent = p.obj;
+                    }
+                    catch (std::runtime_error &e)
+                    {
+                        // Anything not bound to its parent, like a comet passing through, moves
+                        // freely under gravity instead.
+                        if (params.verbose_logging)
+                        {
+                            fprintf(stderr, "Leaving %s off of rails: %s\n", body.name.c_str(), e.what());
+                        }
+                    }
+                }
+            }
+
+            add_object(obj);
+        }
+    }
+
     void Universe::update_list(struct PhysicsObject *obj, std::vector<struct PhysicsObject *> *list, bool newval, bool oldval)
     {
         // If it's a current candidate, and the old value indicates it wasn't before, then
@@ -297,6 +297,93 @@ namespace Diana
         Vector3_rotate_around(up, forward, angles->z);
     }
 
+    void Vector4_apply_ypr(V4* q, V3* angles)
+    {
+        // The turn as a rotation vector in the object's own frame of forward, right, and up.
+        // Vector3_rotate_around() turns clockwise about its axis, hence the signs.
+        double rx = -angles->z;
+        double ry = -angles->y;
+        double rz = -angles->x;
+        double theta2 = rx * rx + ry * ry + rz * rz;
+        if (Vector3_almost_zeroS(theta2))
+        {
+            return;
+        }
+
+        double theta = sqrt(theta2);
+        double c = cos(0.5 * theta);
+        double s = sin(0.5 * theta) / theta;
+        V4 d = { c, s * rx, s * ry, s * rz };
+
+        // The turn is in the object's frame, so it goes on the right.
+        V4 r = {
+            q->w * d.w - q->x * d.x - q->y * d.y - q->z * d.z,
+            q->w * d.x + q->x * d.w + q->y * d.z - q->z * d.y,
+            q->w * d.y - q->x * d.z + q->y * d.w + q->z * d.x,
+            q->w * d.z + q->x * d.y - q->y * d.x + q->z * d.w
+        };
+
+        // Renormalize, so that rounding doesn't build up over many turns.
+        double l = 1.0 / sqrt(r.w * r.w + r.x * r.x + r.y * r.y + r.z * r.z);
+        Vector4_init(q, r.w * l, r.x * l, r.y * l, r.z * l);
+    }
+
+    void Vector4_get_basis(V4* q, V3* forward, V3* up, V3* right)
+    {
+        // The columns of the rotation matrix.
+        if (forward != NULL)
+        {
+            Vector3_init(forward,
+                1 - 2 * (q->y * q->y + q->z * q->z),
+                2 * (q->x * q->y + q->w * q->z),
+                2 * (q->x * q->z - q->w * q->y));
+        }
+
+        if (right != NULL)
+        {
+            Vector3_init(right,
+                2 * (q->x * q->y - q->w * q->z),
+                1 - 2 * (q->x * q->x + q->z * q->z),
+                2 * (q->y * q->z + q->w * q->x));
+        }
+
+        if (up != NULL)
+        {
+            Vector3_init(up,
+                2 * (q->x * q->z + q->w * q->y),
+                2 * (q->y * q->z - q->w * q->x),
+                1 - 2 * (q->x * q->x + q->y * q->y));
+        }
+    }
+
+    void Vector4_from_basis(V4* q, V3* forward, V3* up, V3* right)
+    {
+        // The rotation matrix has forward, right, and up as its columns. Work from whichever of the
+        // components is largest, to keep clear of dividing by something close to zero.
+        // See: Shepperd, Quaternion from rotation matrix, J. Guidance and Control 1(3) (1978)
+        double trace = forward->x + right->y + up->z;
+        if (trace > 0)
+        {
+            double s = 0.5 / sqrt(trace + 1.0);
+            Vector4_init(q, 0.25 / s, (right->z - up->y) * s, (up->x - forward->z) * s, (forward->y - right->x) * s);
+        }
+        else if ((forward->x > right->y) && (forward->x > up->z))
+        {
+            double s = 2.0 * sqrt(1.0 + forward->x - right->y - up->z);
+            Vector4_init(q, (right->z - up->y) / s, 0.25 * s, (right->x + forward->y) / s, (up->x + forward->z) / s);
+        }
+        else if (right->y > up->z)
+        {
+            double s = 2.0 * sqrt(1.0 + right->y - forward->x - up->z);
+            Vector4_init(q, (up->x - forward->z) / s, (right->x + forward->y) / s, 0.25 * s, (up->y + right->z) / s);
+        }
+        else
+        {
+            double s = 2.0 * sqrt(1.0 + up->z - forward->x - right->y);
+            Vector4_init(q, (forward->y - right->x) / s, (up->x + forward->z) / s, (up->y + right->z) / s, 0.25 * s);
+        }
+    }
+
     //! Compares two AABBs, and returns negative if the first comes before the second, positive if vice versa, and zero otherwise.
     int32_t Vector3_compare_aabb(struct AABB* a, struct AABB* b)
     {
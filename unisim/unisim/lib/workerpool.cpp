@@ -0,0 +1,114 @@
+#include "workerpool.hpp"
+
+namespace Diana
+{
+    void *WorkerPool_thread(void *poolV)
+    {
+        WorkerPool *pool = (WorkerPool *)poolV;
+        uint64_t seen = 0;
+
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lk(pool->lock);
+                pool->work_ready.wait(lk, [pool, seen]()
+                                      { return !pool->running || (pool->generation != seen); });
+
+                if (!pool->running)
+                {
+                    return NULL;
+                }
+
+                seen = pool->generation;
+            }
+
+            pool->drain();
+
+            std::unique_lock<std::mutex> lk(pool->lock);
+            pool->busy--;
+            if (pool->busy == 0)
+            {
+                pool->work_done.notify_all();
+            }
+        }
+
+        return NULL;
+    }
+
+    WorkerPool::WorkerPool(int32_t num_threads)
+    {
+        num_tasks = 0;
+        next_task = 0;
+        generation = 0;
+        busy = 0;
+        running = true;
+
+        for (int32_t i = 1; i < num_threads; i++)
+        {
+            helpers.push_back(std::thread(WorkerPool_thread, (void *)this));
+        }
+    }
+
+    WorkerPool::~WorkerPool()
+    {
+        {
+            std::unique_lock<std::mutex> lk(lock);
+            running = false;
+        }
+        work_ready.notify_all();
+
+        for (size_t i = 0; i < helpers.size(); i++)
+        {
+            if (helpers[i].joinable())
+            {
+                helpers[i].join();
+            }
+        }
+    }
+
+    int32_t WorkerPool::size()
+    {
+        return (int32_t)helpers.size() + 1;
+    }
+
+    void WorkerPool::drain()
+    {
+        size_t i;
+        while ((i = next_task.fetch_add(1)) < num_tasks)
+        {
+            work(i);
+        }
+    }
+
+    void WorkerPool::run(size_t n, std::function<void(size_t)> work)
+    {
+        // If there's nobody to share with, or nothing worth sharing, don't bother waking anyone.
+        if ((helpers.size() == 0) || (n <= 1))
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                work(i);
+            }
+            return;
+        }
+
+        {
+            std::unique_lock<std::mutex> lk(lock);
+            this->work = work;
+            num_tasks = n;
+            next_task = 0;
+            busy = (int32_t)helpers.size();
+            generation++;
+        }
+        work_ready.notify_all();
+
+        drain();
+    }
+
+    void WorkerPool::join()
+    {
+        std::unique_lock<std::mutex> lk(lock);
+        work_done.wait(lk, [this]()
+                       { return busy == 0; });
+    }
+}
@@ -4,24 +4,78 @@ double opt_beam_energy_cutoff = parser.get_basic_option(
             1e-10,
             "On initialization, a beam has a maximum distance that is calculated from it's spread values, energy, and this cutoff. The maximum distance, D, is the amount of distance travelled, such that the wavefront at D distance from the source has less than this amount of energy (Joules) per square metre of wavefront area. Raising this value will expire beams sooner, and this may improve performance if large number of beams are in use. This value is derived from commodity wireless transceivers that operate at -70dBmW. ", false).result.option_value;
 params.beam_energy_cutoff = opt_beam_energy_cutoff;
+int32_t opt_collision_broadphase = parser.get_basic_option(
+            "",
+            "--collision-broadphase",
+            0,
+            "Broad-phase collision detection strategy, used to find the pairs of objects that are close enough to need an exact collision test. 0: Sort all objects along the X axis every tick, and sweep along the sorted list. 1: Incremental sweep-and-prune, which keeps objects sorted on all three axes from tick to tick, as well as the set of overlapping pairs. This is cheapest when most objects move only a little relative to each other in each tick. 2: Multi-level spatial hash grid, which keeps the number of pair tests close to linear in dense, clustered scenes where many objects share the same X range. 3: Dynamic AABB tree, which handles universes that mix bodies of very different sizes, such as planets and ships, where a few huge boxes overlap nearly everything. ", false).result.option_value;
+params.collision_broadphase = opt_collision_broadphase;
 double opt_collision_energy_cutoff = parser.get_basic_option(
             "",
             "--collision-energy-cutoff",
             1e-9,
             "Collisions (physical or beam) that result in a transfer of energy below this amount are ignored. This helps to ensure that spurious collisions (stiction) are gracefully handled. ", false).result.option_value;
 params.collision_energy_cutoff = opt_collision_energy_cutoff;
+double opt_collision_grid_cell_size = parser.get_basic_option(
+            "",
+            "--collision-grid-cell-size",
+            0.0,
+            "Size (m) of the cells at the finest level of the spatial hash grid broad-phase. Each coarser level has cells twice as large as the one below it. If this is zero, the size of the smallest object's bounding box is used, and is recomputed every tick. ", false).result.option_value;
+params.collision_grid_cell_size = opt_collision_grid_cell_size;
+double opt_collision_huge_radius_factor = parser.get_basic_option(
+            "",
+            "--collision-huge-radius-factor",
+            100.0,
+            "Objects with a radius more than this many times the median radius of all objects are considered huge, and are kept out of the sorted list used by the default broad-phase. A single huge box overlaps a long stretch of the X axis, which defeats the early exit of the sweep, so huge objects are instead tested against the others with a dedicated search of the sorted list. Set to 0 to disable. ", false).result.option_value;
+params.collision_huge_radius_factor = opt_collision_huge_radius_factor;
+double opt_collision_tree_lookahead = parser.get_basic_option(
+            "",
+            "--collision-tree-lookahead",
+            0.01,
+            "Time (s) of travel at an object's current velocity by which its box is stretched, in the direction that it's moving, in the AABB tree broad-phase. An object keeps its cached pairs for as long as it stays inside of its stretched box, so larger values move objects less often, at the cost of more pairs that need an exact collision test. Tune this using the cache hits and misses in the collision metrics. ", false).result.option_value;
+params.collision_tree_lookahead = opt_collision_tree_lookahead;
+double opt_collision_tree_margin = parser.get_basic_option(
+            "",
+            "--collision-tree-margin",
+            0.1,
+            "Fraction of an object's bounding box size by which its box is enlarged on every side in the AABB tree broad-phase. Objects only need to be moved in the tree when they leave their enlarged box, so larger values move objects less often, at the cost of more pairs that need an exact collision test. ", false).result.option_value;
+params.collision_tree_margin = opt_collision_tree_margin;
+double opt_fixed_timestep = parser.get_basic_option(
+            "",
+            "--fixed-timestep",
+            0.0,
+            "When above zero, every physics tick is exactly this long, in unscaled simulated seconds, in place of one based on how long the last tick took, and the minimum and maximum physics frametimes are ignored. In real time, the wall-clock time that has passed is saved up and spent a tick at a time, and otherwise the ticks run back to back. Runs of the same scenario then give the same results. ", false).result.option_value;
+params.fixed_timestep = opt_fixed_timestep;
 double opt_gravitational_constant = parser.get_basic_option(
             "",
             "--gravitational-constant",
             6.67384e-11,
             "Universal gravitational constant. ", false).result.option_value;
 params.gravitational_constant = opt_gravitational_constant;
+int32_t opt_gravity_attractor_substeps = parser.get_basic_option(
+            "",
+            "--gravity-attractor-substeps",
+            1,
+            "Attractors are moved among themselves before everything else, and each physics tick is split into this many substeps for them. Raising this keeps close encounters and tight orbits between attractors accurate at large time steps, and costs one round of attractor-on-attractor gravity per substep. Everything else moves once per tick against where the attractors end up. ", false).result.option_value;
+params.gravity_attractor_substeps = opt_gravity_attractor_substeps;
+double opt_gravity_extrapolation_tolerance = parser.get_basic_option(
+            "",
+            "--gravity-extrapolation-tolerance",
+            0.0,
+            "When positive, the gravitational pull on objects that aren't attractors is only worked out in full every so often, and extrapolated from how fast it has been changing in between. The time until the next full evaluation is chosen so that the error in the extrapolation is about this fraction of the pull. Objects far from any attractor, whose pull barely changes, are then only looked at occasionally. Set to 0 to work out the pull on every object in full every tick. ", false).result.option_value;
+params.gravity_extrapolation_tolerance = opt_gravity_extrapolation_tolerance;
 double opt_gravity_magnitude_cutoff = parser.get_basic_option(
             "",
             "--gravity-magnitude-cutoff",
             0.01,
             "Objects that would produce a gravitational acceleration below this amount at their bounding radius are not considered attractors in the universe. This is used to optimize the selection of objects that are considered attractors for practical purposes, to reduce the O(N^2) nature of gravitational calculations. ", false).result.option_value;
 params.gravity_magnitude_cutoff = opt_gravity_magnitude_cutoff;
+double opt_gravity_opening_angle = parser.get_basic_option(
+            "",
+            "--gravity-opening-angle",
+            0.0,
+            "When positive, the pull of the attractors on each object is approximated with a Barnes-Hut octree, treating a group of attractors as a single body when its size is less than this fraction of its distance from the object. This makes gravity O(N log N) rather than O(N^2), which makes it practical to lower gravity_magnitude_cutoff so that many more objects attract. Values around 0.5 are typical, and keep the error in any one object's pull to a few percent. Set to 0 to sum over every attractor exactly. ", false).result.option_value;
+params.gravity_opening_angle = opt_gravity_opening_angle;
 double opt_health_damage_threshold = parser.get_basic_option(
             "",
             "--health-damage-threshold",
@@ -34,6 +88,18 @@ double opt_health_mass_scale = parser.get_basic_option(
             1e6,
             "Non-smart physics objects are assigned a number of hit points that is their mass multiplied by this value. ", false).result.option_value;
 params.health_mass_scale = opt_health_mass_scale;
+int32_t opt_integrator = parser.get_basic_option(
+            "",
+            "--integrator",
+            0,
+            "How objects are moved through each tick under gravity and thrust, unless they choose otherwise themselves. 0 is a single first order step, which takes the pull on the object from where it starts towards where the attractors end up, so that it shares the attractors' gravity trees. It is cheap but slowly gains or loses energy in orbits. 1 is velocity Verlet, which is second order and symplectic, and costs no more gravity than 0 since the acceleration at the end of one tick is carried over to the start of the next. 2 is Forest-Ruth, which is fourth order and symplectic, and works out gravity three times each tick. Attractors use a drift-kick-drift leapfrog for 0 and 1, and Forest-Ruth for 2. ", false).result.option_value;
+params.integrator = opt_integrator;
+int32_t opt_max_fixed_steps = parser.get_basic_option(
+            "",
+            "--max-fixed-steps",
+            5,
+            "The most fixed timesteps that are run to catch up with the wall-clock time before checking it again. Any further time that the simulation has fallen behind by is dropped, and the game world runs slower than real time. ", false).result.option_value;
+params.max_fixed_steps = opt_max_fixed_steps;
 double opt_max_physics_frametime = parser.get_basic_option(
             "",
             "--max-physics-frametime",
@@ -92,6 +158,18 @@ double opt_simulation_rate = parser.get_basic_option(
             1.0,
             "When paired with no_realtime_physics=true, this controls a simulation rate relative to realtime. Values <1.0 result in simulations that are slower than real time, and values >1.0 result in simulations faster than realtime. ", false).result.option_value;
 params.simulation_rate = opt_simulation_rate;
+double opt_sleep_gravity = parser.get_basic_option(
+            "",
+            "--sleep-gravity",
+            1e-6,
+            "The most gravitational acceleration, in metres/second^2, that an object can be under and still fall asleep, and the most that the gravity on a sleeping object can change by before it wakes up. ", false).result.option_value;
+params.sleep_gravity = opt_sleep_gravity;
+double opt_sleep_speed = parser.get_basic_option(
+            "",
+            "--sleep-speed",
+            0.0,
+            "Objects that have moved slower than this, in metres/second, for a little while, with no thrust or spin and little gravity on them, are put to sleep. Sleeping objects stay where they are, and are skipped when moving objects and when testing for collisions among themselves, until an awake object's box touches theirs, a beam hits them, their client changes their properties, or the gravity on them changes. Set to 0 to keep every object awake. ", false).result.option_value;
+params.sleep_speed = opt_sleep_speed;
 double opt_spectrum_slush_range = parser.get_basic_option(
             "",
             "--spectrum-slush-range",
@@ -104,6 +182,18 @@ double opt_speed_of_light = parser.get_basic_option(
             299792458l,
             "The speed of light in this universe. The defualt speed for beams, and the speed at which relativistic effects do/would take effect. ", false).result.option_value;
 params.speed_of_light = opt_speed_of_light;
+int32_t opt_timestep_levels = parser.get_basic_option(
+            "",
+            "--timestep-levels",
+            0,
+            "Objects whose gravitational pull changes quickly, such as those passing close to an attractor, are moved through each tick in 2, 4, 8 or more equal substeps, against where the attractors were at each substep, while everything else still takes the whole tick in one step. This is the most times that the tick is halved for any object, and 0 moves everything in one step. The attractors all take the finest substep that any of them needs. ", false).result.option_value;
+params.timestep_levels = opt_timestep_levels;
+double opt_timestep_tolerance = parser.get_basic_option(
+            "",
+            "--timestep-tolerance",
+            0.02,
+            "With timestep_levels above 0, each object's substep is picked so that its gravitational acceleration changes by about this fraction of itself over one substep, going by how fast it changed over the previous tick. ", false).result.option_value;
+params.timestep_tolerance = opt_timestep_tolerance;
 bool opt_verbose_logging = parser.get_flag_option(
             "",
             "--verbose-logging",
@@ -38,6 +38,8 @@ int main(int32_t argc, char **argv)
 
     bool opt_version = parser.get_flag_option("-v", "--version", "Print version of the binary and source code used to generate it. Includes date of last commit, state of working tree when built, and date and time of build", false).result.option_value;
 
+    std::string opt_rails_file = parser.get_basic_option("", "--rails-file", std::string(""), "CSV of bodies to put on rails before starting, with mass (M), radius (R) and position (P) lines as written by the ephemeris tools. A body with several position lines follows them as a table, and one with a single line is fit to an orbit around its parent", false).result.option_value;
+
     bool parse_success = parser.finished_parsing();
 
     if (!parse_success)
@@ -59,6 +61,20 @@ int main(int32_t argc, char **argv)
 
     Diana::Universe *u = new Diana::Universe(params);
 
+    if (opt_rails_file.size() > 0)
+    {
+        try
+        {
+            u->load_rails(opt_rails_file.c_str());
+        }
+        catch (std::runtime_error &e)
+        {
+            fprintf(stderr, "Unable to load rails from %s: %s\n", opt_rails_file.c_str(), e.what());
+            delete u;
+            return 1;
+        }
+    }
+
     u->start_net();
     u->start_sim();
 
@@ -0,0 +1,218 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <random>
+
+#include "physics.hpp"
+
+std::default_random_engine re(1234);
+
+// A beam from the origin along x, without a universe to expire it, so it can be ticked along freely.
+void make_beam(struct Diana::Beam *b, double cosine, double speed)
+{
+    b->universe = NULL;
+    Diana::Vector3_init(&b->origin, 0.0, 0.0, 0.0);
+    Diana::Vector3_init(&b->direction, 1.0, 0.0, 0.0);
+    Diana::Vector3_init(&b->up, 0.0, 0.0, 1.0);
+    Diana::Vector3_cross(&b->right, &b->direction, &b->up);
+    b->front_position = b->origin;
+    b->cosines[0] = cosine;
+    b->cosines[1] = cosine;
+    b->speed = speed;
+    b->area_factor = 1.0;
+    b->energy = 1e6;
+    b->distance_travelled = 0.0;
+    b->max_distance = INFINITY;
+}
+
+void make_target(struct Diana::PhysicsObject *o, double x, double y, double z, double vx)
+{
+    Diana::Vector3_init(&o->position, x, y, z);
+    Diana::Vector3_init(&o->velocity, vx, 0.0, 0.0);
+    o->radius = 1.0;
+}
+
+bool in_box(struct Diana::Beam *b, struct Diana::BeamCollisionResult *bcr, double dt)
+{
+    struct Diana::AABB box;
+    Diana::Beam_estimate_aabb(b, &box, dt);
+
+    struct Diana::Vector3 p;
+    Diana::Vector3_add(&p, &bcr->p, &b->origin);
+    double slack = 1e-9 * (1.0 + Diana::Vector3_length(&p));
+    return (p.x >= box.l.x - slack) && (p.x <= box.u.x + slack) &&
+           (p.y >= box.l.y - slack) && (p.y <= box.u.y + slack) &&
+           (p.z >= box.l.z - slack) && (p.z <= box.u.z + slack);
+}
+
+// Step the beam and the target along until the front reaches it, or give up after the given number
+// of ticks. Returns the tick that it was hit in, or -1.
+int32_t run(struct Diana::Beam *b, struct Diana::PhysicsObject *o, struct Diana::BeamCollisionResult *bcr, double dt, int32_t ticks, bool *box_ok)
+{
+    for (int32_t i = 0; i < ticks; i++)
+    {
+        Diana::Beam_collide(bcr, b, o, dt);
+        if (bcr->t >= 0.0)
+        {
+            *box_ok = in_box(b, bcr, dt);
+            return i;
+        }
+        Diana::Beam_tick(b, dt);
+        Diana::Vector3_fmad(&o->position, dt, &o->velocity);
+    }
+    return -1;
+}
+
+bool report(const char *name, bool ok)
+{
+    printf("%s: %s\n", name, (ok ? "OK" : "FAILED"));
+    return ok;
+}
+
+// A target that isn't moving is hit where it is, with the energy that a front at that distance
+// carries, as it always has been.
+bool check_stationary()
+{
+    struct Diana::Beam b;
+    struct Diana::PhysicsObject o = {};
+    struct Diana::BeamCollisionResult bcr;
+    make_beam(&b, cos(M_PI / 8), 100.0);
+    make_target(&o, 250.0, 20.0, -10.0, 0.0);
+
+    bool box_ok = false;
+    int32_t tick = run(&b, &o, &bcr, 1.0, 10, &box_ok);
+    double e = b.energy * fmin(1.0, M_PI * o.radius * o.radius / (b.area_factor * 250.0 * 250.0));
+    return report("Stationary target", (tick == 2) && box_ok && (fabs(bcr.t - 0.5) < 1e-12) &&
+                                           (bcr.p.x == 250.0) && (bcr.p.y == 20.0) && (bcr.p.z == -10.0) &&
+                                           (fabs(bcr.e - e) <= 1e-12 * e));
+}
+
+// A target coming towards the beam meets the front early, and is hit where it is at that point,
+// which is on the front.
+bool check_crossing()
+{
+    struct Diana::Beam b;
+    struct Diana::PhysicsObject o = {};
+    struct Diana::BeamCollisionResult bcr;
+    make_beam(&b, cos(M_PI / 8), 100.0);
+    make_target(&o, 260.0, 5.0, 5.0, -50.0);
+
+    // 260 - 50t = 100t puts the front on it at t = 1.7333..., in the second tick.
+    bool box_ok = false;
+    int32_t tick = run(&b, &o, &bcr, 1.0, 10, &box_ok);
+    double front = b.distance_travelled + b.speed * bcr.t;
+    return report("Target crossing the front", (tick == 1) && box_ok && (fabs(bcr.t - (260.0 / 150.0 - 1.0)) < 1e-12) &&
+                                                   (fabs(bcr.p.x - front) < 1e-9));
+}
+
+// A target running away faster than the beam is never caught, even though it is inside the cone
+// and ahead of the front the whole time.
+bool check_outrun()
+{
+    struct Diana::Beam b;
+    struct Diana::PhysicsObject o = {};
+    struct Diana::BeamCollisionResult bcr;
+    make_beam(&b, cos(M_PI / 8), 100.0);
+    make_target(&o, 10.0, 0.0, 0.0, 150.0);
+
+    bool box_ok = true;
+    int32_t tick = run(&b, &o, &bcr, 1.0, 100, &box_ok);
+    return report("Target outrunning the beam", tick == -1);
+}
+
+// When the front reaches the target right at the end of a tick, it's left for the next one rather
+// than being hit in both.
+bool check_end_of_tick()
+{
+    struct Diana::Beam b;
+    struct Diana::PhysicsObject o = {};
+    struct Diana::BeamCollisionResult bcr;
+    make_beam(&b, cos(M_PI / 8), 100.0);
+    make_target(&o, 200.0, 0.0, 0.0, 0.0);
+
+    bool box_ok = false;
+    int32_t tick = run(&b, &o, &bcr, 1.0, 10, &box_ok);
+    return report("Hit at the end of a tick", (tick == 2) && box_ok && (bcr.t == 0.0));
+}
+
+// Spreads past 90 degrees reach behind the origin, where the front is moving backwards.
+bool check_behind()
+{
+    struct Diana::Beam b;
+    struct Diana::PhysicsObject o = {};
+    struct Diana::BeamCollisionResult bcr;
+    make_beam(&b, cos(2 * M_PI / 3), 100.0);
+    // About 117 degrees off of the direction, measured in either plane, and 50 behind the origin.
+    make_target(&o, -50.0, 100.0, 100.0, 0.0);
+
+    bool box_ok = false;
+    int32_t tick = run(&b, &o, &bcr, 1.0, 10, &box_ok);
+    bool ok = (tick == 0) && box_ok && (fabs(bcr.t - 0.5) < 1e-12);
+
+    // A beam that doesn't reach that far round doesn't hit it.
+    make_beam(&b, cos(M_PI / 3), 100.0);
+    make_target(&o, -50.0, 100.0, 100.0, 0.0);
+    ok &= (run(&b, &o, &bcr, 1.0, 10, &box_ok) == -1);
+
+    return report("Target behind a wide beam", ok);
+}
+
+// Every hit, from beams pointing every which way at targets moving every which way, is inside the
+// box that the beam index uses to find it.
+bool check_boxes()
+{
+    std::uniform_real_distribution<double> pos(-1000.0, 1000.0);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+    bool ok = true;
+    int32_t num_hits = 0;
+    for (int32_t i = 0; ok && (i < 20000); i++)
+    {
+        struct Diana::Beam b;
+        make_beam(&b, 0.05 + 0.94 * unit(re), 300.0);
+        Diana::Vector3_init(&b.origin, pos(re), pos(re), pos(re));
+        Diana::Vector3_init(&b.direction, pos(re), pos(re), pos(re));
+        Diana::Vector3_normalize(&b.direction);
+        struct Diana::Vector3 r = {pos(re), pos(re), pos(re)};
+        Diana::Vector3_cross(&b.up, &b.direction, &r);
+        Diana::Vector3_normalize(&b.up);
+        Diana::Vector3_cross(&b.right, &b.direction, &b.up);
+        b.cosines[1] = 0.05 + 0.94 * unit(re);
+        b.distance_travelled = 1000.0 * unit(re);
+
+        struct Diana::PhysicsObject o = {};
+        make_target(&o, pos(re), pos(re), pos(re), 0.0);
+        Diana::Vector3_add(&o.position, &b.origin);
+        Diana::Vector3_init(&o.velocity, pos(re), pos(re), pos(re));
+
+        struct Diana::BeamCollisionResult bcr;
+        Diana::Beam_collide(&bcr, &b, &o, 1.0);
+        if (bcr.t >= 0.0)
+        {
+            num_hits++;
+            if (!in_box(&b, &bcr, 1.0))
+            {
+                fprintf(stderr, "Hit %d at (%g, %g, %g) is outside the beam's box\n", i, bcr.p.x, bcr.p.y, bcr.p.z);
+                ok = false;
+            }
+        }
+    }
+
+    // Make sure that there was something to check.
+    ok &= (num_hits > 100);
+    printf("Hits inside the beam box (%d hits): %s\n", num_hits, (ok ? "OK" : "FAILED"));
+    return ok;
+}
+
+int main(int32_t argc, char **argv)
+{
+    bool ok = true;
+    ok &= check_stationary();
+    ok &= check_crossing();
+    ok &= check_outrun();
+    ok &= check_end_of_tick();
+    ok &= check_behind();
+    ok &= check_boxes();
+    return (ok ? 0 : 1);
+}
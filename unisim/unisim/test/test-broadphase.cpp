@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <random>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "broadphase.hpp"
+
+typedef std::set<std::pair<int64_t, int64_t>> PairSet;
+
+std::default_random_engine re(1234);
+
+void random_box(struct Diana::PhysicsObject *o)
+{
+    std::uniform_real_distribution<double> pos(-1000.0, 1000.0);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+    // Mostly small boxes, with the occasional huge one, to exercise the mixed-scale cases.
+    double size = (unit(re) < 0.02 ? 500.0 : 10.0) * unit(re);
+    o->box.l.x = pos(re);
+    o->box.l.y = pos(re) * 0.05;
+    o->box.l.z = pos(re) * 0.05;
+    o->box.u.x = o->box.l.x + size;
+    o->box.u.y = o->box.l.y + size * unit(re);
+    o->box.u.z = o->box.l.z + size * unit(re);
+
+    // Only the AABB tree looks at the velocity, to stretch its boxes ahead of each object.
+    o->velocity.x = pos(re);
+    o->velocity.y = pos(re) * 0.05;
+    o->velocity.z = pos(re) * 0.05;
+}
+
+void nudge_box(struct Diana::PhysicsObject *o)
+{
+    std::uniform_real_distribution<double> step(-2.0, 2.0);
+    double d[3] = {step(re), step(re), step(re)};
+    o->box.l.x += d[0];
+    o->box.u.x += d[0];
+    o->box.l.y += d[1];
+    o->box.u.y += d[1];
+    o->box.l.z += d[2];
+    o->box.u.z += d[2];
+}
+
+bool overlap(struct Diana::AABB *a, struct Diana::AABB *b)
+{
+    return (a->u.x >= b->l.x) && (b->u.x >= a->l.x) &&
+           (a->u.y >= b->l.y) && (b->u.y >= a->l.y) &&
+           (a->u.z >= b->l.z) && (b->u.z >= a->l.z);
+}
+
+std::pair<int64_t, int64_t> key(struct Diana::PhysicsObject *a, struct Diana::PhysicsObject *b)
+{
+    return std::make_pair(std::min(a->phys_id, b->phys_id), std::max(a->phys_id, b->phys_id));
+}
+
+// Every overlapping pair has to be reported exactly once. Reporting extra pairs whose boxes don't
+// overlap is allowed, since the narrow-phase filters those out.
+bool check_pairs(const char *name, int32_t step, std::vector<struct Diana::PhysicsObject *> &objs, Diana::BroadPhase *bp)
+{
+    PairSet expected;
+    for (size_t i = 0; i < objs.size(); i++)
+    {
+        for (size_t j = i + 1; j < objs.size(); j++)
+        {
+            if (overlap(&objs[i]->box, &objs[j]->box))
+            {
+                expected.insert(key(objs[i], objs[j]));
+            }
+        }
+    }
+
+    std::vector<struct Diana::BroadPhasePair> pairs;
+    bp->get_pairs(pairs);
+
+    PairSet found;
+    for (size_t i = 0; i < pairs.size(); i++)
+    {
+        if (!found.insert(key(pairs[i].obj1, pairs[i].obj2)).second)
+        {
+            fprintf(stderr, "%s step %d: duplicate pair\n", name, step);
+            return false;
+        }
+    }
+
+    for (PairSet::iterator it = expected.begin(); it != expected.end(); it++)
+    {
+        if (found.find(*it) == found.end())
+        {
+            fprintf(stderr, "%s step %d: missed pair (%ld, %ld)\n", name, step, (long)it->first, (long)it->second);
+            return false;
+        }
+    }
+
+    // Queries have to find every object that overlaps the query box.
+    struct Diana::AABB q = objs[0]->box;
+    std::vector<struct Diana::PhysicsObject *> hits;
+    bp->query(&q, hits);
+    std::set<struct Diana::PhysicsObject *> hit_set(hits.begin(), hits.end());
+    for (size_t i = 0; i < objs.size(); i++)
+    {
+        if (overlap(&q, &objs[i]->box) && (hit_set.find(objs[i]) == hit_set.end()))
+        {
+            fprintf(stderr, "%s step %d: query missed object %ld\n", name, step, (long)objs[i]->phys_id);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool test_broadphase(const char *name, int32_t type)
+{
+    Diana::BroadPhase *bp = Diana::BroadPhase_create(type, 0.0, 0.1, 0.01);
+    std::vector<struct Diana::PhysicsObject *> objs;
+    int64_t next_id = 0;
+    bool ok = true;
+
+    for (int32_t step = 0; ok && (step < 50); step++)
+    {
+        // Add a batch of objects on the first step, and a few more on every step after that.
+        int32_t num_new = (step == 0 ? 1000 : 10);
+        for (int32_t i = 0; i < num_new; i++)
+        {
+            struct Diana::PhysicsObject *o = (struct Diana::PhysicsObject *)calloc(1, sizeof(struct Diana::PhysicsObject));
+            o->phys_id = next_id++;
+            o->proxy = -1;
+            random_box(o);
+            bp->insert(o);
+            objs.push_back(o);
+        }
+
+        // Remove a few at random.
+        for (int32_t i = 0; (step > 0) && (i < 8); i++)
+        {
+            size_t k = re() % objs.size();
+            bp->remove(objs[k]);
+            free(objs[k]);
+            objs[k] = objs.back();
+            objs.pop_back();
+        }
+
+        for (size_t i = 0; i < objs.size(); i++)
+        {
+            nudge_box(objs[i]);
+        }
+
+        bp->update();
+        ok = check_pairs(name, step, objs, bp);
+    }
+
+    delete bp;
+    for (size_t i = 0; i < objs.size(); i++)
+    {
+        free(objs[i]);
+    }
+
+    printf("%s: %s\n", name, (ok ? "OK" : "FAILED"));
+    return ok;
+}
+
+int main(int32_t argc, char **argv)
+{
+    bool ok = true;
+    ok &= test_broadphase("Sweep and prune", Diana::BROADPHASE_SWEEP_AND_PRUNE);
+    ok &= test_broadphase("Spatial hash grid", Diana::BROADPHASE_HASH_GRID);
+    ok &= test_broadphase("AABB tree", Diana::BROADPHASE_AABB_TREE);
+    return (ok ? 0 : 1);
+}
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <stdexcept>
+
+#include "ephemeris.hpp"
+#include "physics.hpp"
+
+bool close_to(struct Diana::Vector3 *a, struct Diana::Vector3 *b, double tolerance)
+{
+    struct Diana::Vector3 d = {a->x - b->x, a->y - b->y, a->z - b->z};
+    return (Diana::Vector3_length(&d) <= tolerance * Diana::Vector3_length(b));
+}
+
+// An orbit fit through a state has to give that state back at its epoch, and again one period later.
+bool check_kepler(const char *name, struct Diana::Vector3 position, struct Diana::Vector3 velocity)
+{
+    // The Sun and the Earth, roughly.
+    double mu = 6.67384e-11 * (1.988544e30 + 5.97219e24);
+    double epoch = 1234.5;
+
+    struct Diana::KeplerOrbit orbit;
+    Diana::KeplerOrbit_from_state(&orbit, mu, &position, &velocity, epoch);
+
+    bool ok = true;
+    double period = 2 * M_PI / orbit.n;
+    double times[2] = {epoch, epoch + period};
+    for (int32_t i = 0; i < 2; i++)
+    {
+        struct Diana::Vector3 p;
+        struct Diana::Vector3 v;
+        Diana::KeplerOrbit_evaluate(&orbit, times[i], &p, &v);
+        if (!close_to(&p, &position, 1e-9) || !close_to(&v, &velocity, 1e-9))
+        {
+            fprintf(stderr, "%s at t=%g: position (%g, %g, %g), velocity (%g, %g, %g)\n", name, times[i], p.x, p.y, p.z, v.x, v.y, v.z);
+            ok = false;
+        }
+    }
+
+    printf("Kepler %s (e=%g): %s\n", name, orbit.e, (ok ? "OK" : "FAILED"));
+    return ok;
+}
+
+// The spline has to go through every sample exactly, including the ends of the table.
+bool check_table()
+{
+    struct Diana::EphemerisTable table;
+    for (int32_t i = 0; i < 10; i++)
+    {
+        double t = 100.0 * i;
+        struct Diana::Vector3 p = {cos(0.01 * t), sin(0.01 * t), 0.001 * t};
+        struct Diana::Vector3 v = {-0.01 * sin(0.01 * t), 0.01 * cos(0.01 * t), 0.001};
+        Diana::EphemerisTable_add(&table, t, &p, &v);
+    }
+
+    bool ok = true;
+    for (size_t i = 0; i < table.times.size(); i++)
+    {
+        struct Diana::Vector3 p;
+        struct Diana::Vector3 v;
+        Diana::EphemerisTable_evaluate(&table, table.times[i], &p, &v);
+        struct Diana::Vector3 *p0 = &table.positions[i];
+        struct Diana::Vector3 *v0 = &table.velocities[i];
+        if ((p.x != p0->x) || (p.y != p0->y) || (p.z != p0->z) || (v.x != v0->x) || (v.y != v0->y) || (v.z != v0->z))
+        {
+            fprintf(stderr, "Table sample %lu at t=%g: position (%g, %g, %g), velocity (%g, %g, %g)\n", (unsigned long)i, table.times[i], p.x, p.y, p.z, v.x, v.y, v.z);
+            ok = false;
+        }
+    }
+
+    // Samples have to be added in order.
+    try
+    {
+        struct Diana::Vector3 zero = {0.0, 0.0, 0.0};
+        Diana::EphemerisTable_add(&table, 50.0, &zero, &zero);
+        fprintf(stderr, "Out of order sample was accepted\n");
+        ok = false;
+    }
+    catch (std::runtime_error &e)
+    {
+        ok &= (strcmp(e.what(), "Ephemeris::TableOrder") == 0);
+    }
+
+    printf("Ephemeris table: %s\n", (ok ? "OK" : "FAILED"));
+    return ok;
+}
+
+// A chain of parents counts up to the first object off of rails, and a loop of them is caught
+// rather than followed forever.
+bool check_depth()
+{
+    const int32_t n = 5;
+    struct Diana::PhysicsObject objs[n];
+    struct Diana::Rails rails[n];
+    memset(objs, 0, sizeof(objs));
+
+    bool ok = true;
+    for (int32_t i = 0; i < n; i++)
+    {
+        rails[i].type = Diana::RAILS_KEPLER;
+        rails[i].parent = (i > 0 ? &objs[i - 1] : NULL);
+        objs[i].rails = &rails[i];
+    }
+    // The bottom of the chain is the first object, which is on rails of its own but has no parent.
+    ok &= (Diana::Rails_depth(&rails[n - 1]) == n - 1);
+
+    objs[0].rails = NULL;
+    ok &= (Diana::Rails_depth(&rails[n - 1]) == n - 2);
+
+    objs[0].rails = &rails[0];
+    rails[0].parent = &objs[n - 1];
+    try
+    {
+        Diana::Rails_depth(&rails[n - 1]);
+        fprintf(stderr, "Rails cycle was not caught\n");
+        ok = false;
+    }
+    catch (std::runtime_error &e)
+    {
+        ok &= (strcmp(e.what(), "Ephemeris::RailsCycle") == 0);
+    }
+
+    printf("Rails depth: %s\n", (ok ? "OK" : "FAILED"));
+    return ok;
+}
+
+int main(int32_t argc, char **argv)
+{
+    bool ok = true;
+    ok &= check_kepler("circular", {1.496e11, 0.0, 0.0}, {0.0, 29784.7, 0.0});
+    ok &= check_kepler("eccentric", {1.2e11, -3.0e10, 8.0e9}, {9000.0, 36000.0, -2500.0});
+    ok &= check_table();
+    ok &= check_depth();
+    return (ok ? 0 : 1);
+}
@@ -13,9 +13,9 @@ void check_packing()
     struct Diana::PhysicsObject p;
     // On g++ 64-bit, we need %lu, all other times we need %llu
 #if __x86_64__
-    printf("%lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu\n",
+    printf("%lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu\n",
 #else
-    printf("%llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu\n",
+    printf("%llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu\n",
 #endif
         (uint64_t)&p.type - (uint64_t)&p,
         (uint64_t)&p.phys_id - (uint64_t)&p,
@@ -26,9 +26,7 @@ void check_packing()
         (uint64_t)&p.velocity - (uint64_t)&p,
         (uint64_t)&p.ang_velocity - (uint64_t)&p,
         (uint64_t)&p.thrust - (uint64_t)&p,
-        (uint64_t)&p.forward - (uint64_t)&p,
-        (uint64_t)&p.up - (uint64_t)&p,
-        (uint64_t)&p.right - (uint64_t)&p,
+        (uint64_t)&p.orientation - (uint64_t)&p,
         (uint64_t)&p.mass - (uint64_t)&p,
         (uint64_t)&p.radius - (uint64_t)&p,
         (uint64_t)&p.health - (uint64_t)&p,
@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <random>
+#include <vector>
+
+#include "narrowphase.hpp"
+#include "gravity.hpp"
+
+// The vector paths in SweepBatch_test() and AttractorSet_pull() only exist when built for AVX2, and
+// this is only worth building that way.
+#ifndef __AVX2__
+#error "test-simd has to be built with -mavx2"
+#endif
+
+std::default_random_engine re(1234);
+
+struct Diana::PhysicsObject *random_object(int64_t phys_id, double spread, double speed)
+{
+    std::uniform_real_distribution<double> pos(-spread, spread);
+    std::uniform_real_distribution<double> vel(-speed, speed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+    struct Diana::PhysicsObject *o = (struct Diana::PhysicsObject *)calloc(1, sizeof(struct Diana::PhysicsObject));
+    o->phys_id = phys_id;
+    o->position.x = pos(re);
+    o->position.y = pos(re);
+    o->position.z = pos(re);
+
+    // A few objects that aren't moving, which the test turns away before solving anything.
+    if (unit(re) > 0.05)
+    {
+        o->velocity.x = vel(re);
+        o->velocity.y = vel(re);
+        o->velocity.z = vel(re);
+    }
+
+    o->radius = 0.5 + unit(re);
+    o->mass = 1e3 + 1e9 * unit(re);
+    return o;
+}
+
+// Pairs tested four at a time have to come out the same as when they're tested on their own, which
+// a batch of one always is.
+bool check_sweep()
+{
+    std::vector<struct Diana::PhysicsObject *> objs;
+    for (int64_t i = 0; i < 2000; i++)
+    {
+        objs.push_back(random_object(i, 3.0, 2000.0));
+    }
+
+    struct Diana::SweepBatch batch;
+    struct Diana::SweepBatch single;
+    Diana::SweepBatch_init(&batch);
+    Diana::SweepBatch_init(&single);
+
+    for (size_t i = 0; i + 1 < objs.size(); i += 2)
+    {
+        Diana::SweepBatch_add(&batch, objs[i], objs[i + 1], 0.002);
+    }
+    size_t num_hits = Diana::SweepBatch_test(&batch);
+
+    bool ok = true;
+    size_t num_single_hits = 0;
+    for (size_t i = 0; ok && (i < batch.size); i++)
+    {
+        Diana::SweepBatch_clear(&single);
+        Diana::SweepBatch_add(&single, batch.obj1[i], batch.obj2[i], 0.002);
+        num_single_hits += Diana::SweepBatch_test(&single);
+
+        if (single.hit[0] != batch.hit[i])
+        {
+            fprintf(stderr, "Sweep pair %lu: vector %d, scalar %d\n", (unsigned long)i, batch.hit[i], single.hit[0]);
+            ok = false;
+        }
+    }
+
+    if (ok && (num_hits != num_single_hits))
+    {
+        fprintf(stderr, "Sweep hits: vector %lu, scalar %lu\n", (unsigned long)num_hits, (unsigned long)num_single_hits);
+        ok = false;
+    }
+
+    for (size_t i = 0; i < objs.size(); i++)
+    {
+        free(objs[i]);
+    }
+
+    printf("Sweep batch (%lu of %lu hit): %s\n", (unsigned long)num_hits, (unsigned long)batch.size, (ok ? "OK" : "FAILED"));
+    return ok;
+}
+
+// The pull from a whole set of attractors has to match the sum of the pulls from each on its own,
+// which never fills a vector register, up to the order that the terms are added in.
+bool check_pull()
+{
+    std::vector<struct Diana::PhysicsObject *> objs;
+    // An odd number, so that there are some left over after the vector loop.
+    for (int64_t i = 0; i < 1003; i++)
+    {
+        objs.push_back(random_object(i, 1e6, 0.0));
+    }
+
+    struct Diana::AttractorSet set;
+    Diana::AttractorSet_init(&set);
+    for (size_t i = 0; i < objs.size(); i++)
+    {
+        Diana::AttractorSet_add(&set, objs[i]);
+    }
+    Diana::AttractorSet_refresh(&set);
+
+    bool ok = true;
+    // One of the attractors, which has to leave itself out, and something that isn't an attractor.
+    struct Diana::PhysicsObject *targets[2] = {objs[17], random_object(-1, 1e6, 0.0)};
+    for (int32_t k = 0; ok && (k < 2); k++)
+    {
+        struct Diana::Vector3 g = {0.0, 0.0, 0.0};
+        Diana::AttractorSet_pull(&set, &g, targets[k], 6.67384e-11);
+
+        struct Diana::Vector3 expected = {0.0, 0.0, 0.0};
+        struct Diana::Vector3 magnitude = {0.0, 0.0, 0.0};
+        for (size_t i = 0; i < objs.size(); i++)
+        {
+            struct Diana::AttractorSet one;
+            Diana::AttractorSet_init(&one);
+            Diana::AttractorSet_add(&one, objs[i]);
+            Diana::AttractorSet_refresh(&one);
+
+            struct Diana::Vector3 gi = {0.0, 0.0, 0.0};
+            Diana::AttractorSet_pull(&one, &gi, targets[k], 6.67384e-11);
+            expected.x += gi.x;
+            expected.y += gi.y;
+            expected.z += gi.z;
+            magnitude.x += fabs(gi.x);
+            magnitude.y += fabs(gi.y);
+            magnitude.z += fabs(gi.z);
+        }
+
+        double err[3] = {fabs(g.x - expected.x), fabs(g.y - expected.y), fabs(g.z - expected.z)};
+        double bound[3] = {1e-12 * magnitude.x, 1e-12 * magnitude.y, 1e-12 * magnitude.z};
+        for (int32_t d = 0; d < 3; d++)
+        {
+            if (!(err[d] <= bound[d]))
+            {
+                fprintf(stderr, "Pull on target %d, axis %d: off by %g, allowed %g\n", k, d, err[d], bound[d]);
+                ok = false;
+            }
+        }
+    }
+
+    free(targets[1]);
+    for (size_t i = 0; i < objs.size(); i++)
+    {
+        free(objs[i]);
+    }
+
+    printf("Attractor pull: %s\n", (ok ? "OK" : "FAILED"));
+    return ok;
+}
+
+int main(int32_t argc, char **argv)
+{
+    if (!__builtin_cpu_supports("avx2"))
+    {
+        printf("No AVX2 on this CPU, skipping\n");
+        return 0;
+    }
+
+    bool ok = true;
+    ok &= check_sweep();
+    ok &= check_pull();
+    return (ok ? 0 : 1);
+}